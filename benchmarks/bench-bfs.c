@@ -0,0 +1,112 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+/* Measures how long csp_process_bfs takes to explore a large interleaving, with
+ * and without huge pages.  The model is COMPONENT_COUNT copies of a → b → STOP
+ * (with distinct events), interleaved, which has 3^COMPONENT_COUNT states.
+ * Each run happens in a fresh child process, so that the second run can't
+ * reuse the memory that the first one allocated.  Run this via `make bench`. */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csp0.h"
+#include "environment.h"
+#include "huge-pages.h"
+#include "memory.h"
+#include "process.h"
+
+#define COMPONENT_COUNT 11
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct count_processes {
+    struct csp_process_visitor visitor;
+    size_t count;
+};
+
+static int
+count_processes_visit(struct csp *csp, struct csp_process_visitor *visitor,
+                      struct csp_process *process)
+{
+    struct count_processes *self = (struct count_processes *) visitor;
+    self->count++;
+    return CSP_PROCESS_BFS_CONTINUE;
+}
+
+static void
+run(bool huge_pages)
+{
+    char model[1024] = "⫴ {";
+    struct csp *csp;
+    struct csp_process *process;
+    struct count_processes count = {{count_processes_visit}, 0};
+    struct csp_memory_stats stats;
+    double start;
+    double elapsed;
+    size_t i;
+
+    for (i = 0; i < COMPONENT_COUNT; i++) {
+        char component[64];
+        snprintf(component, sizeof(component), "%sa%zu → b%zu → STOP",
+                 i == 0 ? "" : ", ", i, i);
+        strcat(model, component);
+    }
+    strcat(model, "}");
+
+    csp_set_huge_pages(huge_pages);
+    csp = csp_new();
+    process = csp_load_csp0_string(csp, model);
+    start = now();
+    csp_process_bfs(csp, process, &count.visitor);
+    elapsed = now() - start;
+    csp_memory_stats(&stats);
+    printf("%-14s %8zu states %8.3f s   %8.1f ns/state   %7.1f MiB peak\n",
+           huge_pages ? "huge pages" : "regular pages", count.count, elapsed,
+           elapsed * 1e9 / count.count,
+           (stats.categories[CSP_MEMORY_JUDY].peak_bytes +
+            stats.categories[CSP_MEMORY_PROCESSES].peak_bytes) /
+                   (1024.0 * 1024.0));
+    csp_free(csp);
+}
+
+static void
+run_in_child(bool huge_pages)
+{
+    int status;
+    pid_t pid = fork();
+    if (pid == 0) {
+        run(huge_pages);
+        exit(EXIT_SUCCESS);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "Benchmark run failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int
+main(void)
+{
+    /* Flush before forking so that the children don't repeat our output. */
+    fflush(stdout);
+    run_in_child(false);
+    run_in_child(true);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+/* Compares the hash functions that we use to construct IDs against ccan's
+ * hash64_any, which is what we used to use for everything.  Run this via `make
+ * bench`. */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ccan/hash/hash.h"
+#include "id-hash.h"
+
+#define WORD_ITERATIONS 50000000
+#define NAME_ITERATIONS 20000000
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *name, double start, double end, size_t iterations,
+       uint64_t result)
+{
+    /* Print the result so that the compiler can't throw the loop away. */
+    printf("%-24s %8.2f ns/hash   (%016" PRIx64 ")\n", name,
+           (end - start) * 1e9 / iterations, result);
+}
+
+static void
+bench_words(void)
+{
+    size_t i;
+    uint64_t id;
+    double start;
+
+    /* Each hash depends on the previous one, just like a chain of
+     * csp_id_add_id calls. */
+    id = 0;
+    start = now();
+    for (i = 0; i < WORD_ITERATIONS; i++) {
+        id = csp_id_hash_word(i, id);
+    }
+    report("csp_id_hash_word", start, now(), WORD_ITERATIONS, id);
+
+    id = 0;
+    start = now();
+    for (i = 0; i < WORD_ITERATIONS; i++) {
+        uint64_t value = i;
+        id = hash64_any(&value, sizeof(value), id);
+    }
+    report("hash64_any (8 bytes)", start, now(), WORD_ITERATIONS, id);
+}
+
+static void
+bench_names(void)
+{
+    static const char *const names[] = {"a", "tick", "left.send", "P",
+                                        "a_fairly_long_process_name"};
+    static const size_t lengths[] = {1, 4, 9, 1, 26};
+    size_t i;
+    uint64_t id;
+    double start;
+
+    id = 0;
+    start = now();
+    for (i = 0; i < NAME_ITERATIONS; i++) {
+        id = csp_id_hash_bytes(names[i % 5], lengths[i % 5], id);
+    }
+    report("csp_id_hash_bytes", start, now(), NAME_ITERATIONS, id);
+
+    id = 0;
+    start = now();
+    for (i = 0; i < NAME_ITERATIONS; i++) {
+        id = hash64_any(names[i % 5], lengths[i % 5], id);
+    }
+    report("hash64_any (names)", start, now(), NAME_ITERATIONS, id);
+}
+
+int
+main(void)
+{
+    bench_words();
+    bench_names();
+    return EXIT_SUCCESS;
+}
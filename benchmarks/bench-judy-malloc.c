@@ -0,0 +1,84 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+/* Measures how well Judy-heavy set churn scales with the number of threads.
+ * Each thread repeatedly builds up a Judy1 array of pseudo-random keys and then
+ * frees it, which is the allocation pattern that our sets see during a
+ * refinement check.  With per-thread caches, the throughput per thread should
+ * stay roughly flat as we add threads.  Run this via `make bench`. */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define JUDYERROR_NOTEST 1
+#include <Judy.h>
+
+#define MAX_THREADS 8
+#define ROUNDS 200
+#define KEYS_PER_ROUND 10000
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+churn(void *vseed)
+{
+    uint64_t state = (uintptr_t) vseed;
+    size_t round;
+    for (round = 0; round < ROUNDS; round++) {
+        Pvoid_t array = NULL;
+        Word_t freed;
+        int rc;
+        size_t i;
+        for (i = 0; i < KEYS_PER_ROUND; i++) {
+            state = state * UINT64_C(6364136223846793005) +
+                    UINT64_C(1442695040888963407);
+            J1S(rc, array, (Word_t) (state >> 40));
+        }
+        J1FA(freed, array);
+        (void) rc;
+        (void) freed;
+    }
+    return NULL;
+}
+
+int
+main(void)
+{
+    size_t thread_count;
+    double baseline = 0;
+    for (thread_count = 1; thread_count <= MAX_THREADS; thread_count *= 2) {
+        pthread_t threads[MAX_THREADS];
+        double start;
+        double elapsed;
+        double rate;
+        size_t t;
+        start = now();
+        for (t = 0; t < thread_count; t++) {
+            pthread_create(&threads[t], NULL, churn, (void *) (uintptr_t) (t + 1));
+        }
+        for (t = 0; t < thread_count; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        elapsed = now() - start;
+        rate = thread_count * ROUNDS * KEYS_PER_ROUND / elapsed / 1e6;
+        if (thread_count == 1) {
+            baseline = rate;
+        }
+        printf("%zu thread(s): %8.2f M inserts/s   (%.2fx)\n", thread_count,
+               rate, rate / baseline);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+/* Measures how long it takes to iterate through sets that are too big to store
+ * inline, comparing csp_set_foreach against calling Judy1Next directly on the
+ * set's Judy array.  Sets with at most 31 elements live in a single root-level
+ * leaf, which csp_set_foreach steps through without calling Judy1Next.  Run this
+ * via `make bench`. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define JUDYERROR_NOTEST 1
+#include <Judy.h>
+
+#include "set.h"
+
+#define ELEMENTS_PER_RUN 100000000
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run(size_t size)
+{
+    struct csp_set set;
+    struct csp_set_iterator iter;
+    size_t rounds = ELEMENTS_PER_RUN / size;
+    uintptr_t sum = 0;
+    double start;
+    double foreach_ns;
+    double judy_ns;
+    size_t i;
+
+    csp_set_init(&set);
+    for (i = 0; i < size; i++) {
+        /* Spread the elements out like heap pointers. */
+        csp_set_add(&set, (void *) (uintptr_t) (0x10000 + i * 48));
+    }
+
+    start = now();
+    for (i = 0; i < rounds; i++) {
+        csp_set_foreach (&set, &iter) {
+            sum += (uintptr_t) csp_set_iterator_get(&iter);
+        }
+    }
+    foreach_ns = (now() - start) * 1e9 / (rounds * size);
+
+    start = now();
+    for (i = 0; i < rounds; i++) {
+        Word_t key = 0;
+        int found;
+        J1F(found, set.elements.judy, key);
+        while (found) {
+            sum += key;
+            J1N(found, set.elements.judy, key);
+        }
+    }
+    judy_ns = (now() - start) * 1e9 / (rounds * size);
+
+    /* Print the sum so that the compiler can't throw the loops away. */
+    printf("%5zu elements   foreach %6.2f ns/element   Judy1Next %6.2f "
+           "ns/element   (%zx)\n",
+           size, foreach_ns, judy_ns, (size_t) sum);
+    csp_set_done(&set, NULL, NULL);
+}
+
+int
+main(void)
+{
+    static const size_t sizes[] = {8, 16, 31, 32, 1000};
+    size_t i;
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run(sizes[i]);
+    }
+    return EXIT_SUCCESS;
+}
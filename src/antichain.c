@@ -0,0 +1,218 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "antichain.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ccan/likely/likely.h"
+#include "map.h"
+#include "process.h"
+
+static void
+csp_antichain_node_init(struct csp_antichain_node *node)
+{
+    node->terminal = false;
+    csp_map_init(&node->children);
+}
+
+static void
+csp_antichain_node_free_entry(void *ud, void *entry);
+
+static void
+csp_antichain_node_done(struct csp_antichain_node *node)
+{
+    csp_map_done(&node->children, csp_antichain_node_free_entry, NULL);
+}
+
+static void
+csp_antichain_node_free_entry(void *ud, void *entry)
+{
+    struct csp_antichain_node *node = entry;
+    csp_antichain_node_done(node);
+    free(node);
+}
+
+static void
+csp_antichain_node_init_entry(void *ud, void **entry)
+{
+    struct csp_antichain_node *node = malloc(sizeof(struct csp_antichain_node));
+    assert(node != NULL);
+    csp_antichain_node_init(node);
+    *entry = node;
+}
+
+void
+csp_antichain_init(struct csp_antichain *antichain)
+{
+    csp_antichain_node_init(&antichain->root);
+    antichain->size = 0;
+    antichain->indices = NULL;
+    antichain->indices_capacity = 0;
+}
+
+void
+csp_antichain_done(struct csp_antichain *antichain)
+{
+    csp_antichain_node_done(&antichain->root);
+    free(antichain->indices);
+}
+
+size_t
+csp_antichain_size(const struct csp_antichain *antichain)
+{
+    return antichain->size;
+}
+
+static int
+csp_antichain_compare_indices(const void *vi1, const void *vi2)
+{
+    const size_t *i1 = vi1;
+    const size_t *i2 = vi2;
+    return (*i1 < *i2) ? -1 : (*i1 > *i2) ? 1 : 0;
+}
+
+/* Fills in the antichain's scratch array with the index of each process in
+ * `set`, in ascending order, and returns it.  The array is only valid until the
+ * next call. */
+static size_t *
+csp_antichain_sorted_indices(struct csp_antichain *antichain,
+                             const struct csp_process_set *set, size_t *count)
+{
+    struct csp_process_set_iterator iter;
+    size_t *indices;
+    size_t i = 0;
+    *count = csp_process_set_size(set);
+    if (unlikely(*count > antichain->indices_capacity)) {
+        size_t new_capacity = antichain->indices_capacity * 2;
+        if (new_capacity < *count) {
+            new_capacity = *count;
+        }
+        antichain->indices =
+                realloc(antichain->indices, new_capacity * sizeof(size_t));
+        assert(antichain->indices != NULL);
+        antichain->indices_capacity = new_capacity;
+    }
+    indices = antichain->indices;
+    csp_process_set_foreach (set, &iter) {
+        struct csp_process *process = csp_process_set_iterator_get(&iter);
+        indices[i++] = process->index;
+    }
+    qsort(indices, *count, sizeof(size_t), csp_antichain_compare_indices);
+    return indices;
+}
+
+/* Returns whether the subtrie rooted at `node` contains a path that only uses
+ * indices from `indices`. */
+static bool
+csp_antichain_node_has_subset(const struct csp_antichain_node *node,
+                              const size_t *indices, size_t count)
+{
+    size_t i;
+    if (node->terminal) {
+        return true;
+    }
+    /* Any subset stored under this node must continue with one of the
+     * remaining indices; since indices are stored in ascending order, once we
+     * try a particular index, we never need to consider the earlier ones
+     * again. */
+    for (i = 0; i < count; i++) {
+        const struct csp_antichain_node *child =
+                csp_map_get(&node->children, indices[i]);
+        if (child != NULL &&
+            csp_antichain_node_has_subset(child, indices + i + 1,
+                                          count - i - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns the number of sets stored in the subtrie rooted at `node`. */
+static size_t
+csp_antichain_node_count(const struct csp_antichain_node *node)
+{
+    struct csp_map_iterator iter;
+    size_t count = node->terminal ? 1 : 0;
+    csp_map_foreach (&node->children, &iter) {
+        count += csp_antichain_node_count(*iter.value);
+    }
+    return count;
+}
+
+/* Removes every path in the subtrie rooted at `node` that uses all of the
+ * indices in `indices`, along with any nodes that no longer lead to a stored
+ * set.  Returns the number of sets that were removed. */
+static size_t
+csp_antichain_node_remove_supersets(struct csp_antichain_node *node,
+                                    const size_t *indices, size_t count)
+{
+    struct csp_map_iterator iter;
+    size_t removed = 0;
+    if (count == 0) {
+        /* Every set below this node is a superset. */
+        removed = csp_antichain_node_count(node);
+        node->terminal = false;
+        csp_antichain_node_done(node);
+        csp_map_init(&node->children);
+        return removed;
+    }
+    /* Since indices are stored in ascending order, a child whose index is
+     * larger than the first one we're looking for can't lead to a path that
+     * contains it.  (Advancing the iterator only needs the current key, so it's
+     * safe to remove the current child.) */
+    csp_map_foreach (&node->children, &iter) {
+        struct csp_antichain_node *child = *iter.value;
+        if (iter.key > indices[0]) {
+            break;
+        } else if (iter.key == indices[0]) {
+            removed += csp_antichain_node_remove_supersets(child, indices + 1,
+                                                           count - 1);
+        } else {
+            removed += csp_antichain_node_remove_supersets(child, indices,
+                                                           count);
+        }
+        if (!child->terminal && csp_map_empty(&child->children)) {
+            csp_map_remove(&node->children, iter.key,
+                           csp_antichain_node_free_entry, NULL);
+        }
+    }
+    return removed;
+}
+
+bool
+csp_antichain_has_subset(struct csp_antichain *antichain,
+                         const struct csp_process_set *set)
+{
+    size_t count;
+    size_t *indices = csp_antichain_sorted_indices(antichain, set, &count);
+    return csp_antichain_node_has_subset(&antichain->root, indices, count);
+}
+
+bool
+csp_antichain_add(struct csp_antichain *antichain,
+                  const struct csp_process_set *set)
+{
+    size_t count;
+    size_t i;
+    size_t *indices = csp_antichain_sorted_indices(antichain, set, &count);
+    struct csp_antichain_node *node = &antichain->root;
+    if (csp_antichain_node_has_subset(node, indices, count)) {
+        return false;
+    }
+    antichain->size -=
+            csp_antichain_node_remove_supersets(node, indices, count);
+    for (i = 0; i < count; i++) {
+        node = csp_map_insert(&node->children, indices[i],
+                              csp_antichain_node_init_entry, NULL);
+    }
+    node->terminal = true;
+    antichain->size++;
+    return true;
+}
@@ -0,0 +1,64 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HST_ANTICHAIN_H
+#define HST_ANTICHAIN_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "map.h"
+#include "process.h"
+
+/* A collection of process sets that can efficiently answer "have we already
+ * seen a subset of this set?"  Each set is stored as a path through a trie,
+ * with the indices of the set's processes in ascending order.
+ *
+ * We only ever add a set if no subset of it is already present.  When we do
+ * add a set, we remove any existing supersets of it, since they can never
+ * change the answer to a subset query (the new set would satisfy any query that
+ * they would).  That keeps the collection a true antichain, whose size is
+ * bounded by the number of pairwise incomparable sets we've seen. */
+struct csp_antichain_node {
+    bool terminal;
+    /* Maps a process index to the child node for that index. */
+    struct csp_map children;
+};
+
+struct csp_antichain {
+    struct csp_antichain_node root;
+    size_t size;
+    /* Scratch space for sorting the indices of the set we're looking up, so
+     * that we don't allocate a new array for every query. */
+    size_t *indices;
+    size_t indices_capacity;
+};
+
+void
+csp_antichain_init(struct csp_antichain *antichain);
+
+void
+csp_antichain_done(struct csp_antichain *antichain);
+
+/* Returns the number of sets in the antichain.  (Doesn't include any sets that
+ * were removed because a subset of them was added later.) */
+size_t
+csp_antichain_size(const struct csp_antichain *antichain);
+
+/* Returns whether `antichain` contains a subset of `set` (including `set`
+ * itself). */
+bool
+csp_antichain_has_subset(struct csp_antichain *antichain,
+                         const struct csp_process_set *set);
+
+/* Adds `set` to `antichain`, unless it already contains a subset of `set`, and
+ * removes any existing supersets of `set`.  Returns whether `set` was added. */
+bool
+csp_antichain_add(struct csp_antichain *antichain,
+                  const struct csp_process_set *set);
+
+#endif /* HST_ANTICHAIN_H */
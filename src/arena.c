@@ -0,0 +1,166 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "arena.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccan/likely/likely.h"
+#include "huge-pages.h"
+
+/* Chunks start out small, so that an environment that only creates a handful
+ * of processes doesn't waste much memory, and then double in size (up to a
+ * limit) so that large checks only need a handful of chunks. */
+#define CSP_ARENA_MIN_CHUNK_SIZE ((size_t) 4 * 1024)
+#define CSP_ARENA_MAX_CHUNK_SIZE ((size_t) 1024 * 1024)
+
+/* With huge pages on, chunks keep doubling until they fill a whole huge page,
+ * since that's the smallest chunk that we'll back with a huge-page region. */
+#define CSP_ARENA_MAX_HUGE_CHUNK_SIZE CSP_HUGE_PAGE_SIZE
+
+struct csp_arena_chunk {
+    struct csp_arena_chunk *next;
+    size_t size;
+    /* Whether this chunk is a huge-page region, rather than coming from
+     * malloc. */
+    bool huge_pages;
+} __attribute__((aligned(CSP_ARENA_ALIGNMENT)));
+
+#define CSP_ARENA_ROUND_UP(size) \
+    (((size) + CSP_ARENA_ALIGNMENT - 1) & ~((size_t) CSP_ARENA_ALIGNMENT - 1))
+
+void
+csp_arena_init(struct csp_arena *arena)
+{
+    arena->chunks = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+    arena->chunk_size = CSP_ARENA_MIN_CHUNK_SIZE;
+    memset(arena->free_lists, 0, sizeof(arena->free_lists));
+    arena->allocated_bytes = 0;
+}
+
+void
+csp_arena_done(struct csp_arena *arena)
+{
+    struct csp_arena_chunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        struct csp_arena_chunk *next = chunk->next;
+        if (chunk->huge_pages) {
+            csp_huge_pages_unmap(chunk, chunk->size);
+        } else {
+            free(chunk);
+        }
+        chunk = next;
+    }
+}
+
+/* With huge pages, the chunk might be larger than you asked for; check its
+ * `size`.  We only use a huge-page region for chunks that are at least a huge
+ * page long, since rounding anything smaller up would waste most of the region,
+ * and we fall back on malloc if the OS won't give us one. */
+static struct csp_arena_chunk *
+csp_arena_chunk_new(size_t size)
+{
+    struct csp_arena_chunk *chunk;
+    if (csp_huge_pages_enabled() && size >= CSP_HUGE_PAGE_SIZE) {
+        size_t region_size = size;
+        chunk = csp_huge_pages_map(&region_size);
+        if (likely(chunk != NULL)) {
+            chunk->huge_pages = true;
+            chunk->size = region_size;
+            return chunk;
+        }
+    }
+    chunk = malloc(size);
+    assert(chunk != NULL);
+    chunk->huge_pages = false;
+    chunk->size = size;
+    return chunk;
+}
+
+static void *
+csp_arena_alloc_slow(struct csp_arena *arena, size_t size)
+{
+    struct csp_arena_chunk *chunk;
+    size_t needed = sizeof(struct csp_arena_chunk) + size;
+
+    /* Allocations that are large compared to our chunks get a chunk of their
+     * own, which we link in behind the current chunk so that we can keep using
+     * whatever's left of the current one. */
+    if (needed > arena->chunk_size / 4) {
+        chunk = csp_arena_chunk_new(needed);
+        if (arena->chunks == NULL) {
+            chunk->next = NULL;
+            arena->chunks = chunk;
+        } else {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        }
+        return chunk + 1;
+    }
+
+    chunk = csp_arena_chunk_new(arena->chunk_size);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->next = (char *) (chunk + 1) + size;
+    arena->end = (char *) chunk + chunk->size;
+    if (arena->chunk_size < (csp_huge_pages_enabled()
+                                     ? CSP_ARENA_MAX_HUGE_CHUNK_SIZE
+                                     : CSP_ARENA_MAX_CHUNK_SIZE)) {
+        arena->chunk_size *= 2;
+    }
+    return chunk + 1;
+}
+
+/* Returns the free list for allocations of `size` bytes (which must already be
+ * rounded up), or NULL if we don't recycle allocations of that size. */
+static void **
+csp_arena_free_list(struct csp_arena *arena, size_t size)
+{
+    if (size == 0 || size > CSP_ARENA_MAX_RECYCLED_SIZE) {
+        return NULL;
+    }
+    return &arena->free_lists[size / CSP_ARENA_ALIGNMENT - 1];
+}
+
+void *
+csp_arena_alloc(struct csp_arena *arena, size_t size)
+{
+    void *result;
+    void **free_list;
+    size = CSP_ARENA_ROUND_UP(size);
+    arena->allocated_bytes += size;
+    free_list = csp_arena_free_list(arena, size);
+    if (free_list != NULL && *free_list != NULL) {
+        result = *free_list;
+        *free_list = *(void **) result;
+        return result;
+    }
+    if (unlikely((size_t) (arena->end - arena->next) < size)) {
+        return csp_arena_alloc_slow(arena, size);
+    }
+    result = arena->next;
+    arena->next += size;
+    return result;
+}
+
+void
+csp_arena_free(struct csp_arena *arena, void *ptr, size_t size)
+{
+    void **free_list;
+    size = CSP_ARENA_ROUND_UP(size);
+    arena->allocated_bytes -= size;
+    free_list = csp_arena_free_list(arena, size);
+    if (free_list != NULL) {
+        *(void **) ptr = *free_list;
+        *free_list = ptr;
+    }
+}
@@ -0,0 +1,66 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HST_ARENA_H
+#define HST_ARENA_H
+
+#include <stdlib.h>
+
+/* An arena hands out memory from a small number of large, contiguous chunks.
+ * Allocating is just a pointer bump, and everything in the arena is freed at
+ * once when you call csp_arena_done.  This is a good fit for process nodes,
+ * which are created constantly during a check, and which mostly live until
+ * their environment (or session) is freed.
+ *
+ * You can also give an individual allocation back to the arena, if you know
+ * its size.  Small allocations are kept on a free list for their size, and
+ * reused by later allocations of the same size; the chunk memory itself isn't
+ * returned to the system until csp_arena_done.
+ *
+ * If huge pages are turned on (see huge-pages.h), each chunk is a huge-page
+ * region instead of coming from malloc. */
+
+/* Every allocation is aligned to this many bytes. */
+#define CSP_ARENA_ALIGNMENT 16
+
+/* Freed allocations larger than this aren't reused. */
+#define CSP_ARENA_MAX_RECYCLED_SIZE 256
+#define CSP_ARENA_FREE_LIST_COUNT \
+    (CSP_ARENA_MAX_RECYCLED_SIZE / CSP_ARENA_ALIGNMENT)
+
+struct csp_arena_chunk;
+
+struct csp_arena {
+    struct csp_arena_chunk *chunks;
+    /* The unused part of the current chunk. */
+    char *next;
+    char *end;
+    /* The size of the next chunk that we'll allocate. */
+    size_t chunk_size;
+    /* Freed allocations, by size.  Each one starts with a pointer to the next
+     * allocation in the list. */
+    void *free_lists[CSP_ARENA_FREE_LIST_COUNT];
+    /* The number of bytes that have been allocated and not yet freed. */
+    size_t allocated_bytes;
+};
+
+void
+csp_arena_init(struct csp_arena *arena);
+
+void
+csp_arena_done(struct csp_arena *arena);
+
+/* Allocates `size` bytes from the arena.  The memory is not zeroed. */
+void *
+csp_arena_alloc(struct csp_arena *arena, size_t size);
+
+/* Gives an allocation back to the arena.  `size` must be the same size that you
+ * passed to csp_arena_alloc. */
+void
+csp_arena_free(struct csp_arena *arena, void *ptr, size_t size);
+
+#endif /* HST_ARENA_H */
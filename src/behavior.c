@@ -16,25 +16,23 @@
 void
 csp_behavior_init(struct csp_behavior *behavior)
 {
-    csp_event_set_init(&behavior->initials);
+    behavior->initials = NULL;
+    csp_event_set_init(&behavior->scratch);
 }
 
 void
 csp_behavior_done(struct csp_behavior *behavior)
 {
-    csp_event_set_done(&behavior->initials);
+    csp_event_set_done(&behavior->scratch);
 }
 
 bool
 csp_behavior_eq(const struct csp_behavior *b1, const struct csp_behavior *b2)
 {
-    if (b1->hash != b2->hash) {
-        return false;
-    }
     if (unlikely(b1->model != b2->model)) {
         return false;
     }
-    return csp_event_set_eq(&b1->initials, &b2->initials);
+    return b1->initials == b2->initials;
 }
 
 bool
@@ -44,14 +42,15 @@ csp_behavior_refines(const struct csp_behavior *spec,
     if (unlikely(spec->model != impl->model)) {
         return false;
     }
-    return csp_event_set_subseteq(&impl->initials, &spec->initials);
+    return impl->initials == spec->initials ||
+           csp_event_set_subseteq(impl->initials, spec->initials);
 }
 
 static void
 csp_process_add_traces_behavior(struct csp *csp, struct csp_process *process,
                                 struct csp_behavior *behavior)
 {
-    struct csp_collect_events collect = csp_collect_events(&behavior->initials);
+    struct csp_collect_events collect = csp_collect_events(&behavior->scratch);
     csp_process_visit_initials(csp, process, &collect.visitor);
 }
 
@@ -59,15 +58,16 @@ static void
 csp_behavior_finish_traces(struct csp *csp, struct csp_behavior *behavior)
 {
     behavior->model = CSP_TRACES;
-    csp_event_set_remove(&behavior->initials, csp->tau);
-    behavior->hash = csp_event_set_hash(&behavior->initials);
+    csp_event_set_remove(&behavior->scratch, csp->tau);
+    behavior->initials = csp_intern_event_set(csp, &behavior->scratch);
+    behavior->hash = csp_interned_event_set_id(behavior->initials);
 }
 
 static void
 csp_process_get_traces_behavior(struct csp *csp, struct csp_process *process,
                                 struct csp_behavior *behavior)
 {
-    csp_event_set_clear(&behavior->initials);
+    csp_event_set_clear(&behavior->scratch);
     csp_process_add_traces_behavior(csp, process, behavior);
     csp_behavior_finish_traces(csp, behavior);
 }
@@ -92,7 +92,7 @@ csp_process_set_get_traces_behavior(struct csp *csp,
                                     struct csp_behavior *behavior)
 {
     struct csp_process_set_iterator iter;
-    csp_event_set_clear(&behavior->initials);
+    csp_event_set_clear(&behavior->scratch);
     csp_process_set_foreach (processes, &iter) {
         struct csp_process *process = csp_process_set_iterator_get(&iter);
         csp_process_add_traces_behavior(csp, process, behavior);
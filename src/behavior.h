@@ -21,8 +21,14 @@ enum csp_semantic_model { CSP_TRACES };
 
 struct csp_behavior {
     enum csp_semantic_model model;
+    /* The ID of the interned `initials` set.  Two behaviors from the same
+     * environment are equal exactly when their hashes are. */
     csp_id hash;
-    struct csp_event_set initials;
+    /* Interned in the environment that the behavior was calculated in, so you
+     * can compare these by pointer. */
+    const struct csp_event_set *initials;
+    /* Where we collect the initials before interning them. */
+    struct csp_event_set scratch;
 };
 
 void
@@ -0,0 +1,266 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "bitmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccan/likely/likely.h"
+
+/*------------------------------------------------------------------------------
+ * Containers
+ */
+
+#define CSP_BITMAP_WORD_COUNT 1024 /* 65536 bits */
+
+enum csp_bitmap_container_type { CSP_BITMAP_ARRAY, CSP_BITMAP_BITMAP };
+
+struct csp_bitmap_container {
+    uint16_t key;
+    enum csp_bitmap_container_type type;
+    /* The number of values in an array container.  Unused for bitmap
+     * containers. */
+    uint32_t length;
+    uint32_t allocated;
+    union {
+        uint16_t *values;
+        uint64_t *words;
+    } data;
+};
+
+static uint16_t
+csp_bitmap_high(uint32_t value)
+{
+    return value >> 16;
+}
+
+static uint16_t
+csp_bitmap_low(uint32_t value)
+{
+    return value & 0xffff;
+}
+
+static void
+csp_bitmap_container_init_array(struct csp_bitmap_container *container,
+                                uint16_t key)
+{
+    container->key = key;
+    container->type = CSP_BITMAP_ARRAY;
+    container->length = 0;
+    container->allocated = 4;
+    container->data.values = malloc(4 * sizeof(uint16_t));
+    assert(container->data.values != NULL);
+}
+
+static void
+csp_bitmap_container_done(struct csp_bitmap_container *container)
+{
+    /* Both of the union members are heap pointers, so it doesn't matter which
+     * one we free. */
+    free(container->data.values);
+}
+
+/* Return the index of the first element of `values` that is >= `low`. */
+static uint32_t
+csp_bitmap_array_lower_bound(const uint16_t *values, uint32_t length,
+                             uint16_t low)
+{
+    uint32_t lo = 0;
+    uint32_t hi = length;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (values[mid] < low) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool
+csp_bitmap_words_contains(const uint64_t *words, uint16_t low)
+{
+    return (words[low / 64] >> (low % 64)) & 1;
+}
+
+static bool
+csp_bitmap_words_add(uint64_t *words, uint16_t low)
+{
+    uint64_t mask = UINT64_C(1) << (low % 64);
+    bool is_new = (words[low / 64] & mask) == 0;
+    words[low / 64] |= mask;
+    return is_new;
+}
+
+static void
+csp_bitmap_container_to_bitmap(struct csp_bitmap_container *container)
+{
+    uint64_t *words = calloc(CSP_BITMAP_WORD_COUNT, sizeof(uint64_t));
+    uint32_t i;
+    assert(words != NULL);
+    for (i = 0; i < container->length; i++) {
+        csp_bitmap_words_add(words, container->data.values[i]);
+    }
+    free(container->data.values);
+    container->type = CSP_BITMAP_BITMAP;
+    container->length = 0;
+    container->allocated = 0;
+    container->data.words = words;
+}
+
+static bool
+csp_bitmap_container_contains(const struct csp_bitmap_container *container,
+                              uint16_t low)
+{
+    uint32_t i;
+    if (container->type == CSP_BITMAP_BITMAP) {
+        return csp_bitmap_words_contains(container->data.words, low);
+    }
+    i = csp_bitmap_array_lower_bound(container->data.values, container->length,
+                                     low);
+    return i < container->length && container->data.values[i] == low;
+}
+
+static bool
+csp_bitmap_container_add(struct csp_bitmap_container *container, uint16_t low)
+{
+    uint32_t i;
+    if (container->type == CSP_BITMAP_BITMAP) {
+        return csp_bitmap_words_add(container->data.words, low);
+    }
+
+    i = csp_bitmap_array_lower_bound(container->data.values, container->length,
+                                     low);
+    if (i < container->length && container->data.values[i] == low) {
+        return false;
+    }
+    if (unlikely(container->length == CSP_BITMAP_ARRAY_MAX)) {
+        csp_bitmap_container_to_bitmap(container);
+        csp_bitmap_words_add(container->data.words, low);
+        return true;
+    }
+    if (container->length == container->allocated) {
+        container->allocated *= 2;
+        if (container->allocated > CSP_BITMAP_ARRAY_MAX) {
+            container->allocated = CSP_BITMAP_ARRAY_MAX;
+        }
+        container->data.values =
+                realloc(container->data.values,
+                        container->allocated * sizeof(uint16_t));
+        assert(container->data.values != NULL);
+    }
+    memmove(&container->data.values[i + 1], &container->data.values[i],
+            (container->length - i) * sizeof(uint16_t));
+    container->data.values[i] = low;
+    container->length++;
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Bitmaps
+ */
+
+void
+csp_bitmap_init(struct csp_bitmap *bitmap)
+{
+    bitmap->containers = NULL;
+    bitmap->container_count = 0;
+    bitmap->allocated_count = 0;
+    bitmap->size = 0;
+}
+
+void
+csp_bitmap_done(struct csp_bitmap *bitmap)
+{
+    size_t i;
+    for (i = 0; i < bitmap->container_count; i++) {
+        csp_bitmap_container_done(&bitmap->containers[i]);
+    }
+    free(bitmap->containers);
+}
+
+bool
+csp_bitmap_empty(const struct csp_bitmap *bitmap)
+{
+    return bitmap->size == 0;
+}
+
+size_t
+csp_bitmap_size(const struct csp_bitmap *bitmap)
+{
+    return bitmap->size;
+}
+
+/* Returns the index of the first container whose key is >= `key`. */
+static size_t
+csp_bitmap_find_container(const struct csp_bitmap *bitmap, uint16_t key)
+{
+    size_t lo = 0;
+    size_t hi = bitmap->container_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (bitmap->containers[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Makes room for a new container at index `i`, and returns it.  You must
+ * initialize the container. */
+static struct csp_bitmap_container *
+csp_bitmap_insert_container(struct csp_bitmap *bitmap, size_t i)
+{
+    if (bitmap->container_count == bitmap->allocated_count) {
+        bitmap->allocated_count =
+                bitmap->allocated_count == 0 ? 4 : bitmap->allocated_count * 2;
+        bitmap->containers =
+                realloc(bitmap->containers, bitmap->allocated_count *
+                                                    sizeof(*bitmap->containers));
+        assert(bitmap->containers != NULL);
+    }
+    memmove(&bitmap->containers[i + 1], &bitmap->containers[i],
+            (bitmap->container_count - i) * sizeof(*bitmap->containers));
+    bitmap->container_count++;
+    return &bitmap->containers[i];
+}
+
+bool
+csp_bitmap_contains(const struct csp_bitmap *bitmap, uint32_t value)
+{
+    uint16_t key = csp_bitmap_high(value);
+    size_t i = csp_bitmap_find_container(bitmap, key);
+    return i < bitmap->container_count && bitmap->containers[i].key == key &&
+           csp_bitmap_container_contains(&bitmap->containers[i],
+                                         csp_bitmap_low(value));
+}
+
+bool
+csp_bitmap_add(struct csp_bitmap *bitmap, uint32_t value)
+{
+    uint16_t key = csp_bitmap_high(value);
+    size_t i = csp_bitmap_find_container(bitmap, key);
+    struct csp_bitmap_container *container;
+    if (i < bitmap->container_count && bitmap->containers[i].key == key) {
+        container = &bitmap->containers[i];
+    } else {
+        container = csp_bitmap_insert_container(bitmap, i);
+        csp_bitmap_container_init_array(container, key);
+    }
+    if (csp_bitmap_container_add(container, csp_bitmap_low(value))) {
+        bitmap->size++;
+        return true;
+    }
+    return false;
+}
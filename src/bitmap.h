@@ -0,0 +1,61 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HST_BITMAP_H
+#define HST_BITMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* A compressed bitmap of 32-bit values, in the style of Roaring bitmaps.  The
+ * values are split into 64K-sized chunks based on their upper 16 bits, and each
+ * nonempty chunk is stored in a "container" whose representation depends on how
+ * dense the chunk is:
+ *
+ *   - An array container holds a sorted array of the lower 16 bits of each
+ *     value.  We use this for chunks with at most CSP_BITMAP_ARRAY_MAX values.
+ *
+ *   - A bitmap container holds a 64K-bit bitmap, which we use for denser
+ *     chunks.
+ *
+ * We use these as "visited" sets during explorations, keyed by each process's
+ * `index`.  Those are small and dense, and all we ever need to do is add a
+ * value and find out whether it was already there. */
+
+#define CSP_BITMAP_ARRAY_MAX 4096
+
+struct csp_bitmap_container;
+
+struct csp_bitmap {
+    struct csp_bitmap_container *containers;
+    size_t container_count;
+    size_t allocated_count;
+    size_t size;
+};
+
+void
+csp_bitmap_init(struct csp_bitmap *bitmap);
+
+void
+csp_bitmap_done(struct csp_bitmap *bitmap);
+
+bool
+csp_bitmap_empty(const struct csp_bitmap *bitmap);
+
+size_t
+csp_bitmap_size(const struct csp_bitmap *bitmap);
+
+bool
+csp_bitmap_contains(const struct csp_bitmap *bitmap, uint32_t value);
+
+/* Add a single value to a bitmap.  Return whether the value is new (i.e., it
+ * wasn't already in `bitmap`.) */
+bool
+csp_bitmap_add(struct csp_bitmap *bitmap, uint32_t value);
+
+#endif /* HST_BITMAP_H */
@@ -13,16 +13,19 @@
 
 #include "ccan/compiler/compiler.h"
 #include "ccan/container_of/container_of.h"
-#include "ccan/hash/hash.h"
 #include "ccan/likely/likely.h"
+#include "arena.h"
 #include "event.h"
+#include "id-hash.h"
 #include "map.h"
+#include "memory.h"
 #include "process.h"
+#include "side-table.h"
 
 static uint64_t
 hash_sized_name(const char *name, size_t name_length)
 {
-    return hash64_any(name, name_length, 0);
+    return csp_id_hash_bytes(name, name_length, 0);
 }
 
 static uint64_t
@@ -55,24 +58,26 @@ csp_stop_afters(struct csp *csp, struct csp_process *process,
 {
 }
 
+static void
+csp_stop_references(struct csp *csp, struct csp_process *process,
+                    struct csp_process_visitor *visitor)
+{
+}
+
 static void
 csp_stop_free(struct csp *csp, struct csp_process *process)
 {
 }
 
 static const struct csp_process_iface csp_stop_iface = {
-        1, csp_stop_name, csp_stop_initials, csp_stop_afters, csp_stop_free};
+        1, csp_stop_name, csp_stop_initials, csp_stop_afters,
+        csp_stop_references, csp_stop_free};
 
-static struct csp_process *
-csp_stop(void)
+static void
+csp_stop_init(struct csp_process *stop)
 {
-    static struct csp_process stop;
-    static bool initialized = false;
-    if (unlikely(!initialized)) {
-        stop.id = hash_name("STOP");
-        stop.iface = &csp_stop_iface;
-    }
-    return &stop;
+    stop->id = hash_name("STOP");
+    stop->iface = &csp_stop_iface;
 }
 
 static void
@@ -99,25 +104,27 @@ csp_skip_afters(struct csp *csp, struct csp_process *process,
     }
 }
 
+static void
+csp_skip_references(struct csp *csp, struct csp_process *process,
+                    struct csp_process_visitor *visitor)
+{
+    csp_process_visitor_call(csp, visitor, csp->stop);
+}
+
 static void
 csp_skip_free(struct csp *csp, struct csp_process *process)
 {
 }
 
 static const struct csp_process_iface csp_skip_iface = {
-        1, csp_skip_name, csp_skip_initials, csp_skip_afters, csp_skip_free};
+        1, csp_skip_name, csp_skip_initials, csp_skip_afters,
+        csp_skip_references, csp_skip_free};
 
-static struct csp_process *
-csp_skip(void)
-{
-    static struct csp_process skip;
-    static bool initialized = false;
-    if (unlikely(!initialized)) {
-        skip.id = hash_name("skip");
-        skip.iface = &csp_skip_iface;
-        initialized = true;
-    }
-    return &skip;
+static void
+csp_skip_init(struct csp_process *skip)
+{
+    skip->id = hash_name("skip");
+    skip->iface = &csp_skip_iface;
 }
 
 /*------------------------------------------------------------------------------
@@ -131,7 +138,9 @@ struct csp_id_process_map {
 static void
 csp_id_process_map_init(struct csp_id_process_map *map)
 {
-    csp_map_init(&map->map);
+    /* Every operator constructor looks up its process here, and process IDs
+     * are random hashes, so a hash table is a better fit than a JudyL array. */
+    csp_map_init_hashed(&map->map);
 }
 
 static void
@@ -160,6 +169,91 @@ csp_id_process_map_at(struct csp_id_process_map *map, csp_id id)
     return (struct csp_process **) csp_map_at(&map->map, id);
 }
 
+/* Doesn't free the process. */
+static void
+csp_id_process_map_remove(struct csp_id_process_map *map, csp_id id)
+{
+    csp_map_remove(&map->map, id, NULL, NULL);
+}
+
+/*------------------------------------------------------------------------------
+ * Sessions
+ */
+
+struct csp_session_cleanup {
+    struct csp_session_cleanup *next;
+    csp_session_cleanup_f *cleanup;
+    void *ud;
+};
+
+/* Each session owns the processes that were registered while it was the
+ * innermost session, along with the arena that their nodes were allocated
+ * from.  Indices are assigned sequentially (other than the ones that the
+ * session reuses after a garbage collection), so a session's processes are
+ * exactly the ones whose indices are at least `first_index`. */
+struct csp_session {
+    struct csp_session *parent;
+    size_t first_index;
+    struct csp_id_process_map processes;
+    struct csp_arena arena;
+    /* Allocated from `arena`, so we don't have to free these separately. */
+    struct csp_session_cleanup *cleanups;
+    /* How many bytes of process nodes survived the last garbage collection. */
+    size_t gc_survivor_bytes;
+    /* The indices of the processes that the garbage collector has freed, which
+     * we hand out again before growing `process_count`. */
+    size_t *free_indices;
+    size_t free_index_count;
+    size_t free_index_allocated_count;
+    /* The processes from enclosing sessions that refer to processes in this
+     * one (see csp_session_remember_process). */
+    struct csp_process_set remembered;
+    /* The event sets that were first interned while this was the innermost
+     * session.  (The table's parent is the enclosing session's table.) */
+    struct csp_event_set_table event_sets;
+};
+
+static void
+csp_session_init(struct csp_session *session, struct csp_session *parent,
+                 size_t first_index)
+{
+    session->parent = parent;
+    session->first_index = first_index;
+    csp_id_process_map_init(&session->processes);
+    csp_arena_init(&session->arena);
+    session->cleanups = NULL;
+    session->gc_survivor_bytes = 0;
+    session->free_indices = NULL;
+    session->free_index_count = 0;
+    session->free_index_allocated_count = 0;
+    csp_process_set_init(&session->remembered);
+    if (parent == NULL) {
+        csp_event_set_table_init(&session->event_sets);
+    } else {
+        csp_event_set_table_init_child(&session->event_sets,
+                                       &parent->event_sets);
+    }
+}
+
+static void
+csp_session_done(struct csp *csp, struct csp_session *session)
+{
+    struct csp_session_cleanup *cleanup;
+    /* Run the cleanup callbacks first, since they're allowed to look at (but
+     * not create) processes from this session. */
+    for (cleanup = session->cleanups; cleanup != NULL;
+         cleanup = cleanup->next) {
+        cleanup->cleanup(csp, cleanup->ud);
+    }
+    csp_id_process_map_done(csp, &session->processes);
+    /* Every process has already released anything that it owns, so now we can
+     * free the nodes themselves. */
+    csp_arena_done(&session->arena);
+    csp_event_set_table_done(&session->event_sets);
+    free(session->free_indices);
+    csp_process_set_done(&session->remembered);
+}
+
 /*------------------------------------------------------------------------------
  * Environment
  */
@@ -168,9 +262,81 @@ struct csp_priv {
     struct csp public;
     csp_id next_recursion_scope_id;
     size_t process_count;
-    struct csp_id_process_map processes;
+    /* The same processes as in `sessions`, indexed by their `index` */
+    struct csp_side_table processes_by_index;
+    /* Each environment has its own copies of the predefined processes, since
+     * registering a process assigns it an index. */
+    struct csp_process stop;
+    struct csp_process skip;
+    /* The outermost session, which lasts as long as the environment, and the
+     * innermost one, which new processes are registered in. */
+    struct csp_session root;
+    struct csp_session *current;
+    /* Garbage collector state for each process, indexed by its `index` */
+    struct csp_side_table gc_entries;
+    unsigned int gc_epoch;
+    size_t gc_high_water_mark;
+    /* How much memory we last reported for our registry tables */
+    size_t registry_bytes;
+    /* How much memory our process nodes are using (see csp_alloc) */
+    size_t process_bytes;
+    /* How much of that we haven't reported to the global CSP_MEMORY_PROCESSES
+     * counter yet.  Like the Judy allocator, we batch up our reports so that
+     * creating a process doesn't have to touch a shared atomic. */
+    int64_t unreported_process_bytes;
+    /* The calling thread's Judy total (see memory.h) when we were created */
+    int64_t judy_bytes_at_start;
+    size_t memory_budget;
+};
+
+struct csp_gc_entry {
+    unsigned int pin_count;
+    /* The epoch of the last collection that found this process reachable */
+    unsigned int marked_epoch;
 };
 
+/* Reports any change in the size of our registry tables to the memory
+ * accounting code. */
+static void
+csp_update_registry_memory(struct csp_priv *csp)
+{
+    struct csp_session *session;
+    size_t bytes = csp_side_table_memory_usage(&csp->processes_by_index) +
+                   csp_side_table_memory_usage(&csp->gc_entries);
+    for (session = csp->current; session != NULL; session = session->parent) {
+        bytes += csp_map_memory_usage(&session->processes.map);
+    }
+    csp_memory_track_resize(CSP_MEMORY_REGISTRY, csp->registry_bytes, bytes);
+    csp->registry_bytes = bytes;
+}
+
+/* Reports any process memory that we haven't told the memory accounting code
+ * about yet. */
+static void
+csp_report_process_memory(struct csp_priv *csp)
+{
+    if (csp->unreported_process_bytes > 0) {
+        csp_memory_track_alloc(CSP_MEMORY_PROCESSES,
+                               csp->unreported_process_bytes);
+    } else if (csp->unreported_process_bytes < 0) {
+        csp_memory_track_free(CSP_MEMORY_PROCESSES,
+                              -csp->unreported_process_bytes);
+    }
+    csp->unreported_process_bytes = 0;
+}
+
+static void
+csp_count_process_memory(struct csp_priv *csp, int64_t bytes)
+{
+    csp->unreported_process_bytes += bytes;
+    if (unlikely(csp->unreported_process_bytes >=
+                         (int64_t) CSP_MEMORY_PROCESS_BATCH_SIZE ||
+                 csp->unreported_process_bytes <=
+                         -(int64_t) CSP_MEMORY_PROCESS_BATCH_SIZE)) {
+        csp_report_process_memory(csp);
+    }
+}
+
 struct csp *
 csp_new(void)
 {
@@ -178,15 +344,29 @@ csp_new(void)
     if (unlikely(csp == NULL)) {
         return NULL;
     }
-    csp_id_process_map_init(&csp->processes);
+    csp_session_init(&csp->root, NULL, 0);
+    csp->current = &csp->root;
+    csp_side_table_init(&csp->processes_by_index, sizeof(struct csp_process *));
+    csp_side_table_init(&csp->gc_entries, sizeof(struct csp_gc_entry));
+    csp->gc_epoch = 0;
+    csp->gc_high_water_mark = 0;
+    csp->registry_bytes = 0;
+    csp->process_bytes = 0;
+    csp->unreported_process_bytes = 0;
+    csp->judy_bytes_at_start = csp_judy_malloc_thread_bytes();
+    csp->memory_budget = 0;
     csp->process_count = 0;
     csp->next_recursion_scope_id = 0;
     csp->public.tau = csp_tau();
     csp->public.tick = csp_tick();
-    csp->public.stop = csp_stop();
+    csp_stop_init(&csp->stop);
+    csp->public.stop = &csp->stop;
     csp_register_process(&csp->public, csp->public.stop);
-    csp->public.skip = csp_skip();
+    csp_pin_process(&csp->public, csp->public.stop);
+    csp_skip_init(&csp->skip);
+    csp->public.skip = &csp->skip;
     csp_register_process(&csp->public, csp->public.skip);
+    csp_pin_process(&csp->public, csp->public.skip);
     return &csp->public;
 }
 
@@ -194,26 +374,123 @@ void
 csp_free(struct csp *pcsp)
 {
     struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
-    csp_id_process_map_done(&csp->public, &csp->processes);
+    while (csp->current != &csp->root) {
+        csp_session_end(pcsp);
+    }
+    csp_session_done(pcsp, &csp->root);
+    csp_report_process_memory(csp);
+    csp_side_table_done(&csp->processes_by_index, NULL, NULL);
+    csp_side_table_done(&csp->gc_entries, NULL, NULL);
+    csp_memory_track_free(CSP_MEMORY_REGISTRY, csp->registry_bytes);
     free(csp);
 }
 
+void
+csp_session_begin(struct csp *pcsp)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    struct csp_session *session = malloc(sizeof(struct csp_session));
+    assert(session != NULL);
+    csp_report_process_memory(csp);
+    csp_session_init(session, csp->current, csp->process_count);
+    csp->current = session;
+}
+
+void
+csp_session_end(struct csp *pcsp)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    struct csp_session *session = csp->current;
+    size_t index;
+    assert(session != &csp->root);
+    csp_session_done(pcsp, session);
+    /* Forget about the session's processes, and reuse their indices. */
+    for (index = session->first_index; index < csp->process_count; index++) {
+        struct csp_gc_entry *entry = csp_side_table_at(&csp->gc_entries, index);
+        *(struct csp_process **) csp_side_table_at(&csp->processes_by_index,
+                                                   index) = NULL;
+        entry->pin_count = 0;
+        entry->marked_epoch = 0;
+    }
+    csp->process_count = session->first_index;
+    csp->current = session->parent;
+    free(session);
+    csp_report_process_memory(csp);
+    csp_update_registry_memory(csp);
+}
+
+bool
+csp_session_owns_process(struct csp *pcsp, const struct csp_process *process)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    return process->index >= csp->current->first_index;
+}
+
+void
+csp_session_add_cleanup(struct csp *pcsp, csp_session_cleanup_f *cleanup,
+                        void *ud)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    struct csp_session *session = csp->current;
+    struct csp_session_cleanup *entry =
+            csp_arena_alloc(&session->arena, sizeof(struct csp_session_cleanup));
+    entry->cleanup = cleanup;
+    entry->ud = ud;
+    entry->next = session->cleanups;
+    session->cleanups = entry;
+}
+
+void *
+csp_alloc(struct csp *pcsp, size_t size)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    csp_count_process_memory(csp, size);
+    csp->process_bytes += size;
+    return csp_arena_alloc(&csp->current->arena, size);
+}
+
+void
+csp_dealloc(struct csp *pcsp, void *ptr, size_t size)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    csp_count_process_memory(csp, -(int64_t) size);
+    csp->process_bytes -= size;
+    csp_arena_free(&csp->current->arena, ptr, size);
+}
+
 void
 csp_register_process(struct csp *pcsp, struct csp_process *process)
 {
     struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
     struct csp_process **entry =
-            csp_id_process_map_at(&csp->processes, process->id);
+            csp_id_process_map_at(&csp->current->processes, process->id);
     assert(*entry == NULL);
     *entry = process;
-    process->index = csp->process_count++;
+    if (csp->current->free_index_count > 0) {
+        struct csp_session *session = csp->current;
+        process->index = session->free_indices[--session->free_index_count];
+    } else {
+        assert(csp->process_count <= CSP_PROCESS_INDEX_MAX);
+        process->index = csp->process_count++;
+    }
+    *(struct csp_process **) csp_side_table_at(&csp->processes_by_index,
+                                               process->index) = process;
+    csp_update_registry_memory(csp);
 }
 
 struct csp_process *
 csp_get_process(struct csp *pcsp, csp_id process_id)
 {
     struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
-    return csp_id_process_map_get(&csp->processes, process_id);
+    struct csp_session *session;
+    for (session = csp->current; session != NULL; session = session->parent) {
+        struct csp_process *process =
+                csp_id_process_map_get(&session->processes, process_id);
+        if (process != NULL) {
+            return process;
+        }
+    }
+    return NULL;
 }
 
 struct csp_process *
@@ -224,22 +501,273 @@ csp_require_process(struct csp *csp, csp_id id)
     return process;
 }
 
+size_t
+csp_process_count(struct csp *pcsp)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    return csp->process_count;
+}
+
+struct csp_process *
+csp_get_process_by_index(struct csp *pcsp, size_t index)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    struct csp_process *const *entry =
+            csp_side_table_get(&csp->processes_by_index, index);
+    return entry == NULL ? NULL : *entry;
+}
+
+const struct csp_event_set *
+csp_intern_event_set(struct csp *pcsp, const struct csp_event_set *set)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    return csp_event_set_table_intern(&csp->current->event_sets, set);
+}
+
+/*------------------------------------------------------------------------------
+ * Garbage collection
+ */
+
+void
+csp_pin_process(struct csp *pcsp, struct csp_process *process)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    struct csp_gc_entry *entry =
+            csp_side_table_at(&csp->gc_entries, process->index);
+    entry->pin_count++;
+    csp_update_registry_memory(csp);
+}
+
+void
+csp_unpin_process(struct csp *pcsp, struct csp_process *process)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    struct csp_gc_entry *entry =
+            csp_side_table_at(&csp->gc_entries, process->index);
+    assert(entry->pin_count > 0);
+    entry->pin_count--;
+}
+
+void
+csp_session_remember_process(struct csp *pcsp, struct csp_process *process)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    if (process->index >= csp->current->first_index) {
+        return;
+    }
+    csp_process_set_add(&csp->current->remembered, process);
+}
+
+void
+csp_set_gc_high_water_mark(struct csp *pcsp, size_t bytes)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    csp->gc_high_water_mark = bytes;
+}
+
+bool
+csp_gc_enabled(struct csp *pcsp)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    return csp->gc_high_water_mark > 0;
+}
+
+/* The mark phase is a depth-first search, using an explicit stack of processes
+ * that we've marked but whose references we haven't visited yet.  We only mark
+ * processes that belong to the current session; nothing else can be
+ * collected. */
+struct csp_gc_mark {
+    struct csp_process_visitor visitor;
+    struct csp_priv *csp;
+    struct csp_process **stack;
+    size_t count;
+    size_t allocated_count;
+};
+
+static int
+csp_gc_mark_visit(struct csp *pcsp, struct csp_process_visitor *visitor,
+                  struct csp_process *process)
+{
+    struct csp_gc_mark *self =
+            container_of(visitor, struct csp_gc_mark, visitor);
+    struct csp_priv *csp = self->csp;
+    struct csp_gc_entry *entry;
+    if (process->index < csp->current->first_index) {
+        return 0;
+    }
+    entry = csp_side_table_at(&csp->gc_entries, process->index);
+    if (entry->marked_epoch == csp->gc_epoch) {
+        return 0;
+    }
+    entry->marked_epoch = csp->gc_epoch;
+    if (self->count == self->allocated_count) {
+        self->allocated_count =
+                self->allocated_count == 0 ? 64 : self->allocated_count * 2;
+        self->stack = realloc(
+                self->stack, self->allocated_count * sizeof(struct csp_process *));
+        assert(self->stack != NULL);
+    }
+    self->stack[self->count++] = process;
+    return 0;
+}
+
+static void
+csp_gc_mark(struct csp_priv *csp, const struct csp_process_set *roots)
+{
+    struct csp_gc_mark self = {{csp_gc_mark_visit}, csp, NULL, 0, 0};
+    size_t first_index = csp->current->first_index;
+    size_t index;
+    struct csp_process_set_iterator iter;
+    /* Processes from enclosing sessions aren't collected, so anything that
+     * they refer to is reachable.  The only ones that can refer to this
+     * session's processes are the ones that it has remembered. */
+    csp_process_set_foreach (&csp->current->remembered, &iter) {
+        struct csp_process *process = csp_process_set_iterator_get(&iter);
+        csp_process_visit_references(&csp->public, process, &self.visitor);
+    }
+    for (index = first_index; index < csp->process_count; index++) {
+        const struct csp_gc_entry *entry =
+                csp_side_table_get(&csp->gc_entries, index);
+        if (entry != NULL && entry->pin_count > 0) {
+            csp_gc_mark_visit(&csp->public, &self.visitor,
+                              csp_get_process_by_index(&csp->public, index));
+        }
+    }
+    if (roots != NULL) {
+        csp_process_set_visit(&csp->public, roots, &self.visitor);
+    }
+    while (self.count > 0) {
+        struct csp_process *process = self.stack[--self.count];
+        csp_process_visit_references(&csp->public, process, &self.visitor);
+    }
+    free(self.stack);
+}
+
+static void
+csp_session_free_index(struct csp_session *session, size_t index)
+{
+    if (session->free_index_count == session->free_index_allocated_count) {
+        session->free_index_allocated_count =
+                session->free_index_allocated_count == 0
+                        ? 64
+                        : session->free_index_allocated_count * 2;
+        session->free_indices =
+                realloc(session->free_indices,
+                        session->free_index_allocated_count * sizeof(size_t));
+        assert(session->free_indices != NULL);
+    }
+    session->free_indices[session->free_index_count++] = index;
+}
+
+static size_t
+csp_gc_sweep(struct csp_priv *csp)
+{
+    struct csp_session *session = csp->current;
+    size_t freed_count = 0;
+    size_t index;
+    for (index = session->first_index; index < csp->process_count; index++) {
+        struct csp_process **process =
+                csp_side_table_at(&csp->processes_by_index, index);
+        const struct csp_gc_entry *entry =
+                csp_side_table_get(&csp->gc_entries, index);
+        if (*process == NULL ||
+            (entry != NULL && entry->marked_epoch == csp->gc_epoch)) {
+            continue;
+        }
+        csp_id_process_map_remove(&session->processes, (*process)->id);
+        csp_process_free(&csp->public, *process);
+        *process = NULL;
+        csp_session_free_index(session, index);
+        freed_count++;
+    }
+    return freed_count;
+}
+
+size_t
+csp_collect_garbage(struct csp *pcsp, const struct csp_process_set *roots)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    size_t freed_count;
+    /* Each collection gets a new epoch, so we don't have to clear the marks
+     * from the previous one. */
+    csp->gc_epoch++;
+    csp_gc_mark(csp, roots);
+    freed_count = csp_gc_sweep(csp);
+    csp->current->gc_survivor_bytes = csp->current->arena.allocated_bytes;
+    csp_update_registry_memory(csp);
+    return freed_count;
+}
+
+size_t
+csp_maybe_collect_garbage(struct csp *pcsp,
+                          const struct csp_process_set *roots)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    struct csp_session *session = csp->current;
+    size_t trigger;
+    if (csp->gc_high_water_mark == 0) {
+        return 0;
+    }
+    /* If most of the session's processes survive a collection, wait until it
+     * has grown quite a bit more before trying again, so that we don't spend
+     * all of our time marking the same processes over and over. */
+    trigger = csp->gc_high_water_mark;
+    if (trigger < session->gc_survivor_bytes * 2) {
+        trigger = session->gc_survivor_bytes * 2;
+    }
+    if (session->arena.allocated_bytes < trigger) {
+        return 0;
+    }
+    return csp_collect_garbage(pcsp, roots);
+}
+
+/*------------------------------------------------------------------------------
+ * Memory budget
+ */
+
+void
+csp_set_memory_budget(struct csp *pcsp, size_t bytes)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    csp->memory_budget = bytes;
+}
+
+size_t
+csp_memory_usage(struct csp *pcsp)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    int64_t judy_bytes =
+            csp_judy_malloc_thread_bytes() - csp->judy_bytes_at_start;
+    if (judy_bytes < 0) {
+        judy_bytes = 0;
+    }
+    return csp->process_bytes + csp->registry_bytes + (size_t) judy_bytes;
+}
+
+bool
+csp_memory_exhausted(struct csp *pcsp)
+{
+    struct csp_priv *csp = container_of(pcsp, struct csp_priv, public);
+    return csp->memory_budget > 0 &&
+           csp_memory_usage(pcsp) > csp->memory_budget;
+}
+
 csp_id
 csp_id_start(struct csp_id_scope *scope)
 {
-    return hash64_any(&scope, sizeof(struct csp_id_scope *), 0);
+    return csp_id_hash_word((uintptr_t) scope, 0);
 }
 
 csp_id
 csp_id_add_event(csp_id id, const struct csp_event *event)
 {
-    return hash64_any(&event, sizeof(const struct csp_event *), id);
+    return csp_id_hash_word((uintptr_t) event, id);
 }
 
 csp_id
 csp_id_add_id(csp_id id, csp_id id_to_add)
 {
-    return hash64_any(&id_to_add, sizeof(csp_id), id);
+    return csp_id_hash_word(id_to_add, id);
 }
 
 csp_id
@@ -255,13 +783,13 @@ csp_id_add_id_set(csp_id id, const struct csp_id_set *set)
 csp_id
 csp_id_add_name(csp_id id, const char *name)
 {
-    return hash64_any(name, strlen(name), id);
+    return csp_id_hash_bytes(name, strlen(name), id);
 }
 
 csp_id
 csp_id_add_name_sized(csp_id id, const char *name, size_t name_length)
 {
-    return hash64_any(name, name_length, id);
+    return csp_id_hash_bytes(name, name_length, id);
 }
 
 csp_id
@@ -270,27 +798,39 @@ csp_id_add_process(csp_id id, struct csp_process *process)
     return csp_id_add_id(id, process->id);
 }
 
+/* Process bags and sets are ordered by the addresses of their elements, which
+ * aren't stable: if the garbage collector frees a process and someone recreates
+ * it, it will probably end up somewhere else in memory.  So we combine the
+ * elements' IDs using a sum of their hashes, which doesn't depend on the order
+ * that we visit them in. */
+#define CSP_ID_AGGREGATE_SEED UINT64_C(0x2d9e6a1f7c0b5384) /* random */
+
+static uint64_t
+csp_id_aggregate_hash(const struct csp_process *process)
+{
+    return csp_id_hash_word(process->id, CSP_ID_AGGREGATE_SEED);
+}
+
 csp_id
 csp_id_add_process_bag(csp_id id, const struct csp_process_bag *bag)
 {
     struct csp_process_bag_iterator iter;
+    uint64_t hash = 0;
     csp_process_bag_foreach(bag, &iter) {
         struct csp_process *process = csp_process_bag_iterator_get(&iter);
         size_t count = csp_process_bag_iterator_get_count(&iter);
-        size_t j;
-        for (j = 0; j < count; j++) {
-            id = csp_id_add_process(id, process);
-        }
+        hash += count * csp_id_aggregate_hash(process);
     }
-    return id;
+    return csp_id_add_id(id, hash);
 }
 
 csp_id
 csp_id_add_process_set(csp_id id, const struct csp_process_set *set)
 {
     struct csp_process_set_iterator iter;
+    uint64_t hash = 0;
     csp_process_set_foreach(set, &iter) {
-        id = csp_id_add_process(id, csp_process_set_iterator_get(&iter));
+        hash += csp_id_aggregate_hash(csp_process_set_iterator_get(&iter));
     }
-    return id;
+    return csp_id_add_id(id, hash);
 }
@@ -9,6 +9,7 @@
 #define HST_ENVIRONMENT_H
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -27,6 +28,9 @@ typedef uint64_t csp_id;
 #define CSP_ID_NONE ((csp_id) 0)
 #define CSP_PROCESS_NONE CSP_ID_NONE
 
+/* An environment must only be used by one thread at a time, but environments
+ * don't share any mutable state with each other, so you can use separate
+ * environments on separate threads in parallel. */
 struct csp {
     const struct csp_event *tau;
     const struct csp_event *tick;
@@ -40,6 +44,19 @@ csp_new(void);
 void
 csp_free(struct csp *csp);
 
+/* Allocate memory for a process node (or anything else that should live as
+ * long as the process).  The memory comes from an arena owned by the
+ * innermost active session (see below), and is freed all at once when that
+ * session ends or the environment is freed, so you must not free it yourself. */
+void *
+csp_alloc(struct csp *csp, size_t size);
+
+/* Give memory back to the environment before its session ends.  `size` must be
+ * the same size that you passed to csp_alloc, and the session that allocated it
+ * must still be the innermost one.  Process nodes call this from their `free`
+ * method. */
+void
+csp_dealloc(struct csp *csp, void *ptr, size_t size);
 
 /* Register a process.  There must not already be a process registered with the
  * same ID. */
@@ -56,6 +73,170 @@ csp_get_process(struct csp *csp, csp_id id);
 struct csp_process *
 csp_require_process(struct csp *csp, csp_id id);
 
+/* Return the number of processes that have been registered.  Every registered
+ * process has an `index` that's less than this. */
+size_t
+csp_process_count(struct csp *csp);
+
+/* Return the process with a particular `index`, or NULL if there isn't one. */
+struct csp_process *
+csp_get_process_by_index(struct csp *csp, size_t index);
+
+/* Return the interned copy of an event set.  Equal sets are always interned to
+ * the same pointer.  Interned sets belong to the innermost session that's
+ * active when they're first interned, and the pointer remains valid until that
+ * session ends (see below), so that a long-lived environment doesn't
+ * accumulate every set that any of its checks has seen. */
+const struct csp_event_set *
+csp_intern_event_set(struct csp *csp, const struct csp_event_set *set);
+
+/*------------------------------------------------------------------------------
+ * Sessions
+ */
+
+/* A session lets you throw away the processes that you create during a
+ * refinement check (refinement pairs, prenormalized and normalized nodes, and
+ * any operator states that the check explores) once you're done with it,
+ * while keeping the processes that make up your model.
+ *
+ * Every process is registered in the innermost session that's active when it's
+ * created (or in the environment itself if there aren't any sessions).  Lookups
+ * still see the processes in all of the enclosing sessions, so anything you
+ * defined before beginning a session can be used inside it.  When you end a
+ * session, all of its processes are freed, and their indices are handed out
+ * again to the processes that you create next; any pointers or indices that you
+ * got for them are no longer valid.
+ *
+ * Sessions can be nested; you must end them in the reverse order that you began
+ * them.  csp_free ends any sessions that are still active.
+ *
+ * Ending a session also frees the event sets that were first interned during
+ * it.  The environment's index→process table isn't trimmed, though: it keeps
+ * room for as many processes as it has ever held at once, since the next
+ * session will reuse those indices. */
+
+void
+csp_session_begin(struct csp *csp);
+
+void
+csp_session_end(struct csp *csp);
+
+/* Return whether `process` belongs to the innermost active session.  (If there
+ * aren't any sessions, every process belongs to the environment itself, and so
+ * this always returns true.) */
+bool
+csp_session_owns_process(struct csp *csp, const struct csp_process *process);
+
+/* A process from an enclosing session must not keep pointers to processes from
+ * the current session once it ends.  If a process memoizes anything that it
+ * creates lazily, and it isn't owned by the current session, it should use this
+ * to register a callback that forgets whatever it has memoized.  The callback
+ * runs at the start of csp_session_end.  (It should also call
+ * csp_session_remember_process, so that the garbage collector doesn't free
+ * what it has memoized before then.) */
+typedef void
+csp_session_cleanup_f(struct csp *csp, void *ud);
+
+void
+csp_session_add_cleanup(struct csp *csp, csp_session_cleanup_f *cleanup,
+                        void *ud);
+
+/*------------------------------------------------------------------------------
+ * Garbage collection
+ */
+
+/* Sessions only free memory when they end.  During a single long exploration,
+ * you can also have the garbage collector free the processes in the innermost
+ * session that are no longer reachable.  A process is reachable if it's pinned,
+ * if it belongs to an enclosing session, if it's one of the `roots` that you
+ * pass in to the collector, or if it's referenced (see the `references` method
+ * of csp_process_iface) by a remembered process (see below) or by another
+ * reachable process.  Everything else is freed, just like when a session ends.
+ *
+ * Each collection uses a new epoch number to mark reachable processes, so
+ * there's nothing to clear out between collections.
+ *
+ * Since processes are identified by their IDs, and an ID only depends on the
+ * definition of a process, a process that has been collected can always be
+ * recreated if it turns out that you need it again; it will have the same ID,
+ * but a new `index`.  So anything that needs to remember a process across
+ * collections should use its ID, not its pointer or index. */
+
+/* Processes can be pinned more than once; they stay pinned until you unpin
+ * them the same number of times. */
+void
+csp_pin_process(struct csp *csp, struct csp_process *process);
+
+void
+csp_unpin_process(struct csp *csp, struct csp_process *process);
+
+/* The collector doesn't look through the processes in enclosing sessions for
+ * references to the current session's processes, since that would make every
+ * collection as slow as the entire model is large.  So a process from an
+ * enclosing session that starts referring to processes from the current session
+ * (usually by memoizing them) must call this, and the collector will treat
+ * everything that it refers to as reachable until the session ends.  This does
+ * nothing if `process` belongs to the current session. */
+void
+csp_session_remember_process(struct csp *csp, struct csp_process *process);
+
+/* Collect garbage whenever the process nodes in the innermost session take up
+ * more than this many bytes.  A high-water mark of 0 (the default) turns off
+ * automatic collection.
+ *
+ * Once you turn this on, any process that you hold onto across a call that
+ * might collect garbage (such as a refinement check) must be pinned, or must
+ * belong to an enclosing session. */
+void
+csp_set_gc_high_water_mark(struct csp *csp, size_t bytes);
+
+/* Return whether automatic garbage collection is turned on. */
+bool
+csp_gc_enabled(struct csp *csp);
+
+/* Free every unreachable process in the innermost session.  `roots` can be
+ * NULL.  Returns the number of processes that were freed.  The session hands
+ * out the freed processes' indices to the next processes that it registers, so
+ * csp_process_count doesn't keep growing across collections. */
+size_t
+csp_collect_garbage(struct csp *csp, const struct csp_process_set *roots);
+
+/* Collect garbage if the innermost session has grown past the high-water mark.
+ * (If most of the session survived the previous collection, we wait for it to
+ * double in size first.)  Returns the number of processes that were freed. */
+size_t
+csp_maybe_collect_garbage(struct csp *csp, const struct csp_process_set *roots);
+
+/*------------------------------------------------------------------------------
+ * Memory budget
+ */
+
+/* You can give an environment a memory budget, so that a check that would
+ * otherwise run out of memory gives up cleanly instead (see
+ * csp_try_traces_refinement).  The budget is compared against
+ * csp_memory_usage, which only counts the environment's own memory: its
+ * process nodes, its registry tables, and any Judy arrays allocated since the
+ * environment was created.  We can't tell which environment a Judy array
+ * belongs to, so that last part is the change in the calling thread's Judy
+ * usage (see memory.h); you should create and use each environment on a single
+ * thread, and Judy arrays that anyone else allocates on that thread will count
+ * against its budget too.
+ *
+ * Nothing fails when you go over budget; allocations still succeed, and it's
+ * up to the long-running operations to check csp_memory_exhausted every so
+ * often and stop.  A budget of 0 (the default) means there's no limit. */
+void
+csp_set_memory_budget(struct csp *csp, size_t bytes);
+
+/* Returns how much memory the environment is using, as described above. */
+size_t
+csp_memory_usage(struct csp *csp);
+
+/* Return whether we're currently using more memory than the environment's
+ * budget allows. */
+bool
+csp_memory_exhausted(struct csp *csp);
+
 /*------------------------------------------------------------------------------
  * Constructing process IDs
  */
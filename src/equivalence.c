@@ -14,46 +14,45 @@
 #include "ccan/likely/likely.h"
 #include "id-set.h"
 #include "map.h"
+#include "memory.h"
 #include "process.h"
 
 static void
 csp_process_classes_init(struct csp_process_classes *classes)
 {
-    csp_map_init(&classes->map);
+    csp_side_table_init(&classes->table, sizeof(csp_id));
 }
 
 static void
 csp_process_classes_done(struct csp_process_classes *classes)
 {
-    csp_map_done(&classes->map, NULL, NULL);
+    csp_side_table_done(&classes->table, NULL, NULL);
 }
 
 static csp_id
 csp_process_classes_get(const struct csp_process_classes *classes,
                         struct csp_process *process)
 {
-    void *entry = csp_map_get(&classes->map, (uintptr_t) process);
-    if (entry == NULL) {
-        return CSP_ID_NONE;
-    } else {
-        return (uintptr_t) entry;
-    }
+    const csp_id *entry = csp_side_table_get(&classes->table, process->index);
+    return entry == NULL ? CSP_ID_NONE : *entry;
 }
 
 static csp_id
 csp_process_classes_insert(struct csp_process_classes *classes,
                            struct csp_process *process, csp_id class_id)
 {
-    void **entry = csp_map_at(&classes->map, (uintptr_t) process);
-    csp_id result = (uintptr_t) *entry;
-    *entry = (void *) class_id;
+    csp_id *entry = csp_side_table_at(&classes->table, process->index);
+    csp_id result = *entry;
+    *entry = class_id;
     return result;
 }
 
 static void
 csp_class_members_init(struct csp_class_members *members)
 {
-    csp_map_init(&members->map);
+    /* We only ever iterate through the classes to collect their IDs into a
+     * set, so we don't need the map itself to be ordered. */
+    csp_map_init_hashed(&members->map);
 }
 
 static void
@@ -129,6 +128,13 @@ csp_class_members_iterator_get_class_id(
     return iter->iter.key;
 }
 
+static const struct csp_process_set *
+csp_class_members_iterator_get_members(
+        const struct csp_class_members_iterator *iter)
+{
+    return *iter->iter.value;
+}
+
 #define csp_class_members_foreach(map, iter)            \
     for (csp_class_members_get_iterator((map), (iter)); \
          !csp_class_members_iterator_done((iter));      \
@@ -148,6 +154,7 @@ csp_equivalences_init(struct csp_equivalences *equiv)
 {
     csp_class_members_init(&equiv->class_members);
     csp_process_classes_init(&equiv->process_classes);
+    equiv->reported_bytes = 0;
 }
 
 void
@@ -155,6 +162,23 @@ csp_equivalences_done(struct csp_equivalences *equiv)
 {
     csp_class_members_done(&equiv->class_members);
     csp_process_classes_done(&equiv->process_classes);
+    csp_memory_track_free(CSP_MEMORY_EQUIVALENCES, equiv->reported_bytes);
+}
+
+/* Reports any change in the size of our tables to the memory accounting code.
+ * (The members of each class are Judy-backed process sets, which are accounted
+ * for separately.) */
+static void
+csp_equivalences_update_memory(struct csp_equivalences *equiv)
+{
+    size_t bytes =
+            csp_map_memory_usage(&equiv->class_members.map) +
+            csp_map_size(&equiv->class_members.map) *
+                    sizeof(struct csp_process_set) +
+            csp_side_table_memory_usage(&equiv->process_classes.table);
+    csp_memory_track_resize(CSP_MEMORY_EQUIVALENCES, equiv->reported_bytes,
+                            bytes);
+    equiv->reported_bytes = bytes;
 }
 
 void
@@ -190,6 +214,7 @@ csp_equivalences_add(struct csp_equivalences *equiv, csp_id class_id,
 
     /* And then add the member to the new equivalence class. */
     csp_class_members_insert(&equiv->class_members, class_id, process);
+    csp_equivalences_update_memory(equiv);
 }
 
 void
@@ -209,6 +234,17 @@ csp_equivalences_get_class(struct csp_equivalences *equiv,
     return csp_process_classes_get(&equiv->process_classes, process);
 }
 
+void
+csp_equivalences_visit_members(struct csp *csp, struct csp_equivalences *equiv,
+                               struct csp_process_visitor *visitor)
+{
+    struct csp_class_members_iterator iter;
+    csp_class_members_foreach (&equiv->class_members, &iter) {
+        csp_process_set_visit(
+                csp, csp_class_members_iterator_get_members(&iter), visitor);
+    }
+}
+
 const struct csp_process_set *
 csp_equivalences_get_members(struct csp_equivalences *equiv, csp_id class_id)
 {
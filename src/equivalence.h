@@ -11,6 +11,7 @@
 #include "id-set.h"
 #include "map.h"
 #include "process.h"
+#include "side-table.h"
 
 /* Stores information about the "equivalence classes" of a set of processes.
  * All of the processes that have "equivalent" behavior (according to one of
@@ -21,14 +22,17 @@ struct csp_class_members {
     struct csp_map map;
 };
 
-/* Maps a process to its class ID. */
+/* Maps a process to its class ID.  Indexed by each process's `index`;
+ * processes that haven't been assigned a class yet have CSP_ID_NONE. */
 struct csp_process_classes {
-    struct csp_map map;
+    struct csp_side_table table;
 };
 
 struct csp_equivalences {
     struct csp_class_members class_members;
     struct csp_process_classes process_classes;
+    /* How much memory we last reported to the memory accounting code */
+    size_t reported_bytes;
 };
 
 struct csp_equivalences *
@@ -65,4 +69,9 @@ csp_equivalences_get_class(struct csp_equivalences *equiv,
 const struct csp_process_set *
 csp_equivalences_get_members(struct csp_equivalences *equiv, csp_id class_id);
 
+/* Calls `visitor` for every process that belongs to any equivalence class. */
+void
+csp_equivalences_visit_members(struct csp *csp, struct csp_equivalences *equiv,
+                               struct csp_process_visitor *visitor);
+
 #endif /* HST_EQUIVALENCE_H */
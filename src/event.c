@@ -8,17 +8,18 @@
 #include "event.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "ccan/container_of/container_of.h"
-#include "ccan/hash/hash.h"
 #include "ccan/likely/likely.h"
 #include "basics.h"
+#include "id-hash.h"
 #include "map.h"
-#include "set.h"
+#include "memory.h"
 
 /*------------------------------------------------------------------------------
  * Events
@@ -26,20 +27,24 @@
 
 struct csp_event {
     csp_id id;
+    size_t index;
     const char *name;
 };
 
 static struct csp_event *
-csp_event_new(csp_id id, const char *name, size_t name_length)
+csp_event_new(csp_id id, size_t index, const char *name, size_t name_length)
 {
     struct csp_event *event =
             malloc(sizeof(struct csp_event) + name_length + 1);
     char *name_copy;
     assert(event != NULL);
+    csp_memory_track_alloc(CSP_MEMORY_EVENTS,
+                           sizeof(struct csp_event) + name_length + 1);
     name_copy = (void *) (event + 1);
     memcpy(name_copy, name, name_length);
     name_copy[name_length] = '\0';
     event->id = id;
+    event->index = index;
     event->name = name_copy;
     return event;
 }
@@ -47,60 +52,286 @@ csp_event_new(csp_id id, const char *name, size_t name_length)
 static void
 csp_event_free(struct csp_event *event)
 {
+    if (event == NULL) {
+        return;
+    }
+    csp_memory_track_free(CSP_MEMORY_EVENTS,
+                          sizeof(struct csp_event) + strlen(event->name) + 1);
     free(event);
 }
 
 /*------------------------------------------------------------------------------
- * Event map
+ * Event table
  */
 
-struct csp_event_map {
-    struct csp_map map;
+/* Events are interned in a single process-wide table, which can be used from
+ * any number of threads at once.  The table is split into shards, chosen by the
+ * top bits of each event's ID.  Each shard is an open-addressed hash table
+ * (with linear probing), along with a lock that must be held to add anything
+ * to it.  Lookups don't need the lock: a slot is only ever written once (when
+ * an event is added to it), and we publish each slot with a release store, so
+ * a reader will see either NULL or a fully constructed event.
+ *
+ * When a shard's table fills up, we copy it into a new table twice as large,
+ * and publish the new table in the same way.  A reader might still be probing
+ * the old table, so we never free it until exit; that's cheap, since the old
+ * tables only add up to the size of the current one.  If a reader doesn't find
+ * an event in a stale table, it falls back on the locked path, which checks
+ * again in the current table before adding anything.
+ *
+ * Events are never freed until exit, so pointers to them are stable. */
+
+#define CSP_EVENT_SHARD_BITS 6
+#define CSP_EVENT_SHARD_COUNT (1 << CSP_EVENT_SHARD_BITS)
+#define CSP_EVENT_TABLE_INITIAL_CAPACITY 16
+
+struct csp_event_table {
+    /* Always a power of 2. */
+    size_t capacity;
+    /* The table that this one replaced, kept alive for any concurrent
+     * readers. */
+    struct csp_event_table *retired;
+    struct csp_event *slots[];
+};
+
+struct csp_event_shard {
+    pthread_mutex_t lock;
+    /* Read without holding the lock, so always use atomic loads and stores. */
+    struct csp_event_table *table;
+    /* Only accessed while holding the lock. */
+    size_t count;
 };
 
+static struct csp_event_shard shards[CSP_EVENT_SHARD_COUNT];
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
+
+/* Maps each event's dense index back to the event.  This is split into chunks
+ * that double in size, so that we never have to move an entry once it's been
+ * written: chunk k holds CSP_EVENT_CHUNK_BASE × 2^k entries.  Chunks are
+ * allocated the first time that an event with one of their indices is
+ * created. */
+
+#define CSP_EVENT_CHUNK_BASE_BITS 6
+#define CSP_EVENT_CHUNK_BASE (1 << CSP_EVENT_CHUNK_BASE_BITS)
+#define CSP_EVENT_CHUNK_COUNT (64 - CSP_EVENT_CHUNK_BASE_BITS)
+
+static const struct csp_event **events_by_index[CSP_EVENT_CHUNK_COUNT];
+static size_t event_count = 0;
+
 static void
-csp_event_map_init(struct csp_event_map *map)
+csp_event_index_locate(size_t index, size_t *chunk, size_t *offset)
+{
+    size_t shifted = (index >> CSP_EVENT_CHUNK_BASE_BITS) + 1;
+    size_t k = 63 - __builtin_clzll(shifted);
+    *chunk = k;
+    *offset = index - (((size_t) 1 << k) - 1) * CSP_EVENT_CHUNK_BASE;
+}
+
+static const struct csp_event *
+csp_event_get_by_index(size_t index)
+{
+    size_t chunk;
+    size_t offset;
+    const struct csp_event **entries;
+    csp_event_index_locate(index, &chunk, &offset);
+    entries = __atomic_load_n(&events_by_index[chunk], __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&entries[offset], __ATOMIC_ACQUIRE);
+}
+
+/* Assigns a new index to `event`, and makes it available to
+ * csp_event_get_by_index. */
+static size_t
+csp_event_register_index(struct csp_event *event)
+{
+    size_t index = __atomic_fetch_add(&event_count, 1, __ATOMIC_RELAXED);
+    size_t chunk;
+    size_t offset;
+    const struct csp_event **entries;
+    csp_event_index_locate(index, &chunk, &offset);
+    entries = __atomic_load_n(&events_by_index[chunk], __ATOMIC_ACQUIRE);
+    if (unlikely(entries == NULL)) {
+        /* Two shards might need the same chunk at the same time; whoever loses
+         * the race uses the winner's allocation instead. */
+        const struct csp_event **new_entries = calloc(
+                CSP_EVENT_CHUNK_BASE << chunk, sizeof(struct csp_event *));
+        assert(new_entries != NULL);
+        if (__atomic_compare_exchange_n(&events_by_index[chunk], &entries,
+                                        new_entries, false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            entries = new_entries;
+            csp_memory_track_alloc(
+                    CSP_MEMORY_EVENTS,
+                    (CSP_EVENT_CHUNK_BASE << chunk) *
+                            sizeof(struct csp_event *));
+        } else {
+            free(new_entries);
+        }
+    }
+    event->index = index;
+    __atomic_store_n(&entries[offset], event, __ATOMIC_RELEASE);
+    return index;
+}
+
+static struct csp_event_table *
+csp_event_table_new(size_t capacity)
 {
-    csp_map_init(&map->map);
+    struct csp_event_table *table = calloc(
+            1, sizeof(struct csp_event_table) +
+                       capacity * sizeof(struct csp_event *));
+    assert(table != NULL);
+    table->capacity = capacity;
+    csp_memory_track_alloc(CSP_MEMORY_EVENTS,
+                           sizeof(struct csp_event_table) +
+                                   capacity * sizeof(struct csp_event *));
+    return table;
+}
+
+static void
+csp_event_table_free(struct csp_event_table *table, bool free_events)
+{
+    while (table != NULL) {
+        struct csp_event_table *retired = table->retired;
+        if (free_events) {
+            size_t i;
+            for (i = 0; i < table->capacity; i++) {
+                csp_event_free(table->slots[i]);
+            }
+            /* Every retired table only contains events that are also in the
+             * current table. */
+            free_events = false;
+        }
+        csp_memory_track_free(CSP_MEMORY_EVENTS,
+                              sizeof(struct csp_event_table) +
+                                      table->capacity *
+                                              sizeof(struct csp_event *));
+        free(table);
+        table = retired;
+    }
+}
+
+/* Returns the event in `table` with the given ID, or NULL if there isn't one.
+ * Safe to call without holding the shard's lock. */
+static struct csp_event *
+csp_event_table_find(const struct csp_event_table *table, csp_id id)
+{
+    size_t mask = table->capacity - 1;
+    size_t i = id & mask;
+    while (true) {
+        struct csp_event *event =
+                __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+        if (event == NULL || event->id == id) {
+            return event;
+        }
+        i = (i + 1) & mask;
+    }
 }
 
+/* Must hold the shard's lock.  `event` must not already be in the table. */
 static void
-csp_event_map_free_entry(void *ud, void *entry)
+csp_event_table_insert(struct csp_event_table *table, struct csp_event *event)
 {
-    struct csp_event *event = entry;
-    csp_event_free(event);
+    size_t mask = table->capacity - 1;
+    size_t i = event->id & mask;
+    while (table->slots[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    __atomic_store_n(&table->slots[i], event, __ATOMIC_RELEASE);
 }
 
 static void
-csp_event_map_done(struct csp_event_map *map)
+free_event_table(void)
 {
-    csp_map_done(&map->map, csp_event_map_free_entry, NULL);
+    size_t i;
+    for (i = 0; i < CSP_EVENT_SHARD_COUNT; i++) {
+        csp_event_table_free(shards[i].table, true);
+        pthread_mutex_destroy(&shards[i].lock);
+    }
+    for (i = 0; i < CSP_EVENT_CHUNK_COUNT; i++) {
+        if (events_by_index[i] != NULL) {
+            csp_memory_track_free(CSP_MEMORY_EVENTS,
+                                  (CSP_EVENT_CHUNK_BASE << i) *
+                                          sizeof(struct csp_event *));
+        }
+        free(events_by_index[i]);
+    }
 }
 
-static const struct csp_event **
-csp_event_map_at(struct csp_event_map *map, csp_id id)
+static void
+csp_event_shards_init(void)
 {
-    return (const struct csp_event **) csp_map_at(&map->map, id);
+    size_t i;
+    for (i = 0; i < CSP_EVENT_SHARD_COUNT; i++) {
+        int rc = pthread_mutex_init(&shards[i].lock, NULL);
+        assert(rc == 0);
+    }
+    atexit(free_event_table);
 }
 
-static struct csp_event_map events;
+static struct csp_event_shard *
+csp_event_get_shard(csp_id id)
+{
+    return &shards[id >> (64 - CSP_EVENT_SHARD_BITS)];
+}
 
-static void
-free_event_map(void)
+/* The lock-free fast path: returns NULL if the event doesn't exist yet (or if
+ * it was only just created by another thread). */
+static const struct csp_event *
+csp_event_shard_find(struct csp_event_shard *shard, csp_id id)
 {
-    csp_event_map_done(&events);
+    struct csp_event_table *table =
+            __atomic_load_n(&shard->table, __ATOMIC_ACQUIRE);
+    return likely(table != NULL) ? csp_event_table_find(table, id) : NULL;
 }
 
-static struct csp_event_map *
-get_event_map(void)
+/* Must hold the shard's lock. */
+static const struct csp_event *
+csp_event_shard_add_locked(struct csp_event_shard *shard, csp_id id,
+                           const char *name, size_t name_length)
 {
-    static bool initialized = false;
-    if (unlikely(!initialized)) {
-        csp_event_map_init(&events);
-        atexit(free_event_map);
-        initialized = true;
+    struct csp_event_table *table = shard->table;
+    struct csp_event *event;
+    if (table != NULL) {
+        event = csp_event_table_find(table, id);
+        if (event != NULL) {
+            return event;
+        }
     }
-    return &events;
+
+    /* Keep each table at most 3/4 full. */
+    if (table == NULL || (shard->count + 1) * 4 > table->capacity * 3) {
+        size_t capacity = table == NULL ? CSP_EVENT_TABLE_INITIAL_CAPACITY
+                                        : table->capacity * 2;
+        struct csp_event_table *new_table = csp_event_table_new(capacity);
+        if (table != NULL) {
+            size_t i;
+            for (i = 0; i < table->capacity; i++) {
+                if (table->slots[i] != NULL) {
+                    csp_event_table_insert(new_table, table->slots[i]);
+                }
+            }
+        }
+        new_table->retired = table;
+        __atomic_store_n(&shard->table, new_table, __ATOMIC_RELEASE);
+        table = new_table;
+    }
+
+    event = csp_event_new(id, 0, name, name_length);
+    csp_event_register_index(event);
+    csp_event_table_insert(table, event);
+    shard->count++;
+    return event;
+}
+
+static const struct csp_event *
+csp_event_shard_add(struct csp_event_shard *shard, csp_id id,
+                    const char *name, size_t name_length)
+{
+    const struct csp_event *event;
+    pthread_once(&shards_once, csp_event_shards_init);
+    pthread_mutex_lock(&shard->lock);
+    event = csp_event_shard_add_locked(shard, id, name, name_length);
+    pthread_mutex_unlock(&shard->lock);
+    return event;
 }
 
 /*------------------------------------------------------------------------------
@@ -110,7 +341,7 @@ get_event_map(void)
 static uint64_t
 hash_sized_name(const char *name, size_t name_length)
 {
-    return hash64_any(name, name_length, 0);
+    return csp_id_hash_bytes(name, name_length, 0);
 }
 
 const struct csp_event *
@@ -122,13 +353,82 @@ csp_event_get(const char *name)
 const struct csp_event *
 csp_event_get_sized(const char *name, size_t name_length)
 {
-    struct csp_event_map *map = get_event_map();
     csp_id event_id = hash_sized_name(name, name_length);
-    const struct csp_event **event = csp_event_map_at(map, event_id);
-    if (unlikely(*event == NULL)) {
-        *event = csp_event_new(event_id, name, name_length);
+    struct csp_event_shard *shard = csp_event_get_shard(event_id);
+    const struct csp_event *event = csp_event_shard_find(shard, event_id);
+    if (unlikely(event == NULL)) {
+        event = csp_event_shard_add(shard, event_id, name, name_length);
     }
-    return *event;
+    return event;
+}
+
+struct csp_event_get_many_miss {
+    size_t shard_index;
+    size_t i;
+    csp_id id;
+};
+
+static int
+csp_event_get_many_miss_cmp(const void *va, const void *vb)
+{
+    const struct csp_event_get_many_miss *a = va;
+    const struct csp_event_get_many_miss *b = vb;
+    if (a->shard_index != b->shard_index) {
+        return a->shard_index < b->shard_index ? -1 : 1;
+    }
+    return a->i < b->i ? -1 : a->i > b->i;
+}
+
+void
+csp_event_get_many(size_t count, const char *const *names,
+                   const size_t *name_lengths,
+                   const struct csp_event **events)
+{
+    struct csp_event_get_many_miss *misses = NULL;
+    size_t miss_count = 0;
+    size_t i;
+
+    /* First look up every event without taking any locks, remembering which
+     * ones we didn't find. */
+    for (i = 0; i < count; i++) {
+        csp_id event_id = hash_sized_name(names[i], name_lengths[i]);
+        struct csp_event_shard *shard = csp_event_get_shard(event_id);
+        events[i] = csp_event_shard_find(shard, event_id);
+        if (events[i] == NULL) {
+            if (misses == NULL) {
+                misses = malloc((count - i) *
+                                sizeof(struct csp_event_get_many_miss));
+                assert(misses != NULL);
+            }
+            misses[miss_count].shard_index = shard - shards;
+            misses[miss_count].i = i;
+            misses[miss_count].id = event_id;
+            miss_count++;
+        }
+    }
+    if (misses == NULL) {
+        return;
+    }
+
+    /* Then add all of the missing events, grouped by shard, so that we only
+     * have to acquire each shard's lock once.  We add them in their original
+     * order within each shard, so that duplicate names get the same event. */
+    pthread_once(&shards_once, csp_event_shards_init);
+    qsort(misses, miss_count, sizeof(struct csp_event_get_many_miss),
+          csp_event_get_many_miss_cmp);
+    i = 0;
+    while (i < miss_count) {
+        struct csp_event_shard *shard = &shards[misses[i].shard_index];
+        pthread_mutex_lock(&shard->lock);
+        do {
+            size_t j = misses[i].i;
+            events[j] = csp_event_shard_add_locked(shard, misses[i].id,
+                                                   names[j], name_lengths[j]);
+            i++;
+        } while (i < miss_count && &shards[misses[i].shard_index] == shard);
+        pthread_mutex_unlock(&shard->lock);
+    }
+    free(misses);
 }
 
 csp_id
@@ -143,6 +443,12 @@ csp_event_name(const struct csp_event *event)
     return event->name;
 }
 
+size_t
+csp_event_index(const struct csp_event *event)
+{
+    return event->index;
+}
+
 /*------------------------------------------------------------------------------
  * Predefined events
  */
@@ -151,20 +457,25 @@ const struct csp_event *
 csp_tau(void)
 {
     static const struct csp_event *tau = NULL;
-    if (unlikely(tau == NULL)) {
-        tau = csp_event_get("τ");
+    const struct csp_event *result = __atomic_load_n(&tau, __ATOMIC_ACQUIRE);
+    if (unlikely(result == NULL)) {
+        /* Every thread that races here gets the same event back. */
+        result = csp_event_get("τ");
+        __atomic_store_n(&tau, result, __ATOMIC_RELEASE);
     }
-    return tau;
+    return result;
 }
 
 const struct csp_event *
 csp_tick(void)
 {
     static const struct csp_event *tick = NULL;
-    if (unlikely(tick == NULL)) {
-        tick = csp_event_get("✔");
+    const struct csp_event *result = __atomic_load_n(&tick, __ATOMIC_ACQUIRE);
+    if (unlikely(result == NULL)) {
+        result = csp_event_get("✔");
+        __atomic_store_n(&tick, result, __ATOMIC_RELEASE);
     }
-    return tick;
+    return result;
 }
 
 /*------------------------------------------------------------------------------
@@ -173,73 +484,200 @@ csp_tick(void)
 
 #define CSP_EVENT_SET_INITIAL_HASH UINT64_C(0xbe70ef9046515956) /* random */
 
+#define CSP_EVENT_SET_WORD_BITS 64
+#define csp_event_set_word_index(index) ((index) / CSP_EVENT_SET_WORD_BITS)
+#define csp_event_set_bit(index) \
+    (UINT64_C(1) << ((index) % CSP_EVENT_SET_WORD_BITS))
+
+static uint64_t *
+csp_event_set_words(struct csp_event_set *set)
+{
+    return set->heap_words == NULL ? set->inline_words : set->heap_words;
+}
+
+static const uint64_t *
+csp_event_set_const_words(const struct csp_event_set *set)
+{
+    return set->heap_words == NULL ? set->inline_words : set->heap_words;
+}
+
+/* Returns the i-th word of `set`, treating any unallocated words as zero. */
+static uint64_t
+csp_event_set_word(const struct csp_event_set *set, size_t i)
+{
+    return i < set->word_count ? csp_event_set_const_words(set)[i] : 0;
+}
+
+/* Returns the number of words in `set`, ignoring any trailing zero words. */
+static size_t
+csp_event_set_used_word_count(const struct csp_event_set *set)
+{
+    const uint64_t *words = csp_event_set_const_words(set);
+    size_t count = set->word_count;
+    while (count > 0 && words[count - 1] == 0) {
+        count--;
+    }
+    return count;
+}
+
+/* Ensures that `set` has room for at least `word_count` words. */
+static void
+csp_event_set_reserve(struct csp_event_set *set, size_t word_count)
+{
+    size_t new_count;
+    uint64_t *new_words;
+    if (likely(word_count <= set->word_count)) {
+        return;
+    }
+    new_count = set->word_count * 2;
+    if (new_count < word_count) {
+        new_count = word_count;
+    }
+    if (set->heap_words == NULL) {
+        new_words = malloc(new_count * sizeof(uint64_t));
+        assert(new_words != NULL);
+        memcpy(new_words, set->inline_words,
+               set->word_count * sizeof(uint64_t));
+    } else {
+        new_words = realloc(set->heap_words, new_count * sizeof(uint64_t));
+        assert(new_words != NULL);
+    }
+    memset(new_words + set->word_count, 0,
+           (new_count - set->word_count) * sizeof(uint64_t));
+    set->heap_words = new_words;
+    set->word_count = new_count;
+}
+
 void
 csp_event_set_init(struct csp_event_set *set)
 {
-    csp_set_init(&set->set);
+    set->word_count = CSP_EVENT_SET_INLINE_WORD_COUNT;
+    set->heap_words = NULL;
+    memset(set->inline_words, 0, sizeof(set->inline_words));
 }
 
 void
 csp_event_set_done(struct csp_event_set *set)
 {
-    csp_set_done(&set->set, NULL, NULL);
+    free(set->heap_words);
 }
 
 uint64_t
 csp_event_set_hash(const struct csp_event_set *set)
 {
-    return csp_set_hash(&set->set, CSP_EVENT_SET_INITIAL_HASH);
+    const uint64_t *words = csp_event_set_const_words(set);
+    size_t count = csp_event_set_used_word_count(set);
+    size_t i;
+    uint64_t hash = CSP_EVENT_SET_INITIAL_HASH;
+    /* Trailing zero words are ignored, so that the hash only depends on the
+     * contents of the set, and not on how many words it has allocated. */
+    for (i = 0; i < count; i++) {
+        hash = csp_id_hash_word(words[i], hash);
+    }
+    return hash;
 }
 
 bool
 csp_event_set_empty(const struct csp_event_set *set)
 {
-    return csp_set_empty(&set->set);
+    return csp_event_set_used_word_count(set) == 0;
 }
 
 size_t
 csp_event_set_size(const struct csp_event_set *set)
 {
-    return csp_set_size(&set->set);
+    const uint64_t *words = csp_event_set_const_words(set);
+    size_t size = 0;
+    size_t i;
+    for (i = 0; i < set->word_count; i++) {
+        size += __builtin_popcountll(words[i]);
+    }
+    return size;
 }
 
 bool
 csp_event_set_eq(const struct csp_event_set *set1,
                  const struct csp_event_set *set2)
 {
-    return csp_set_eq(&set1->set, &set2->set);
+    size_t count = set1->word_count > set2->word_count ? set1->word_count
+                                                       : set2->word_count;
+    size_t i;
+    for (i = 0; i < count; i++) {
+        if (csp_event_set_word(set1, i) != csp_event_set_word(set2, i)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 bool
 csp_event_set_subseteq(const struct csp_event_set *set1,
                        const struct csp_event_set *set2)
 {
-    return csp_set_subseteq(&set1->set, &set2->set);
+    const uint64_t *words1 = csp_event_set_const_words(set1);
+    size_t i;
+    for (i = 0; i < set1->word_count; i++) {
+        if ((words1[i] & ~csp_event_set_word(set2, i)) != 0) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void
 csp_event_set_clear(struct csp_event_set *set)
 {
-    csp_set_clear(&set->set, NULL, NULL);
+    memset(csp_event_set_words(set), 0, set->word_count * sizeof(uint64_t));
 }
 
 bool
 csp_event_set_add(struct csp_event_set *set, const struct csp_event *event)
 {
-    return csp_set_add(&set->set, (void *) event);
+    size_t word_index = csp_event_set_word_index(event->index);
+    uint64_t bit = csp_event_set_bit(event->index);
+    uint64_t *word;
+    csp_event_set_reserve(set, word_index + 1);
+    word = &csp_event_set_words(set)[word_index];
+    if (*word & bit) {
+        return false;
+    }
+    *word |= bit;
+    return true;
 }
 
 bool
 csp_event_set_remove(struct csp_event_set *set, const struct csp_event *event)
 {
-    return csp_set_remove(&set->set, (void *) event);
+    size_t word_index = csp_event_set_word_index(event->index);
+    uint64_t bit = csp_event_set_bit(event->index);
+    uint64_t *word;
+    if (word_index >= set->word_count) {
+        return false;
+    }
+    word = &csp_event_set_words(set)[word_index];
+    if (!(*word & bit)) {
+        return false;
+    }
+    *word &= ~bit;
+    return true;
 }
 
 bool
 csp_event_set_union(struct csp_event_set *set,
                     const struct csp_event_set *other)
 {
-    return csp_set_union(&set->set, &other->set);
+    size_t count = csp_event_set_used_word_count(other);
+    const uint64_t *other_words = csp_event_set_const_words(other);
+    uint64_t *words;
+    uint64_t any_new = 0;
+    size_t i;
+    csp_event_set_reserve(set, count);
+    words = csp_event_set_words(set);
+    for (i = 0; i < count; i++) {
+        any_new |= other_words[i] & ~words[i];
+        words[i] |= other_words[i];
+    }
+    return any_new != 0;
 }
 
 void
@@ -253,29 +691,154 @@ csp_event_set_visit(struct csp *csp, const struct csp_event_set *set,
     }
 }
 
+/* Returns the index of the first event in `set` whose index is at least
+ * `start`, or SIZE_MAX if there isn't one. */
+static size_t
+csp_event_set_find_next(const struct csp_event_set *set, size_t start)
+{
+    const uint64_t *words = csp_event_set_const_words(set);
+    size_t word_index = csp_event_set_word_index(start);
+    uint64_t word;
+    if (word_index >= set->word_count) {
+        return SIZE_MAX;
+    }
+    /* Mask off the bits before `start` in the first word. */
+    word = words[word_index] &
+           (~UINT64_C(0) << (start % CSP_EVENT_SET_WORD_BITS));
+    while (word == 0) {
+        if (++word_index >= set->word_count) {
+            return SIZE_MAX;
+        }
+        word = words[word_index];
+    }
+    return word_index * CSP_EVENT_SET_WORD_BITS + __builtin_ctzll(word);
+}
+
 void
 csp_event_set_get_iterator(const struct csp_event_set *set,
                            struct csp_event_set_iterator *iter)
 {
-    csp_set_get_iterator(&set->set, &iter->iter);
+    iter->set = set;
+    iter->index = csp_event_set_find_next(set, 0);
 }
 
 const struct csp_event *
 csp_event_set_iterator_get(const struct csp_event_set_iterator *iter)
 {
-    return csp_set_iterator_get(&iter->iter);
+    return csp_event_get_by_index(iter->index);
 }
 
 bool
 csp_event_set_iterator_done(struct csp_event_set_iterator *iter)
 {
-    return csp_set_iterator_done(&iter->iter);
+    return iter->index == SIZE_MAX;
 }
 
 void
 csp_event_set_iterator_advance(struct csp_event_set_iterator *iter)
 {
-    csp_set_iterator_advance(&iter->iter);
+    iter->index = csp_event_set_find_next(iter->set, iter->index + 1);
+}
+
+/*------------------------------------------------------------------------------
+ * Interned event sets
+ */
+
+struct csp_interned_event_set {
+    csp_id id;
+    struct csp_event_set set;
+};
+
+void
+csp_event_set_table_init(struct csp_event_set_table *table)
+{
+    csp_map_init(&table->map);
+    table->parent = NULL;
+}
+
+void
+csp_event_set_table_init_child(struct csp_event_set_table *table,
+                               const struct csp_event_set_table *parent)
+{
+    csp_map_init(&table->map);
+    table->parent = parent;
+}
+
+static size_t
+csp_interned_event_set_size(const struct csp_interned_event_set *interned)
+{
+    size_t size = sizeof(struct csp_interned_event_set);
+    if (interned->set.heap_words != NULL) {
+        size += interned->set.word_count * sizeof(uint64_t);
+    }
+    return size;
+}
+
+static void
+csp_event_set_table_free_entry(void *ud, void *entry)
+{
+    struct csp_interned_event_set *interned = entry;
+    csp_memory_track_free(CSP_MEMORY_EVENTS,
+                          csp_interned_event_set_size(interned));
+    csp_event_set_done(&interned->set);
+    free(interned);
+}
+
+void
+csp_event_set_table_done(struct csp_event_set_table *table)
+{
+    csp_map_done(&table->map, csp_event_set_table_free_entry, NULL);
+}
+
+const struct csp_event_set *
+csp_event_set_table_intern(struct csp_event_set_table *table,
+                           const struct csp_event_set *set)
+{
+    csp_id id = csp_event_set_hash(set);
+    struct csp_interned_event_set **entry;
+    /* The table is keyed by ID, and we need each interned set to have a
+     * distinct ID.  Start with the set's hash; if some other set with the same
+     * hash already has that ID (in this table or any of its ancestors), probe
+     * forward until we find either this set or an unused ID. */
+    while (true) {
+        const struct csp_event_set_table *ancestor;
+        const struct csp_interned_event_set *existing = NULL;
+        for (ancestor = table->parent; ancestor != NULL;
+             ancestor = ancestor->parent) {
+            existing = csp_map_get(&ancestor->map, id);
+            if (existing != NULL) {
+                break;
+            }
+        }
+        if (existing == NULL) {
+            entry = (struct csp_interned_event_set **) csp_map_at(&table->map,
+                                                                  id);
+            if (*entry == NULL) {
+                break;
+            }
+            existing = *entry;
+        }
+        if (csp_event_set_eq(&existing->set, set)) {
+            return &existing->set;
+        }
+        id++;
+    }
+    *entry = malloc(sizeof(struct csp_interned_event_set));
+    assert(*entry != NULL);
+    (*entry)->id = id;
+    csp_event_set_init(&(*entry)->set);
+    csp_event_set_union(&(*entry)->set, set);
+    csp_memory_track_alloc(CSP_MEMORY_EVENTS,
+                           csp_interned_event_set_size(*entry));
+    return &(*entry)->set;
+}
+
+csp_id
+csp_interned_event_set_id(const struct csp_event_set *set)
+{
+    const struct csp_interned_event_set *interned =
+            container_of(set, struct csp_interned_event_set, set);
+    return interned->id;
 }
 
 /*------------------------------------------------------------------------------
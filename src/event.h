@@ -8,11 +8,13 @@
 #ifndef HST_EVENT_H
 #define HST_EVENT_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "ccan/compiler/compiler.h"
 #include "basics.h"
-#include "set.h"
+#include "map.h"
 
 struct csp;
 struct csp_event_visitor;
@@ -42,6 +44,17 @@ PURE_FUNCTION
 const struct csp_event *
 csp_event_get_sized(const char *name, size_t name_length);
 
+/* Looks up the events with each of the given names, filling in `events` with
+ * the results.  This is equivalent to calling csp_event_get_sized for each name
+ * in turn, but is faster when many of the events don't exist yet.
+ *
+ * All of the event functions are safe to call from multiple threads at once;
+ * looking up an event that already exists never needs to take a lock. */
+void
+csp_event_get_many(size_t count, const char *const *names,
+                   const size_t *name_lengths,
+                   const struct csp_event **events);
+
 PURE_FUNCTION
 csp_id
 csp_event_id(const struct csp_event *event);
@@ -50,12 +63,30 @@ PURE_FUNCTION
 const char *
 csp_event_name(const struct csp_event *event);
 
+/* Every event is assigned a small, dense index when it's first created.  (The
+ * first event gets index 0, the next gets index 1, and so on.)  These indices
+ * aren't stable across runs, since they depend on the order in which events
+ * are created, so you should never use them to calculate an ID. */
+PURE_FUNCTION
+size_t
+csp_event_index(const struct csp_event *event);
+
 /*------------------------------------------------------------------------------
  * Event sets
  */
 
+/* The number of 64-bit words that an event set can store without allocating
+ * anything.  This lets us store the events with the first 256 indices inline. */
+#define CSP_EVENT_SET_INLINE_WORD_COUNT 4
+
+/* A set of events, stored as a bitset indexed by each event's dense index.
+ * Any words beyond `word_count` are implicitly zero, so two sets can be equal
+ * even if they have allocated different numbers of words. */
 struct csp_event_set {
-    struct csp_set set;
+    size_t word_count;
+    /* NULL if we're still using `inline_words`. */
+    uint64_t *heap_words;
+    uint64_t inline_words[CSP_EVENT_SET_INLINE_WORD_COUNT];
 };
 
 void
@@ -106,7 +137,10 @@ csp_event_set_visit(struct csp *csp, const struct csp_event_set *set,
                     struct csp_event_visitor *visitor);
 
 struct csp_event_set_iterator {
-    struct csp_set_iterator iter;
+    const struct csp_event_set *set;
+    /* The index of the current event, or SIZE_MAX once we've reached the end of
+     * the set. */
+    size_t index;
 };
 
 void
@@ -127,6 +161,49 @@ csp_event_set_iterator_advance(struct csp_event_set_iterator *iter);
          !csp_event_set_iterator_done((iter));      \
          csp_event_set_iterator_advance((iter)))
 
+/*------------------------------------------------------------------------------
+ * Interned event sets
+ */
+
+/* A table of frozen event sets, where each distinct set is stored exactly once.
+ * Two interned sets from the same table are equal if and only if they are the
+ * same pointer.  Each interned set also has an ID, which is derived from its
+ * contents, and which is distinct from the ID of every other set in the same
+ * table.
+ *
+ * A table can have a parent, whose sets it treats as its own: interning a set
+ * that's already in the parent (or one of its ancestors) returns the parent's
+ * copy, and IDs are distinct across the whole chain.  New sets are only ever
+ * added to the child, so you can throw away the child without affecting the
+ * parent.  The parent must outlive the child, and you must not add anything to
+ * the parent while the child exists. */
+struct csp_event_set_table {
+    /* Maps each interned set's ID to the set. */
+    struct csp_map map;
+    const struct csp_event_set_table *parent;
+};
+
+void
+csp_event_set_table_init(struct csp_event_set_table *table);
+
+void
+csp_event_set_table_init_child(struct csp_event_set_table *table,
+                               const struct csp_event_set_table *parent);
+
+void
+csp_event_set_table_done(struct csp_event_set_table *table);
+
+/* Returns the interned copy of `set`, adding it to `table` if needed.  The
+ * result is owned by `table`, and must not be modified. */
+const struct csp_event_set *
+csp_event_set_table_intern(struct csp_event_set_table *table,
+                           const struct csp_event_set *set);
+
+/* Returns the ID of an interned event set.  `set` must have been returned by
+ * csp_event_set_table_intern. */
+csp_id
+csp_interned_event_set_id(const struct csp_event_set *set);
+
 /*------------------------------------------------------------------------------
  * Event visitors
  */
@@ -10,6 +10,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "huge-pages.h"
+#include "memory.h"
+
 #include "has-trace.c.in"
 #include "reachable.c.in"
 #include "traces.c.in"
@@ -30,18 +33,55 @@ streq(const char *str1, const char *str2)
     return strcmp(str1, str2) == 0;
 }
 
+/* Registered with atexit when you pass in --mem-stats, so that we print out the
+ * statistics no matter how the command exits. */
+static void
+print_memory_stats(void)
+{
+    struct csp_memory_stats stats;
+    enum csp_memory_category category;
+    csp_memory_stats(&stats);
+    fprintf(stderr, "%-14s %14s %14s\n", "memory", "current", "peak");
+    for (category = 0; category < CSP_MEMORY_CATEGORY_COUNT; category++) {
+        fprintf(stderr, "%-14s %14zu %14zu\n",
+                csp_memory_category_name(category),
+                stats.categories[category].current_bytes,
+                stats.categories[category].peak_bytes);
+    }
+    fprintf(stderr, "judy free lists %13zu\n", stats.judy_free_list_bytes);
+    fprintf(stderr, "judy slabs %18zu\n", stats.judy_slab_bytes);
+}
+
 int
 main(int argc, char **argv)
 {
     const char *command;
     struct command *curr;
+    bool mem_stats = false;
+
+    argc--, argv++; /* Executable name */
+
+    /* Global options come before the command name. */
+    while (argc > 0 && strncmp(*argv, "--", 2) == 0) {
+        if (streq(*argv, "--mem-stats")) {
+            mem_stats = true;
+        } else if (streq(*argv, "--huge-pages")) {
+            csp_set_huge_pages(true);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", *argv);
+            exit(EXIT_FAILURE);
+        }
+        argc--, argv++;
+    }
+    if (mem_stats) {
+        atexit(print_memory_stats);
+    }
 
-    if (argc <= 1) {
-        fprintf(stderr, "Usage: hst [command]\n");
+    if (argc == 0) {
+        fprintf(stderr, "Usage: hst [--mem-stats] [--huge-pages] [command]\n");
         exit(EXIT_FAILURE);
     }
 
-    argc--, argv++; /* Executable name */
     command = *argv;
 
     for (curr = commands; curr->name != NULL; curr++) {
@@ -0,0 +1,124 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "huge-pages.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ccan/likely/likely.h"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* -1 until we've looked at the HST_HUGE_PAGES environment variable. */
+static int huge_pages_enabled = -1;
+
+/* Set once MAP_HUGETLB has failed, so that we don't keep asking for explicit
+ * huge pages when the administrator hasn't reserved any. */
+static bool hugetlb_unavailable = false;
+
+bool
+csp_huge_pages_enabled(void)
+{
+    int enabled = __atomic_load_n(&huge_pages_enabled, __ATOMIC_RELAXED);
+    if (unlikely(enabled == -1)) {
+        const char *env = getenv("HST_HUGE_PAGES");
+        enabled = env != NULL && strcmp(env, "1") == 0;
+        __atomic_store_n(&huge_pages_enabled, enabled, __ATOMIC_RELAXED);
+    }
+    return enabled;
+}
+
+void
+csp_set_huge_pages(bool enabled)
+{
+    __atomic_store_n(&huge_pages_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+static size_t
+round_up(size_t size)
+{
+    return (size + CSP_HUGE_PAGE_SIZE - 1) & ~(CSP_HUGE_PAGE_SIZE - 1);
+}
+
+#if defined(MAP_HUGETLB)
+static void *
+map_hugetlb(size_t size)
+{
+    void *region;
+    if (__atomic_load_n(&hugetlb_unavailable, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region == MAP_FAILED) {
+        __atomic_store_n(&hugetlb_unavailable, true, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return region;
+}
+#else
+static void *
+map_hugetlb(size_t size)
+{
+    return NULL;
+}
+#endif
+
+/* Maps a region of regular pages, and then trims it so that it's aligned to a
+ * huge page boundary, which transparent huge pages need.  Returns NULL if the
+ * mapping fails. */
+static void *
+map_aligned(size_t size)
+{
+    size_t padded_size = size + CSP_HUGE_PAGE_SIZE;
+    char *padded = mmap(NULL, padded_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char *region;
+    size_t head;
+    size_t tail;
+    if (padded == MAP_FAILED) {
+        return NULL;
+    }
+    region = (char *) round_up((uintptr_t) padded);
+    head = region - padded;
+    tail = padded_size - head - size;
+    if (head > 0) {
+        munmap(padded, head);
+    }
+    if (tail > 0) {
+        munmap(region + size, tail);
+    }
+#if defined(MADV_HUGEPAGE)
+    /* This is only advice; it's fine if the kernel doesn't support it. */
+    madvise(region, size, MADV_HUGEPAGE);
+#endif
+    return region;
+}
+
+void *
+csp_huge_pages_map(size_t *size)
+{
+    void *region;
+    *size = round_up(*size);
+    region = map_hugetlb(*size);
+    if (region == NULL) {
+        region = map_aligned(*size);
+    }
+    return region;
+}
+
+void
+csp_huge_pages_unmap(void *ptr, size_t size)
+{
+    munmap(ptr, size);
+}
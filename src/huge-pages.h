@@ -0,0 +1,51 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HST_HUGE_PAGES_H
+#define HST_HUGE_PAGES_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Judy arrays and process nodes are both pointer-chasing structures, and a
+ * large check can touch millions of them, so it can spend a lot of its time on
+ * TLB misses.  If you turn on huge pages, the Judy allocator's slabs and the
+ * environment's arena chunks are carved out of large regions that we map
+ * ourselves, asking the OS to back them with huge pages.  We first try for
+ * explicit huge pages (MAP_HUGETLB), which only works if the administrator has
+ * reserved some; if that fails we fall back on transparent huge pages
+ * (MADV_HUGEPAGE); and if the OS doesn't support either, we just end up with
+ * regular pages.
+ *
+ * Huge pages are off by default, since they round every region up to a whole
+ * huge page, which wastes memory for small checks.  You can turn them on by
+ * calling csp_set_huge_pages, or by setting the HST_HUGE_PAGES environment
+ * variable to 1.  The setting is shared by the whole program, and only affects
+ * memory that's allocated after you change it. */
+
+#define CSP_HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+bool
+csp_huge_pages_enabled(void);
+
+void
+csp_set_huge_pages(bool enabled);
+
+/* Maps a new region of zeroed memory that's at least `*size` bytes long and is
+ * aligned to CSP_HUGE_PAGE_SIZE.  Rounds `*size` up to the actual size of the
+ * region, which is always a multiple of CSP_HUGE_PAGE_SIZE.  Returns NULL if
+ * the OS won't give us the memory; callers should fall back on regular
+ * allocations. */
+void *
+csp_huge_pages_map(size_t *size);
+
+/* Unmaps a region returned by csp_huge_pages_map.  `size` must be the rounded
+ * size that it gave you. */
+void
+csp_huge_pages_unmap(void *ptr, size_t size);
+
+#endif /* HST_HUGE_PAGES_H */
@@ -0,0 +1,134 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "id-hash.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccan/hash/hash.h"
+
+#if defined(CSP_ID_HASH_LOOKUP3)
+
+uint64_t
+csp_id_hash_word(uint64_t value, uint64_t seed)
+{
+    return hash64_any(&value, sizeof(value), seed);
+}
+
+uint64_t
+csp_id_hash_bytes(const void *data, size_t length, uint64_t seed)
+{
+    return hash64_any(data, length, seed);
+}
+
+#else /* !CSP_ID_HASH_LOOKUP3 */
+
+/* These mixers follow the structure of wyhash: the core operation ("mum")
+ * multiplies two 64-bit words into a 128-bit product, and XORs the two halves
+ * of the product together.  Every input bit affects most of the output bits,
+ * and modern CPUs can do the whole thing in a handful of cycles. */
+
+#define CSP_ID_HASH_P0 UINT64_C(0xa0761d6478bd642f)
+#define CSP_ID_HASH_P1 UINT64_C(0xe7037ed1a0b428db)
+#define CSP_ID_HASH_P2 UINT64_C(0x8ebc6af09c88c6e3)
+#define CSP_ID_HASH_P3 UINT64_C(0x589965cc75374cc3)
+
+static uint64_t
+csp_id_hash_mum(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = (__uint128_t) a * b;
+    return (uint64_t) product ^ (uint64_t) (product >> 64);
+#else
+    /* Schoolbook multiplication using 32-bit halves. */
+    uint64_t a_lo = (uint32_t) a;
+    uint64_t a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t) b;
+    uint64_t b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t) hi_lo + lo_hi;
+    uint64_t lo = (cross << 32) | (uint32_t) lo_lo;
+    uint64_t hi = hi_hi + (hi_lo >> 32) + (cross >> 32);
+    return lo ^ hi;
+#endif
+}
+
+static uint64_t
+csp_id_hash_read64(const uint8_t *data)
+{
+    uint64_t result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+static uint64_t
+csp_id_hash_read32(const uint8_t *data)
+{
+    uint32_t result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+/* Reads 1-3 bytes into a word, without looping or branching on the exact
+ * length. */
+static uint64_t
+csp_id_hash_read_small(const uint8_t *data, size_t length)
+{
+    return ((uint64_t) data[0] << 16) | ((uint64_t) data[length >> 1] << 8) |
+           data[length - 1];
+}
+
+uint64_t
+csp_id_hash_word(uint64_t value, uint64_t seed)
+{
+    uint64_t rotated = (value << 32) | (value >> 32);
+    uint64_t h = csp_id_hash_mum(value ^ CSP_ID_HASH_P1,
+                                 rotated ^ seed ^ CSP_ID_HASH_P0);
+    return csp_id_hash_mum(h ^ CSP_ID_HASH_P2, CSP_ID_HASH_P1 ^ sizeof(value));
+}
+
+uint64_t
+csp_id_hash_bytes(const void *vdata, size_t length, uint64_t seed)
+{
+    const uint8_t *data = vdata;
+    size_t remaining = length;
+    uint64_t a;
+    uint64_t b;
+    seed ^= CSP_ID_HASH_P0;
+    while (remaining > 16) {
+        seed = csp_id_hash_mum(csp_id_hash_read64(data) ^ CSP_ID_HASH_P1,
+                               csp_id_hash_read64(data + 8) ^ seed);
+        data += 16;
+        remaining -= 16;
+    }
+    /* The final 0-16 bytes are read as two (possibly overlapping) words, like
+     * wyhash does.  That avoids a variable-length copy, and is still injective
+     * for any particular length, which we mix in below. */
+    if (remaining > 8) {
+        a = csp_id_hash_read64(data);
+        b = csp_id_hash_read64(data + remaining - 8);
+    } else if (remaining >= 4) {
+        a = csp_id_hash_read32(data);
+        b = csp_id_hash_read32(data + remaining - 4);
+    } else if (remaining > 0) {
+        a = csp_id_hash_read_small(data, remaining);
+        b = 0;
+    } else {
+        a = 0;
+        b = 0;
+    }
+    return csp_id_hash_mum(
+            CSP_ID_HASH_P1 ^ length,
+            csp_id_hash_mum(a ^ CSP_ID_HASH_P2, b ^ seed ^ CSP_ID_HASH_P3));
+}
+
+#endif /* !CSP_ID_HASH_LOOKUP3 */
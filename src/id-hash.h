@@ -0,0 +1,34 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HST_ID_HASH_H
+#define HST_ID_HASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* The hash functions that we use to construct reproducible IDs.  Almost every
+ * hash that we calculate is of a single 64-bit word (another ID, a pointer, or
+ * a set's running hash), so we have a dedicated function for that case, which
+ * is a couple of 64×64→128-bit multiplications instead of a byte-oriented
+ * loop.  Event and process names go through a separate function that consumes
+ * 16 bytes at a time.
+ *
+ * You can choose the implementation at configure time with --with-id-hash.
+ * The default (`mum`) uses the multiply-and-fold mixers described above; you
+ * can also ask for `lookup3` to use ccan's hash64_any for everything, which is
+ * what we used to do. */
+
+/* Returns a hash of a single 64-bit `value`, starting from `seed`. */
+uint64_t
+csp_id_hash_word(uint64_t value, uint64_t seed);
+
+/* Returns a hash of `length` bytes of `data`, starting from `seed`. */
+uint64_t
+csp_id_hash_bytes(const void *data, size_t length, uint64_t seed);
+
+#endif /* HST_ID_HASH_H */
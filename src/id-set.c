@@ -7,7 +7,9 @@
 
 #include "id-set.h"
 
+#include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "set.h"
@@ -82,13 +84,15 @@ csp_id_set_add(struct csp_id_set *set, csp_id id)
 bool
 csp_id_set_add_many(struct csp_id_set *set, size_t count, csp_id *ids)
 {
-    bool any_new = false;
+    bool any_new;
+    void **elements = malloc(count * sizeof(void *));
     size_t i;
+    assert(count == 0 || elements != NULL);
     for (i = 0; i < count; i++) {
-        if (csp_id_set_add(set, ids[i])) {
-            any_new = true;
-        }
+        elements[i] = (void *) (uintptr_t) ids[i];
     }
+    any_new = csp_set_add_many(&set->set, count, elements);
+    free(elements);
     return any_new;
 }
 
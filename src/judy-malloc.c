@@ -5,55 +5,333 @@
  * -----------------------------------------------------------------------------
  */
 
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "ccan/likely/likely.h"
 #include "Judy.h"
+#include "huge-pages.h"
+#include "memory.h"
 
-/* We're going to use a simple free list to reduce the number of times we dive
- * down in malloc, especially since we're going to build up and free sets quite
- * a lot during a refinement check.
+/* Judy allocates everything in units of Words, and we're going to build up and
+ * free sets quite a lot during a refinement check, so we use our own slab
+ * allocator for the small sizes instead of diving down into malloc for every
+ * node.  The small sizes seem to be the most common, so we only handle sizes
+ * up through a hopefully reasonable number, and use malloc/free directly for
+ * everything bigger than that.
  *
- * Judy allocates everything in units of Words, so we need a separate free list
- * for each distinct Word size.  The small ones seem to be the most common, so
- * we only keep free lists for the sizes up through a hopefully reasonable
- * number, and use calloc/free directly for everything bigger than that. */
+ * Each thread has its own cache, containing a free list for each Word size.
+ * When a free list is empty, we carve new objects off of a slab: a large,
+ * aligned chunk of memory that only contains objects of a single size.  Since
+ * slabs are aligned, we can find the slab (and the cache that owns it) for any
+ * object by masking off the low bits of its address.
+ *
+ * Allocating and freeing on the owning thread never needs any synchronization.
+ * If a thread frees an object that belongs to another thread's cache, it
+ * pushes the object onto that cache's "remote free" stack (with a CAS), and the
+ * owning thread collects everything on that stack the next time one of its free
+ * lists runs dry.
+ *
+ * Other threads might still be holding objects from a cache's slabs when its
+ * thread exits, so we never free a cache.  Instead, we put it in a pool, and
+ * the next thread that starts allocating adopts it, along with its slabs and
+ * free lists.  That means that the total amount of memory in the caches is
+ * bounded by the largest number of threads that were ever allocating at once.
+ *
+ * Each cache also counts how many bytes it has handed out (less the number of
+ * bytes freed to it), and only reports that to the memory accounting code once
+ * it builds up to CSP_MEMORY_JUDY_BATCH_SIZE, so that we don't need an atomic
+ * operation for every allocation.  The number of bytes on the cache's free
+ * lists is only ever written by its owning thread, but can be read by any
+ * thread that wants to report on it.
+ *
+ * Separately, each thread keeps a running total of the Judy memory that it has
+ * allocated less the memory that it has freed, which environments use to
+ * charge Judy arrays against their memory budgets (see environment.h).  That
+ * total is only ever touched by its own thread, so it's a plain thread-local.
+ *
+ * Slabs normally come straight from aligned_alloc.  If huge pages are turned on
+ * (see huge-pages.h), each cache instead maps a huge-page region at a time and
+ * carves its slabs out of that, so that the objects that a thread allocates
+ * are packed into as few TLB entries as possible. */
 
 #define MAX_WORDS 64
-static void *FREE_LISTS[MAX_WORDS + 1];
+#define SLAB_SIZE ((size_t) 64 * 1024)
 
-static void *
-new_object(size_t words)
+struct judy_cache;
+
+struct judy_slab {
+    struct judy_cache *owner;
+    size_t words;
+    /* The other slabs owned by the same cache. */
+    struct judy_slab *next;
+};
+
+struct judy_cache {
+    void *free_lists[MAX_WORDS + 1];
+    /* The unused part of the most recent slab for each size. */
+    char *bump[MAX_WORDS + 1];
+    char *bump_end[MAX_WORDS + 1];
+    struct judy_slab *slabs;
+    /* The unused part of the most recent huge-page region. */
+    char *region_next;
+    char *region_end;
+    /* Objects freed by other threads.  Only accessed atomically. */
+    void *remote_frees;
+    /* The next cache in the pool of caches whose threads have exited. */
+    struct judy_cache *next_unused;
+    /* Every cache that has ever been created. */
+    struct judy_cache *next_cache;
+    /* Bytes allocated minus bytes freed that we haven't reported yet. */
+    int64_t unreported_bytes;
+    size_t free_list_bytes;
+};
+
+static __thread struct judy_cache *current_cache = NULL;
+static __thread int64_t thread_bytes = 0;
+
+static pthread_mutex_t unused_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct judy_cache *unused_caches = NULL;
+static struct judy_cache *all_caches = NULL;
+static size_t slab_bytes = 0;
+
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+/*------------------------------------------------------------------------------
+ * Caches
+ */
+
+static void
+report_bytes(struct judy_cache *cache)
+{
+    if (cache->unreported_bytes > 0) {
+        csp_memory_track_alloc(CSP_MEMORY_JUDY, cache->unreported_bytes);
+    } else if (cache->unreported_bytes < 0) {
+        csp_memory_track_free(CSP_MEMORY_JUDY, -cache->unreported_bytes);
+    }
+    cache->unreported_bytes = 0;
+}
+
+static void
+count_allocation(struct judy_cache *cache, int64_t bytes)
+{
+    cache->unreported_bytes += bytes;
+    if (unlikely(cache->unreported_bytes >=
+                         (int64_t) CSP_MEMORY_JUDY_BATCH_SIZE ||
+                 cache->unreported_bytes <=
+                         -(int64_t) CSP_MEMORY_JUDY_BATCH_SIZE)) {
+        report_bytes(cache);
+    }
+}
+
+static void
+count_free_list_bytes(struct judy_cache *cache, int64_t bytes)
+{
+    size_t free_list_bytes =
+            __atomic_load_n(&cache->free_list_bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&cache->free_list_bytes, free_list_bytes + bytes,
+                     __ATOMIC_RELAXED);
+}
+
+static void
+release_cache(void *vcache)
+{
+    struct judy_cache *cache = vcache;
+    report_bytes(cache);
+    pthread_mutex_lock(&unused_caches_lock);
+    cache->next_unused = unused_caches;
+    unused_caches = cache;
+    pthread_mutex_unlock(&unused_caches_lock);
+    current_cache = NULL;
+}
+
+static void
+create_cache_key(void)
+{
+    int rc = pthread_key_create(&cache_key, release_cache);
+    assert(rc == 0);
+}
+
+static struct judy_cache *
+acquire_cache(void)
+{
+    struct judy_cache *cache;
+    pthread_once(&cache_key_once, create_cache_key);
+    pthread_mutex_lock(&unused_caches_lock);
+    cache = unused_caches;
+    if (cache != NULL) {
+        unused_caches = cache->next_unused;
+    } else {
+        cache = calloc(1, sizeof(struct judy_cache));
+        assert(cache != NULL);
+        cache->next_cache = all_caches;
+        all_caches = cache;
+    }
+    pthread_mutex_unlock(&unused_caches_lock);
+    /* Make sure that release_cache is called when this thread exits.
+     * (Destructors are only called for keys with a non-NULL value.) */
+    pthread_setspecific(cache_key, cache);
+    current_cache = cache;
+    return cache;
+}
+
+static struct judy_cache *
+get_cache(void)
+{
+    struct judy_cache *cache = current_cache;
+    return likely(cache != NULL) ? cache : acquire_cache();
+}
+
+/*------------------------------------------------------------------------------
+ * Slabs
+ */
+
+static struct judy_slab *
+get_slab(void *object)
+{
+    return (struct judy_slab *) ((uintptr_t) object & ~(SLAB_SIZE - 1));
+}
+
+static struct judy_slab *
+new_slab(struct judy_cache *cache)
+{
+    struct judy_slab *slab;
+    if (csp_huge_pages_enabled() && cache->region_next == cache->region_end) {
+        /* Like slabs, regions are never unmapped. */
+        size_t size = CSP_HUGE_PAGE_SIZE;
+        char *region = csp_huge_pages_map(&size);
+        if (region != NULL) {
+            cache->region_next = region;
+            cache->region_end = region + size;
+        }
+    }
+    if (cache->region_next == cache->region_end) {
+        /* Either huge pages are off, or the OS wouldn't give us a region. */
+        slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+        assert(slab != NULL);
+        return slab;
+    }
+    slab = (struct judy_slab *) cache->region_next;
+    cache->region_next += SLAB_SIZE;
+    return slab;
+}
+
+/* Adds a new slab for objects of the given size. */
+static void
+refill_bump(struct judy_cache *cache, size_t words)
+{
+    struct judy_slab *slab = new_slab(cache);
+    __atomic_add_fetch(&slab_bytes, SLAB_SIZE, __ATOMIC_RELAXED);
+    slab->owner = cache;
+    slab->words = words;
+    slab->next = cache->slabs;
+    cache->slabs = slab;
+    cache->bump[words] = (char *) (slab + 1);
+    cache->bump_end[words] = (char *) slab + SLAB_SIZE;
+}
+
+/* Moves every object that other threads have freed onto our own free lists.
+ * Returns whether there were any. */
+static bool
+collect_remote_frees(struct judy_cache *cache)
+{
+    void *object = __atomic_exchange_n(&cache->remote_frees, NULL,
+                                       __ATOMIC_ACQUIRE);
+    if (object == NULL) {
+        return false;
+    }
+    while (object != NULL) {
+        void *next = *((void **) object);
+        size_t words = get_slab(object)->words;
+        *((void **) object) = cache->free_lists[words];
+        cache->free_lists[words] = object;
+        count_free_list_bytes(cache, words * sizeof(Word_t));
+        object = next;
+    }
+    return true;
+}
+
+static void
+push_remote_free(struct judy_cache *owner, void *object)
 {
-    return calloc(words, sizeof(Word_t));
+    void *head = __atomic_load_n(&owner->remote_frees, __ATOMIC_RELAXED);
+    do {
+        *((void **) object) = head;
+    } while (!__atomic_compare_exchange_n(&owner->remote_frees, &head, object,
+                                          true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
 }
 
 static void *
-reuse_object(size_t words)
+new_object(struct judy_cache *cache, size_t words)
 {
-    void *object = FREE_LISTS[words];
-    FREE_LISTS[words] = *((void **) object);
+    size_t size = words * sizeof(Word_t);
+    void *object;
+    if (collect_remote_frees(cache) && cache->free_lists[words] != NULL) {
+        object = cache->free_lists[words];
+        cache->free_lists[words] = *((void **) object);
+        count_free_list_bytes(cache, -(int64_t) size);
+        return object;
+    }
+    if (unlikely(cache->bump[words] == NULL ||
+                 (size_t) (cache->bump_end[words] - cache->bump[words]) <
+                         size)) {
+        refill_bump(cache, words);
+    }
+    object = cache->bump[words];
+    cache->bump[words] += size;
     return object;
 }
 
+/*------------------------------------------------------------------------------
+ * Judy API
+ */
+
 Word_t
 JudyMalloc(Word_t words)
 {
-    if (unlikely(words > MAX_WORDS || FREE_LISTS[words] == NULL)) {
-        return (Word_t) new_object(words);
-    } else {
-        return (Word_t) reuse_object(words);
+    struct judy_cache *cache;
+    void *object;
+    thread_bytes += words * sizeof(Word_t);
+    if (unlikely(words > MAX_WORDS)) {
+        csp_memory_track_alloc(CSP_MEMORY_JUDY, words * sizeof(Word_t));
+        return (Word_t) malloc(words * sizeof(Word_t));
+    }
+    cache = get_cache();
+    count_allocation(cache, words * sizeof(Word_t));
+    object = cache->free_lists[words];
+    if (unlikely(object == NULL)) {
+        return (Word_t) new_object(cache, words);
     }
+    cache->free_lists[words] = *((void **) object);
+    count_free_list_bytes(cache, -(int64_t) (words * sizeof(Word_t)));
+    return (Word_t) object;
 }
 
 void
 JudyFree(void *object, Word_t words)
 {
+    struct judy_cache *cache;
+    struct judy_slab *slab;
+    thread_bytes -= words * sizeof(Word_t);
     if (unlikely(words > MAX_WORDS)) {
+        csp_memory_track_free(CSP_MEMORY_JUDY, words * sizeof(Word_t));
         free(object);
+        return;
+    }
+    cache = get_cache();
+    count_allocation(cache, -(int64_t) (words * sizeof(Word_t)));
+    slab = get_slab(object);
+    if (likely(slab->owner == cache)) {
+        *((void **) object) = cache->free_lists[words];
+        cache->free_lists[words] = object;
+        count_free_list_bytes(cache, words * sizeof(Word_t));
     } else {
-        *((void **) object) = FREE_LISTS[words];
-        FREE_LISTS[words] = object;
+        push_remote_free(slab->owner, object);
     }
 }
 
@@ -68,3 +346,31 @@ JudyFreeVirtual(void *object, Word_t words)
 {
     JudyFree(object, words);
 }
+
+/*------------------------------------------------------------------------------
+ * Statistics
+ */
+
+void
+csp_judy_malloc_stats(size_t *free_list_bytes, size_t *total_slab_bytes)
+{
+    struct judy_cache *cache;
+    /* We can at least make sure that our own thread's numbers are up to date. */
+    if (current_cache != NULL) {
+        report_bytes(current_cache);
+    }
+    *free_list_bytes = 0;
+    pthread_mutex_lock(&unused_caches_lock);
+    for (cache = all_caches; cache != NULL; cache = cache->next_cache) {
+        *free_list_bytes +=
+                __atomic_load_n(&cache->free_list_bytes, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&unused_caches_lock);
+    *total_slab_bytes = __atomic_load_n(&slab_bytes, __ATOMIC_RELAXED);
+}
+
+int64_t
+csp_judy_malloc_thread_bytes(void)
+{
+    return thread_bytes;
+}
@@ -7,23 +7,330 @@
 
 #include "map.h"
 
+#include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 #define JUDYERROR_NOTEST 1
 #include <Judy.h>
 
 #include "ccan/compiler/compiler.h"
+#include "ccan/likely/likely.h"
+
+/*------------------------------------------------------------------------------
+ * Hash tables
+ */
+
+/* Hashed maps are "Swiss tables": open-addressing hash tables whose slots are
+ * divided into groups of 8.  Alongside the slots, we keep one control byte per
+ * slot, which is either EMPTY, DELETED, or (for a full slot) the lower 7 bits
+ * of the key's hash.  To look up a key, we load a whole group's control bytes
+ * as a single 64-bit word, and use some bit-twiddling to find every slot in the
+ * group whose control byte matches the key's hash; we only have to compare keys
+ * for those slots.  Probing stops at the first group that contains an EMPTY
+ * slot.
+ *
+ * IDs are usually already well-mixed hashes, but some maps are keyed by
+ * pointers, so we run every key through a finalizer anyway. */
+
+#define CSP_MAP_GROUP_SIZE 8
+#define CSP_MAP_CTRL_EMPTY 0x80
+#define CSP_MAP_CTRL_DELETED 0xfe
+#define CSP_MAP_LSBS UINT64_C(0x0101010101010101)
+#define CSP_MAP_MSBS UINT64_C(0x8080808080808080)
+
+struct csp_map_slot {
+    csp_id key;
+    void *value;
+};
+
+struct csp_map_table {
+    /* Always a power of 2, and at least CSP_MAP_GROUP_SIZE. */
+    size_t capacity;
+    size_t count;
+    /* How many more EMPTY slots we can fill before we have to grow. */
+    size_t growth_left;
+    uint8_t *ctrl;
+    struct csp_map_slot *slots;
+};
+
+static uint64_t
+csp_map_hash(csp_id id)
+{
+    /* The MurmurHash3 finalizer */
+    id ^= id >> 33;
+    id *= UINT64_C(0xff51afd7ed558ccd);
+    id ^= id >> 33;
+    id *= UINT64_C(0xc4ceb9fe1a85ec53);
+    id ^= id >> 33;
+    return id;
+}
+
+static uint8_t
+csp_map_h2(uint64_t hash)
+{
+    return hash & 0x7f;
+}
+
+static uint64_t
+csp_map_load_group(const struct csp_map_table *table, size_t group)
+{
+    uint64_t word;
+    memcpy(&word, &table->ctrl[group * CSP_MAP_GROUP_SIZE], sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/* Returns a mask with the high bit set in each byte of `group` that equals
+ * `h2`.  This can have false positives (but only for bytes that are also full
+ * slots), so you still have to compare keys. */
+static uint64_t
+csp_map_group_match(uint64_t group, uint8_t h2)
+{
+    uint64_t x = group ^ (CSP_MAP_LSBS * h2);
+    return (x - CSP_MAP_LSBS) & ~x & CSP_MAP_MSBS;
+}
+
+static uint64_t
+csp_map_group_match_empty(uint64_t group)
+{
+    /* EMPTY is the only control byte with bit 7 set and bit 1 clear. */
+    return group & ~(group << 6) & CSP_MAP_MSBS;
+}
+
+static uint64_t
+csp_map_group_match_empty_or_deleted(uint64_t group)
+{
+    return group & CSP_MAP_MSBS;
+}
+
+static size_t
+csp_map_mask_first(uint64_t mask)
+{
+    return __builtin_ctzll(mask) / 8;
+}
+
+static size_t
+csp_map_table_max_load(size_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+static struct csp_map_table *
+csp_map_table_new(size_t capacity)
+{
+    struct csp_map_table *table = malloc(sizeof(struct csp_map_table));
+    assert(table != NULL);
+    table->capacity = capacity;
+    table->count = 0;
+    table->growth_left = csp_map_table_max_load(capacity);
+    table->ctrl = malloc(capacity);
+    assert(table->ctrl != NULL);
+    memset(table->ctrl, CSP_MAP_CTRL_EMPTY, capacity);
+    table->slots = malloc(capacity * sizeof(struct csp_map_slot));
+    assert(table->slots != NULL);
+    return table;
+}
+
+static void
+csp_map_table_free(struct csp_map_table *table)
+{
+    if (table != NULL) {
+        free(table->ctrl);
+        free(table->slots);
+        free(table);
+    }
+}
+
+static bool
+csp_map_table_is_full(const struct csp_map_table *table, size_t slot)
+{
+    return (table->ctrl[slot] & 0x80) == 0;
+}
+
+/* Returns the slot containing `id`, or SIZE_MAX if there isn't one. */
+static size_t
+csp_map_table_find(const struct csp_map_table *table, csp_id id)
+{
+    uint64_t hash = csp_map_hash(id);
+    uint8_t h2 = csp_map_h2(hash);
+    size_t group_mask = table->capacity / CSP_MAP_GROUP_SIZE - 1;
+    size_t group_index = (hash >> 7) & group_mask;
+    size_t step = 0;
+    while (true) {
+        uint64_t group = csp_map_load_group(table, group_index);
+        uint64_t match = csp_map_group_match(group, h2);
+        while (match != 0) {
+            size_t slot = group_index * CSP_MAP_GROUP_SIZE +
+                          csp_map_mask_first(match);
+            if (likely(table->slots[slot].key == id)) {
+                return slot;
+            }
+            match &= match - 1;
+        }
+        if (likely(csp_map_group_match_empty(group) != 0)) {
+            return SIZE_MAX;
+        }
+        /* Triangular probing visits every group exactly once, since the
+         * number of groups is a power of 2. */
+        group_index = (group_index + ++step) & group_mask;
+    }
+}
+
+/* Returns the first EMPTY or DELETED slot in `hash`'s probe sequence. */
+static size_t
+csp_map_table_find_free(const struct csp_map_table *table, uint64_t hash)
+{
+    size_t group_mask = table->capacity / CSP_MAP_GROUP_SIZE - 1;
+    size_t group_index = (hash >> 7) & group_mask;
+    size_t step = 0;
+    while (true) {
+        uint64_t group = csp_map_load_group(table, group_index);
+        uint64_t match = csp_map_group_match_empty_or_deleted(group);
+        if (match != 0) {
+            return group_index * CSP_MAP_GROUP_SIZE + csp_map_mask_first(match);
+        }
+        group_index = (group_index + ++step) & group_mask;
+    }
+}
+
+static void
+csp_map_table_fill(struct csp_map_table *table, size_t slot, csp_id id,
+                   uint64_t hash, void *value)
+{
+    if (table->ctrl[slot] == CSP_MAP_CTRL_EMPTY) {
+        table->growth_left--;
+    }
+    table->ctrl[slot] = csp_map_h2(hash);
+    table->slots[slot].key = id;
+    table->slots[slot].value = value;
+    table->count++;
+}
+
+/* Moves the contents of `table` into a new table.  If most of the table's
+ * non-EMPTY slots are tombstones, the new table is the same size; otherwise
+ * it's twice as big. */
+static struct csp_map_table *
+csp_map_table_rehash(struct csp_map_table *table)
+{
+    size_t capacity = table->count * 2 < csp_map_table_max_load(table->capacity)
+                              ? table->capacity
+                              : table->capacity * 2;
+    struct csp_map_table *new_table = csp_map_table_new(capacity);
+    size_t slot;
+    for (slot = 0; slot < table->capacity; slot++) {
+        if (csp_map_table_is_full(table, slot)) {
+            csp_id id = table->slots[slot].key;
+            uint64_t hash = csp_map_hash(id);
+            size_t new_slot = csp_map_table_find_free(new_table, hash);
+            csp_map_table_fill(new_table, new_slot, id, hash,
+                               table->slots[slot].value);
+        }
+    }
+    csp_map_table_free(table);
+    return new_table;
+}
+
+/* Returns the slot for `id`, creating it (with a NULL value) if needed. */
+static void **
+csp_map_table_at(struct csp_map *map, csp_id id)
+{
+    struct csp_map_table *table = map->entries;
+    uint64_t hash;
+    size_t slot;
+    if (unlikely(table == NULL)) {
+        table = map->entries = csp_map_table_new(CSP_MAP_GROUP_SIZE);
+    } else {
+        slot = csp_map_table_find(table, id);
+        if (slot != SIZE_MAX) {
+            return &table->slots[slot].value;
+        }
+    }
+    hash = csp_map_hash(id);
+    slot = csp_map_table_find_free(table, hash);
+    if (unlikely(table->growth_left == 0 &&
+                 table->ctrl[slot] == CSP_MAP_CTRL_EMPTY)) {
+        table = map->entries = csp_map_table_rehash(table);
+        slot = csp_map_table_find_free(table, hash);
+    }
+    csp_map_table_fill(table, slot, id, hash, NULL);
+    return &table->slots[slot].value;
+}
+
+static void
+csp_map_table_remove(struct csp_map_table *table, size_t slot)
+{
+    size_t group_index = slot / CSP_MAP_GROUP_SIZE;
+    /* If this slot's group already has an EMPTY slot, then no probe sequence
+     * ever continued past this group, and we don't need a tombstone. */
+    if (csp_map_group_match_empty(csp_map_load_group(table, group_index))) {
+        table->ctrl[slot] = CSP_MAP_CTRL_EMPTY;
+        table->growth_left++;
+    } else {
+        table->ctrl[slot] = CSP_MAP_CTRL_DELETED;
+    }
+    table->count--;
+}
+
+/* Returns the first full slot at or after `slot`, or the table's capacity if
+ * there isn't one. */
+static size_t
+csp_map_table_next(const struct csp_map_table *table, size_t slot)
+{
+    if (table == NULL) {
+        return 0;
+    }
+    while (slot < table->capacity && !csp_map_table_is_full(table, slot)) {
+        slot++;
+    }
+    return slot;
+}
+
+static size_t
+csp_map_table_capacity(const struct csp_map_table *table)
+{
+    return table == NULL ? 0 : table->capacity;
+}
+
+/*------------------------------------------------------------------------------
+ * Maps
+ */
 
 void
 csp_map_init(struct csp_map *map)
 {
     map->entries = NULL;
+    map->backend = CSP_MAP_ORDERED;
+}
+
+void
+csp_map_init_hashed(struct csp_map *map)
+{
+    map->entries = NULL;
+    map->backend = CSP_MAP_HASHED;
 }
 
 void
 csp_map_done(struct csp_map *map, csp_map_free_entry_f *free_entry, void *ud)
 {
     UNNEEDED Word_t dummy;
+    if (map->backend == CSP_MAP_HASHED) {
+        struct csp_map_table *table = map->entries;
+        if (free_entry != NULL && table != NULL) {
+            size_t slot;
+            for (slot = 0; slot < table->capacity; slot++) {
+                if (csp_map_table_is_full(table, slot)) {
+                    free_entry(ud, table->slots[slot].value);
+                }
+            }
+        }
+        csp_map_table_free(table);
+        map->entries = NULL;
+        return;
+    }
     if (free_entry != NULL) {
         Word_t *ventry;
         csp_id id = 0;
@@ -37,12 +344,30 @@ csp_map_done(struct csp_map *map, csp_map_free_entry_f *free_entry, void *ud)
     JLFA(dummy, map->entries);
 }
 
+static void
+csp_map_iterator_load_slot(struct csp_map_iterator *iter)
+{
+    struct csp_map_table *table = iter->map->entries;
+    iter->slot = csp_map_table_next(table, iter->slot);
+    if (iter->slot < csp_map_table_capacity(table)) {
+        iter->key = table->slots[iter->slot].key;
+        iter->value = &table->slots[iter->slot].value;
+    } else {
+        iter->value = NULL;
+    }
+}
+
 void
 csp_map_get_iterator(const struct csp_map *map, struct csp_map_iterator *iter)
 {
-    iter->entries = &map->entries;
+    iter->map = map;
+    iter->slot = 0;
     iter->key = 0;
-    JLF(iter->value, *iter->entries, iter->key);
+    if (map->backend == CSP_MAP_HASHED) {
+        csp_map_iterator_load_slot(iter);
+        return;
+    }
+    JLF(iter->value, map->entries, iter->key);
 }
 
 bool
@@ -54,7 +379,12 @@ csp_map_iterator_done(struct csp_map_iterator *iter)
 void
 csp_map_iterator_advance(struct csp_map_iterator *iter)
 {
-    JLN(iter->value, *iter->entries, iter->key);
+    if (iter->map->backend == CSP_MAP_HASHED) {
+        iter->slot++;
+        csp_map_iterator_load_slot(iter);
+        return;
+    }
+    JLN(iter->value, iter->map->entries, iter->key);
 }
 
 bool
@@ -78,6 +408,10 @@ csp_map_eq(const struct csp_map *map1, const struct csp_map *map2,
 bool
 csp_map_empty(const struct csp_map *map)
 {
+    if (map->backend == CSP_MAP_HASHED) {
+        const struct csp_map_table *table = map->entries;
+        return table == NULL || table->count == 0;
+    }
     return map->entries == NULL;
 }
 
@@ -85,14 +419,38 @@ size_t
 csp_map_size(const struct csp_map *map)
 {
     Word_t count;
+    if (map->backend == CSP_MAP_HASHED) {
+        const struct csp_map_table *table = map->entries;
+        return table == NULL ? 0 : table->count;
+    }
     JLC(count, map->entries, 0, -1);
     return count;
 }
 
+size_t
+csp_map_memory_usage(const struct csp_map *map)
+{
+    const struct csp_map_table *table = map->entries;
+    if (map->backend != CSP_MAP_HASHED || table == NULL) {
+        return 0;
+    }
+    return sizeof(struct csp_map_table) + table->capacity +
+           table->capacity * sizeof(struct csp_map_slot);
+}
+
 void *
 csp_map_get(const struct csp_map *map, csp_id id)
 {
     Word_t *ventry;
+    if (map->backend == CSP_MAP_HASHED) {
+        const struct csp_map_table *table = map->entries;
+        size_t slot;
+        if (table == NULL) {
+            return NULL;
+        }
+        slot = csp_map_table_find(table, id);
+        return slot == SIZE_MAX ? NULL : table->slots[slot].value;
+    }
     JLG(ventry, map->entries, id);
     if (ventry == NULL) {
         return NULL;
@@ -106,6 +464,9 @@ void **
 csp_map_at(struct csp_map *map, csp_id id)
 {
     Word_t *ventry;
+    if (map->backend == CSP_MAP_HASHED) {
+        return csp_map_table_at(map, id);
+    }
     JLI(ventry, map->entries, id);
     return (void **) ventry;
 }
@@ -114,10 +475,7 @@ void *
 csp_map_insert(struct csp_map *map, csp_id id, csp_map_init_entry_f *init_entry,
                void *ud)
 {
-    Word_t *ventry;
-    void **entry;
-    JLI(ventry, map->entries, id);
-    entry = (void **) ventry;
+    void **entry = csp_map_at(map, id);
     if (*entry == NULL) {
         init_entry(ud, entry);
     }
@@ -135,5 +493,15 @@ csp_map_remove(struct csp_map *map, csp_id id, csp_map_free_entry_f *free_entry,
             free_entry(ud, entry);
         }
     }
+    if (map->backend == CSP_MAP_HASHED) {
+        struct csp_map_table *table = map->entries;
+        if (table != NULL) {
+            size_t slot = csp_map_table_find(table, id);
+            if (slot != SIZE_MAX) {
+                csp_map_table_remove(table, slot);
+            }
+        }
+        return;
+    }
     JLD(rc, map->entries, id);
 }
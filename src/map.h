@@ -17,14 +17,28 @@
  * you want.  You'll typically never use this type directly; instead, there are
  * several helper types that store particular kinds of values, and you'll use
  * one of those directly.  (Take a look at csp_id_map to see an example of how
- * to implement one of those more specialized map types.) */
+ * to implement one of those more specialized map types.)
+ *
+ * There are two backends.  By default, entries are stored in a JudyL array,
+ * which keeps them sorted by key.  Alternatively, you can store them in an
+ * open-addressing hash table, which is a better fit for maps that are mostly
+ * used for point lookups of random-looking keys, like the process registry.
+ * Hashed maps iterate through their entries in an arbitrary order, and you
+ * must not add entries to them while you're iterating. */
+
+enum csp_map_backend { CSP_MAP_ORDERED, CSP_MAP_HASHED };
+
 struct csp_map {
     void *entries;
+    enum csp_map_backend backend;
 };
 
 void
 csp_map_init(struct csp_map *map);
 
+void
+csp_map_init_hashed(struct csp_map *map);
+
 typedef void
 csp_map_free_entry_f(void *ud, void *entry);
 
@@ -44,6 +58,12 @@ csp_map_empty(const struct csp_map *map);
 size_t
 csp_map_size(const struct csp_map *map);
 
+/* Returns the number of bytes that a hashed map's table takes up.  (An ordered
+ * map's entries live in a Judy array, which keeps track of its own memory, so
+ * this is always 0 for them.) */
+size_t
+csp_map_memory_usage(const struct csp_map *map);
+
 /* Return NULL if the entry doesn't exist. */
 void *
 csp_map_get(const struct csp_map *map, csp_id id);
@@ -67,7 +87,8 @@ csp_map_remove(struct csp_map *map, csp_id id, csp_map_free_entry_f *free_entry,
                void *ud);
 
 struct csp_map_iterator {
-    void *const *entries;
+    const struct csp_map *map;
+    size_t slot;
     csp_id key;
     void **value;
 };
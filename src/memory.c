@@ -0,0 +1,105 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "memory.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ccan/likely/likely.h"
+
+/* The counters are signed, since one thread might report that it has freed
+ * some Judy memory before the thread that allocated it has reported the
+ * allocation.  Each counter gets its own cache line, so that threads reporting
+ * to different categories don't contend with each other. */
+#define CSP_MEMORY_CACHE_LINE_SIZE 64
+
+struct csp_memory_counter {
+    int64_t current;
+    int64_t peak;
+} __attribute__((aligned(CSP_MEMORY_CACHE_LINE_SIZE)));
+
+static struct csp_memory_counter counters[CSP_MEMORY_CATEGORY_COUNT];
+
+static const char *const category_names[CSP_MEMORY_CATEGORY_COUNT] = {
+        "judy", "processes", "registry", "equivalences", "events"};
+
+const char *
+csp_memory_category_name(enum csp_memory_category category)
+{
+    assert(category < CSP_MEMORY_CATEGORY_COUNT);
+    return category_names[category];
+}
+
+void
+csp_memory_track_alloc(enum csp_memory_category category, size_t bytes)
+{
+    struct csp_memory_counter *counter = &counters[category];
+    int64_t current = __atomic_add_fetch(&counter->current, (int64_t) bytes,
+                                         __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&counter->peak, __ATOMIC_RELAXED);
+    /* Only touch the peak when we've actually passed it; once usage has
+     * leveled off, that's rare.  (The hot allocation paths batch up their
+     * reports, so we're not called very often to begin with.) */
+    if (likely(current <= peak)) {
+        return;
+    }
+    while (current > peak &&
+           !__atomic_compare_exchange_n(&counter->peak, &peak, current, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void
+csp_memory_track_free(enum csp_memory_category category, size_t bytes)
+{
+    struct csp_memory_counter *counter = &counters[category];
+    __atomic_sub_fetch(&counter->current, (int64_t) bytes, __ATOMIC_RELAXED);
+}
+
+void
+csp_memory_track_resize(enum csp_memory_category category, size_t old_bytes,
+                        size_t new_bytes)
+{
+    if (new_bytes > old_bytes) {
+        csp_memory_track_alloc(category, new_bytes - old_bytes);
+    } else if (new_bytes < old_bytes) {
+        csp_memory_track_free(category, old_bytes - new_bytes);
+    }
+}
+
+static size_t
+clamp(int64_t value)
+{
+    return value < 0 ? 0 : (size_t) value;
+}
+
+size_t
+csp_memory_total_bytes(void)
+{
+    int64_t total = 0;
+    size_t i;
+    for (i = 0; i < CSP_MEMORY_CATEGORY_COUNT; i++) {
+        total += __atomic_load_n(&counters[i].current, __ATOMIC_RELAXED);
+    }
+    return clamp(total);
+}
+
+void
+csp_memory_stats(struct csp_memory_stats *stats)
+{
+    size_t i;
+    for (i = 0; i < CSP_MEMORY_CATEGORY_COUNT; i++) {
+        stats->categories[i].current_bytes = clamp(
+                __atomic_load_n(&counters[i].current, __ATOMIC_RELAXED));
+        stats->categories[i].peak_bytes =
+                clamp(__atomic_load_n(&counters[i].peak, __ATOMIC_RELAXED));
+    }
+    csp_judy_malloc_stats(&stats->judy_free_list_bytes,
+                          &stats->judy_slab_bytes);
+}
@@ -0,0 +1,98 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HST_MEMORY_H
+#define HST_MEMORY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* We keep track of how much memory each of our major subsystems is using, so
+ * that you can see where the memory goes during a large check.  The counters
+ * are shared by every environment (and every thread), since some of the things
+ * that we're measuring (like the event table and the Judy allocator) are
+ * shared, too.
+ *
+ * These only count the memory that each subsystem has asked for, not any
+ * overhead from malloc itself. */
+
+enum csp_memory_category {
+    /* Everything allocated by Judy arrays, which back most of our sets and
+     * ordered maps, no matter who owns them. */
+    CSP_MEMORY_JUDY,
+    /* Process nodes, and any memory that they own other than Judy arrays. */
+    CSP_MEMORY_PROCESSES,
+    /* Each environment's ID→process and index→process tables. */
+    CSP_MEMORY_REGISTRY,
+    /* Equivalence classes built up by bisimulation and normalization. */
+    CSP_MEMORY_EQUIVALENCES,
+    /* Interned events and event sets. */
+    CSP_MEMORY_EVENTS,
+    CSP_MEMORY_CATEGORY_COUNT
+};
+
+/* Returns a short lower-case name for a category, like "judy". */
+const char *
+csp_memory_category_name(enum csp_memory_category category);
+
+struct csp_memory_usage {
+    size_t current_bytes;
+    size_t peak_bytes;
+};
+
+struct csp_memory_stats {
+    struct csp_memory_usage categories[CSP_MEMORY_CATEGORY_COUNT];
+    /* The Judy allocator keeps freed objects on per-thread free lists so that
+     * it can hand them out again; these are the number of bytes sitting on
+     * those free lists, and the total size of the slabs that they (and every
+     * small object that's in use) were carved out of. */
+    size_t judy_free_list_bytes;
+    size_t judy_slab_bytes;
+};
+
+/* Fills in `stats` with the current memory usage.  To keep allocation cheap,
+ * each thread only reports its Judy allocations every so often, so the Judy
+ * numbers can be off by up to CSP_MEMORY_JUDY_BATCH_SIZE bytes for each thread
+ * other than the calling one.  Likewise, each environment only reports its
+ * process nodes every CSP_MEMORY_PROCESS_BATCH_SIZE bytes (and whenever a
+ * session begins or ends). */
+void
+csp_memory_stats(struct csp_memory_stats *stats);
+
+#define CSP_MEMORY_JUDY_BATCH_SIZE ((size_t) 64 * 1024)
+#define CSP_MEMORY_PROCESS_BATCH_SIZE ((size_t) 16 * 1024)
+
+/* Returns the current usage of all of the categories put together.  This is
+ * cheaper than csp_memory_stats, so it's okay to call it often. */
+size_t
+csp_memory_total_bytes(void);
+
+/* Record that a subsystem has allocated or freed `bytes` bytes. */
+void
+csp_memory_track_alloc(enum csp_memory_category category, size_t bytes);
+
+void
+csp_memory_track_free(enum csp_memory_category category, size_t bytes);
+
+/* Record a change in a subsystem's usage from `old_bytes` to `new_bytes`.
+ * Handy for data structures that can tell you how big they are. */
+void
+csp_memory_track_resize(enum csp_memory_category category, size_t old_bytes,
+                        size_t new_bytes);
+
+/* Implemented in judy-malloc.c */
+void
+csp_judy_malloc_stats(size_t *free_list_bytes, size_t *slab_bytes);
+
+/* Returns the number of bytes of Judy memory that the calling thread has
+ * allocated, less the number of bytes that it has freed, since it started.
+ * This is always up to date, but can go negative if the thread frees memory
+ * that some other thread allocated. */
+int64_t
+csp_judy_malloc_thread_bytes(void);
+
+#endif /* HST_MEMORY_H */
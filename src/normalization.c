@@ -110,7 +110,9 @@ csp_process_get_single_after_visit_edge(struct csp *csp,
 {
     struct csp_process_get_single_after *self =
             container_of(visitor, struct csp_process_get_single_after, visitor);
-    assert(self->after == NULL);
+    /* Some operators can report the same edge more than once (for instance,
+     * a → STOP □ a → STOP), which is fine. */
+    assert(self->after == NULL || self->after == after);
     self->after = after;
 }
 
@@ -197,18 +199,29 @@ csp_prenormalized_process_afters(struct csp *csp, struct csp_process *process,
     csp_edge_visitor_call(csp, visitor, initial, after);
 }
 
+static void
+csp_prenormalized_process_references(struct csp *csp,
+                                     struct csp_process *process,
+                                     struct csp_process_visitor *visitor)
+{
+    struct csp_prenormalized_process *self =
+            container_of(process, struct csp_prenormalized_process, process);
+    csp_process_set_visit(csp, &self->ps, visitor);
+}
+
 static void
 csp_prenormalized_process_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_prenormalized_process *self =
             container_of(process, struct csp_prenormalized_process, process);
     csp_process_set_done(&self->ps);
-    free(self);
+    csp_dealloc(csp, self, sizeof(struct csp_prenormalized_process));
 }
 
 static const struct csp_process_iface csp_prenormalized_process_iface = {
         0, csp_prenormalized_process_name, csp_prenormalized_process_initials,
-        csp_prenormalized_process_afters, csp_prenormalized_process_free};
+        csp_prenormalized_process_afters, csp_prenormalized_process_references,
+        csp_prenormalized_process_free};
 
 static csp_id
 csp_prenormalized_process_get_id(const struct csp_process_set *ps)
@@ -225,8 +238,7 @@ csp_prenormalized_process_new(struct csp *csp, const struct csp_process_set *ps)
     struct csp_prenormalized_process *self;
     csp_id id = csp_prenormalized_process_get_id(ps);
     return_if_nonnull(csp_get_process(csp, id));
-    self = malloc(sizeof(struct csp_prenormalized_process));
-    assert(self != NULL);
+    self = csp_alloc(csp, sizeof(struct csp_prenormalized_process));
     self->process.id = id;
     self->process.iface = &csp_prenormalized_process_iface;
     csp_process_set_init(&self->ps);
@@ -263,6 +275,67 @@ csp_prenormalized_process_get_processes(struct csp_process *process)
     return &self->ps;
 }
 
+/*------------------------------------------------------------------------------
+ * Surveying prenormalized processes
+ */
+
+struct csp_survey_prenormalized {
+    struct csp_process_visitor visitor;
+    size_t max_nodes;
+    struct csp_prenormalized_survey *survey;
+};
+
+static bool
+csp_prenormalized_process_is_deterministic(struct csp *csp,
+                                           struct csp_process *process)
+{
+    const struct csp_process_set *ps =
+            csp_prenormalized_process_get_processes(process);
+    struct csp_process_set_iterator iter;
+    struct csp_contains_event contains;
+    if (csp_process_set_size(ps) != 1) {
+        return false;
+    }
+    /* A τ-closed singleton can still contain a τ self-loop. */
+    contains = csp_contains_event(csp->tau);
+    csp_process_set_get_iterator(ps, &iter);
+    csp_process_visit_initials(csp, csp_process_set_iterator_get(&iter),
+                               &contains.visitor);
+    return !contains.is_present;
+}
+
+static int
+csp_survey_prenormalized_visit(struct csp *csp,
+                               struct csp_process_visitor *visitor,
+                               struct csp_process *process)
+{
+    struct csp_survey_prenormalized *self =
+            container_of(visitor, struct csp_survey_prenormalized, visitor);
+    if (self->survey->node_count == self->max_nodes) {
+        self->survey->truncated = true;
+        return CSP_PROCESS_BFS_ABORT;
+    }
+    self->survey->node_count++;
+    if (!csp_prenormalized_process_is_deterministic(csp, process)) {
+        self->survey->nondeterministic_count++;
+    }
+    return CSP_PROCESS_BFS_CONTINUE;
+}
+
+void
+csp_survey_prenormalized_process(struct csp *csp,
+                                 struct csp_process *prenormalized,
+                                 size_t max_nodes,
+                                 struct csp_prenormalized_survey *survey)
+{
+    struct csp_survey_prenormalized self = {
+            {csp_survey_prenormalized_visit}, max_nodes, survey};
+    survey->node_count = 0;
+    survey->nondeterministic_count = 0;
+    survey->truncated = false;
+    csp_process_bfs(csp, prenormalized, &self.visitor);
+}
+
 /*------------------------------------------------------------------------------
  * Step equivalence
  */
@@ -348,7 +421,8 @@ csp_init_bisimulation_visit_process(struct csp *csp,
                                     struct csp_process *process)
 {
     /* We start by assuming that all nodes with the same behavior are
-     * equivalent. */
+     * equivalent.  Behaviors are interned, so each distinct behavior has a
+     * distinct hash, which we can use as the ID of its initial class. */
     struct csp_init_bisimulation *self = container_of(
             visitor, struct csp_init_bisimulation, visitor);
     csp_process_get_behavior(csp, process, CSP_TRACES, &self->behavior);
@@ -466,15 +540,16 @@ struct csp_normalized_process {
     /* Should be prenormalized processes */
     const struct csp_process_set *subprocesses;
     struct csp_equivalences *equiv;
+    /* The normalized process that owns `equiv` (which might be this one) */
+    struct csp_process *owner;
     csp_id equivalence_class;
-    bool equiv_owned;
 };
 
 static struct csp_process *
 csp_normalized_process_new(struct csp *csp,
                            struct csp_process *prenormalized_root,
                            struct csp_equivalences *equiv,
-                           csp_id equivalence_class, bool equiv_owned);
+                           csp_id equivalence_class, struct csp_process *owner);
 
 static void
 csp_normalized_process_name(struct csp *csp, struct csp_process *process,
@@ -539,24 +614,42 @@ csp_normalized_process_afters(struct csp *csp, struct csp_process *process,
     /* Our "real" after is the normalized node for this equivalence class that
      * we just found. */
     after = csp_normalized_process_new(csp, self->prenormalized_root,
-                                       self->equiv, equivalence_class, false);
+                                       self->equiv, equivalence_class,
+                                       self->owner);
     return csp_edge_visitor_call(csp, visitor, initial, after);
 }
 
+static void
+csp_normalized_process_references(struct csp *csp, struct csp_process *process,
+                                  struct csp_process_visitor *visitor)
+{
+    struct csp_normalized_process *self =
+            container_of(process, struct csp_normalized_process, process);
+    csp_process_visitor_call(csp, visitor, self->prenormalized_root);
+    if (self->owner == process) {
+        /* The equivalences are indexed by each prenormalized process's `index`,
+         * so they all have to stay alive as long as we do. */
+        csp_equivalences_visit_members(csp, self->equiv, visitor);
+    } else {
+        csp_process_visitor_call(csp, visitor, self->owner);
+    }
+}
+
 static void
 csp_normalized_process_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_normalized_process *self =
             container_of(process, struct csp_normalized_process, process);
-    if (self->equiv_owned) {
+    if (self->owner == process) {
         csp_equivalences_free(self->equiv);
     }
-    free(self);
+    csp_dealloc(csp, self, sizeof(struct csp_normalized_process));
 }
 
 static const struct csp_process_iface csp_normalized_process_iface = {
         0, csp_normalized_process_name, csp_normalized_process_initials,
-        csp_normalized_process_afters, csp_normalized_process_free};
+        csp_normalized_process_afters, csp_normalized_process_references,
+        csp_normalized_process_free};
 
 static csp_id
 csp_normalized_process_get_id(struct csp_process *prenormalized_root,
@@ -569,11 +662,12 @@ csp_normalized_process_get_id(struct csp_process *prenormalized_root,
     return id;
 }
 
+/* If `owner` is NULL, the new process will own `equiv`. */
 static struct csp_process *
 csp_normalized_process_new(struct csp *csp,
                            struct csp_process *prenormalized_root,
                            struct csp_equivalences *equiv,
-                           csp_id equivalence_class, bool equiv_owned)
+                           csp_id equivalence_class, struct csp_process *owner)
 {
     struct csp_normalized_process *self;
     struct csp_process *process;
@@ -581,19 +675,18 @@ csp_normalized_process_new(struct csp *csp,
                                               equivalence_class);
     process = csp_get_process(csp, id);
     if (unlikely(process != NULL)) {
-        if (equiv_owned) {
+        if (owner == NULL) {
             csp_equivalences_free(equiv);
         }
         return process;
     }
 
-    self = malloc(sizeof(struct csp_normalized_process));
-    assert(self != NULL);
+    self = csp_alloc(csp, sizeof(struct csp_normalized_process));
     self->process.id = id;
     self->process.iface = &csp_normalized_process_iface;
     self->prenormalized_root = prenormalized_root;
     self->equiv = equiv;
-    self->equiv_owned = equiv_owned;
+    self->owner = owner == NULL ? &self->process : owner;
     self->equivalence_class = equivalence_class;
     self->subprocesses = csp_equivalences_get_members(equiv, equivalence_class);
     csp_register_process(csp, &self->process);
@@ -609,7 +702,7 @@ csp_normalize_process(struct csp *csp, struct csp_process *prenormalized)
     equivalence_class = csp_equivalences_get_class(equiv, prenormalized);
     assert(equivalence_class != CSP_ID_NONE);
     return csp_normalized_process_new(csp, prenormalized, equiv,
-                                      equivalence_class, true);
+                                      equivalence_class, NULL);
 }
 
 static struct csp_normalized_process *
@@ -630,7 +723,7 @@ csp_normalized_subprocess(struct csp *csp, struct csp_process *root_,
     class_id = csp_equivalences_get_class(root->equiv, prenormalized);
     /* Then return the normalized subprocess for that equivalence class. */
     return csp_normalized_process_new(csp, root->prenormalized_root,
-                                      root->equiv, class_id, false);
+                                      root->equiv, class_id, root->owner);
 }
 
 void
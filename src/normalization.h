@@ -8,6 +8,9 @@
 #ifndef HST_NORMALIZATION_H
 #define HST_NORMALIZATION_H
 
+#include <stdbool.h>
+#include <stdlib.h>
+
 #include "basics.h"
 #include "environment.h"
 #include "equivalence.h"
@@ -36,6 +39,29 @@ csp_find_process_closure(struct csp *csp, const struct csp_event *event,
 struct csp_process *
 csp_prenormalize_process(struct csp *csp, struct csp_process *process);
 
+/* Describes the prenormalized graph reachable from a prenormalized process. */
+struct csp_prenormalized_survey {
+    /* The number of prenormalized nodes that we visited. */
+    size_t node_count;
+    /* The number of visited nodes that are nondeterministic — that is, that
+     * represent more than one underlying process, or a single process that
+     * can perform a τ. */
+    size_t nondeterministic_count;
+    /* Whether we stopped before visiting every reachable node. */
+    bool truncated;
+};
+
+/* Performs a breadth-first search of the prenormalized nodes reachable from
+ * `prenormalized`, visiting at most `max_nodes` of them, and fills in `survey`
+ * with what we find.  If the search isn't truncated and none of the nodes are
+ * nondeterministic, then the original process was already deterministic, and
+ * can be used as the Spec of a refinement check as-is. */
+void
+csp_survey_prenormalized_process(struct csp *csp,
+                                 struct csp_process *prenormalized,
+                                 size_t max_nodes,
+                                 struct csp_prenormalized_survey *survey);
+
 /* Creates the "normalization" of a prenormalized process.  A normalized process
  * has the same restrictions as a prenormalized process, but also guarantees
  * that each distinct subprocess has a distinct behavior.  The result is a
@@ -73,8 +99,8 @@ csp_normalized_process_get_processes(struct csp *csp,
                                      struct csp_process_set *set);
 
 /* Returns the single `after` process for a particular `initial`, or NULL if
- * there is none.  If `process` has multiple `afters` for `initial`, the result
- * is undefined.  (We only call this for normalized processes, which are
+ * there is none.  If `process` has multiple distinct `afters` for `initial`,
+ * the result is undefined.  (We only call this for normalized processes, which are
  * guaranteed to have zero or one `after` for each event.) */
 struct csp_process *
 csp_process_get_single_after(struct csp *csp, struct csp_process *process,
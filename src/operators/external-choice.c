@@ -138,18 +138,28 @@ csp_external_choice_afters(struct csp *csp, struct csp_process *process,
     }
 }
 
+static void
+csp_external_choice_references(struct csp *csp, struct csp_process *process,
+                                 struct csp_process_visitor *visitor)
+{
+    struct csp_external_choice *choice =
+            container_of(process, struct csp_external_choice, process);
+    csp_process_set_visit(csp, &choice->ps, visitor);
+}
+
 static void
 csp_external_choice_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_external_choice *choice =
             container_of(process, struct csp_external_choice, process);
     csp_process_set_done(&choice->ps);
-    free(choice);
+    csp_dealloc(csp, choice, sizeof(struct csp_external_choice));
 }
 
 static const struct csp_process_iface csp_external_choice_iface = {
         6, csp_external_choice_name, csp_external_choice_initials,
-        csp_external_choice_afters, csp_external_choice_free};
+        csp_external_choice_afters, csp_external_choice_references,
+        csp_external_choice_free};
 
 static csp_id
 csp_external_choice_get_id(const struct csp_process_set *ps)
@@ -166,8 +176,7 @@ csp_external_choice_new(struct csp *csp, const struct csp_process_set *ps)
     csp_id id = csp_external_choice_get_id(ps);
     struct csp_external_choice *choice;
     return_if_nonnull(csp_get_process(csp, id));
-    choice = malloc(sizeof(struct csp_external_choice));
-    assert(choice != NULL);
+    choice = csp_alloc(csp, sizeof(struct csp_external_choice));
     choice->process.id = id;
     choice->process.iface = &csp_external_choice_iface;
     csp_process_set_init(&choice->ps);
@@ -15,13 +15,21 @@
 #include "environment.h"
 #include "event.h"
 #include "macros.h"
+#include "persistent-bag.h"
 #include "process.h"
 
+/* Every successor of an interleaving differs from it in only one subprocess, so
+ * we store the subprocesses in a persistent bag.  Each successor shares all but
+ * O(log n) of its nodes with its predecessor. */
 struct csp_interleave {
     struct csp_process process;
-    struct csp_process_bag ps;
+    struct csp_persistent_bag ps;
 };
 
+static struct csp_process *
+csp_interleave_persistent(struct csp *csp,
+                          const struct csp_persistent_bag *ps);
+
 /* Operational semantics for ⊓ Ps
  *
  *                  P -τ→ P'
@@ -46,7 +54,11 @@ csp_interleave_name(struct csp *csp, struct csp_process *process,
 {
     struct csp_interleave *interleave =
             container_of(process, struct csp_interleave, process);
-    csp_process_bag_nested_name(csp, process, &interleave->ps, "⫴", visitor);
+    struct csp_process_bag ps;
+    csp_process_bag_init(&ps);
+    csp_persistent_bag_to_bag(&interleave->ps, &ps);
+    csp_process_bag_nested_name(csp, process, &ps, "⫴", visitor);
+    csp_process_bag_done(&ps);
 }
 
 struct csp_interleave_build_initial {
@@ -92,11 +104,11 @@ csp_interleave_initials(struct csp *csp, struct csp_process *process,
      */
     struct csp_interleave *interleave =
             container_of(process, struct csp_interleave, process);
-    struct csp_process_bag_iterator iter;
+    struct csp_persistent_bag_iterator iter;
     struct csp_interleave_build_initial build_initial =
             csp_interleave_build_initial(visitor);
-    csp_process_bag_foreach (&interleave->ps, &iter) {
-        struct csp_process *p = csp_process_bag_iterator_get(&iter);
+    csp_persistent_bag_foreach (&interleave->ps, &iter) {
+        struct csp_process *p = csp_persistent_bag_iterator_get(&iter);
         csp_process_visit_initials(csp, p, &build_initial.visitor);
     }
     /* Rule 4 */
@@ -108,7 +120,7 @@ csp_interleave_initials(struct csp *csp, struct csp_process *process,
 struct csp_interleave_build_normal_after {
     struct csp_edge_visitor visitor;
     struct csp_edge_visitor *wrapped;
-    struct csp_process_bag *ps_prime;
+    const struct csp_persistent_bag *ps_minus_p;
 };
 
 static void
@@ -119,22 +131,22 @@ csp_interleave_build_normal_after_visit(struct csp *csp,
 {
     struct csp_interleave_build_normal_after *self = container_of(
             visitor, struct csp_interleave_build_normal_after, visitor);
-    /* ps_prime currently contains Ps.  Add P' and remove P to produce
-     * (Ps ∖ {P} ∪ {P'}) */
-    csp_process_bag_add(self->ps_prime, p_prime);
+    /* Add P' to a (cheap) copy of Ps ∖ {P} to produce (Ps ∖ {P} ∪ {P'}) */
+    struct csp_persistent_bag ps_prime;
+    csp_persistent_bag_init_copy(&ps_prime, self->ps_minus_p);
+    csp_persistent_bag_add(csp, &ps_prime, p_prime);
     /* Create ⫴ (Ps ∖ {P} ∪ {P'}) as a result. */
     csp_edge_visitor_call(csp, self->wrapped, initial,
-                          csp_interleave(csp, self->ps_prime));
-    /* Reset Ps' back to Ps ∖ {P}. */
-    csp_process_bag_remove(self->ps_prime, p_prime);
+                          csp_interleave_persistent(csp, &ps_prime));
+    csp_persistent_bag_done(csp, &ps_prime);
 }
 
 static struct csp_interleave_build_normal_after
 csp_interleave_build_normal_after(struct csp_edge_visitor *wrapped,
-                                  struct csp_process_bag *ps_prime)
+                                  const struct csp_persistent_bag *ps_minus_p)
 {
     struct csp_interleave_build_normal_after self = {
-            {csp_interleave_build_normal_after_visit}, wrapped, ps_prime};
+            {csp_interleave_build_normal_after_visit}, wrapped, ps_minus_p};
     return self;
 }
 
@@ -148,26 +160,22 @@ csp_interleave_normal_afters(struct csp *csp, struct csp_process *process,
     /* afters(⫴ Ps, a ∉ {τ,✔}) = ⋃ { ⫴ Ps ∖ {P} ∪ {P'} |
      *                                  P ∈ Ps, P' ∈ afters(P, a) }     [rule 2]
      */
-    struct csp_process_bag_iterator iter;
+    struct csp_persistent_bag_iterator iter;
     /* We're going to build up a lot of new Ps' sets that all have the same
      * basic structure: Ps' = Ps ∖ {P} ∪ {P'} */
-    struct csp_process_bag ps_prime;
-    struct csp_interleave_build_normal_after build_after =
-            csp_interleave_build_normal_after(visitor, &ps_prime);
-    csp_process_bag_init(&ps_prime);
-    /* Each Ps' starts with Ps, so go ahead and add that to our Ps' set once. */
-    csp_process_bag_union(&ps_prime, &interleave->ps);
+    struct csp_persistent_bag ps_minus_p;
+    struct csp_interleave_build_normal_after build_after;
     /* For all P ∈ Ps */
-    csp_process_bag_foreach (&interleave->ps, &iter) {
-        struct csp_process *p = csp_process_bag_iterator_get(&iter);
-        /* Set Ps' to Ps ∖ {P} */
-        csp_process_bag_remove(&ps_prime, p);
+    csp_persistent_bag_foreach (&interleave->ps, &iter) {
+        struct csp_process *p = csp_persistent_bag_iterator_get(&iter);
+        /* Construct Ps ∖ {P}, which shares most of its nodes with Ps. */
+        csp_persistent_bag_init_copy(&ps_minus_p, &interleave->ps);
+        csp_persistent_bag_remove(csp, &ps_minus_p, p);
         /* For all P' ∈ afters(P, a) */
+        build_after = csp_interleave_build_normal_after(visitor, &ps_minus_p);
         csp_process_visit_afters(csp, p, initial, &build_after.visitor);
-        /* Reset Ps' back to Ps. */
-        csp_process_bag_add(&ps_prime, p);
+        csp_persistent_bag_done(csp, &ps_minus_p);
     }
-    csp_process_bag_done(&ps_prime);
 }
 
 static void
@@ -177,30 +185,23 @@ csp_interleave_tau_for_tick_afters(struct csp *csp, struct csp_process *process,
 {
     struct csp_interleave *interleave =
             container_of(process, struct csp_interleave, process);
-    struct csp_process_bag_iterator i;
-    /* We're going to build up a lot of new Ps' sets that all have the same
-     * basic structure: Ps' = Ps ∖ {P} ∪ {STOP} */
-    struct csp_process_bag ps_prime;
-    csp_process_bag_init(&ps_prime);
-    /* Each Ps' starts with Ps, so go ahead and add that to our Ps' set once. */
-    csp_process_bag_union(&ps_prime, &interleave->ps);
+    struct csp_persistent_bag_iterator i;
     /* Find each P ∈ Ps where ✔ ∈ initials(P). */
-    csp_process_bag_foreach (&interleave->ps, &i) {
-        struct csp_process *p = csp_process_bag_iterator_get(&i);
+    csp_persistent_bag_foreach (&interleave->ps, &i) {
+        struct csp_process *p = csp_persistent_bag_iterator_get(&i);
         struct csp_contains_event contains = csp_contains_event(csp->tick);
         csp_process_visit_initials(csp, p, &contains.visitor);
         if (contains.is_present) {
             /* Create Ps ∖ {P} ∪ {STOP}) as a result. */
-            csp_process_bag_remove(&ps_prime, p);
-            csp_process_bag_add(&ps_prime, csp->stop);
+            struct csp_persistent_bag ps_prime;
+            csp_persistent_bag_init_copy(&ps_prime, &interleave->ps);
+            csp_persistent_bag_remove(csp, &ps_prime, p);
+            csp_persistent_bag_add(csp, &ps_prime, csp->stop);
             csp_edge_visitor_call(csp, visitor, initial,
-                                  csp_interleave(csp, &ps_prime));
-            /* Reset Ps' back to Ps. */
-            csp_process_bag_remove(&ps_prime, csp->stop);
-            csp_process_bag_add(&ps_prime, p);
+                                  csp_interleave_persistent(csp, &ps_prime));
+            csp_persistent_bag_done(csp, &ps_prime);
         }
     }
-    csp_process_bag_done(&ps_prime);
 }
 
 static void
@@ -228,9 +229,9 @@ csp_interleave_tick_afters(struct csp *csp, struct csp_process *process,
             container_of(process, struct csp_interleave, process);
     /* afters(⫴ {STOP}, ✔) = {STOP}                                  [rule 4] */
     struct csp_any_events any = csp_any_events();
-    struct csp_process_bag_iterator i;
-    csp_process_bag_foreach (&interleave->ps, &i) {
-        struct csp_process *p = csp_process_bag_iterator_get(&i);
+    struct csp_persistent_bag_iterator i;
+    csp_persistent_bag_foreach (&interleave->ps, &i) {
+        struct csp_process *p = csp_persistent_bag_iterator_get(&i);
         csp_process_visit_initials(csp, p, &any.visitor);
         if (any.has_events) {
             /* One of the subprocess has at least one initial, so this cannot
@@ -255,40 +256,54 @@ csp_interleave_afters(struct csp *csp, struct csp_process *process,
     }
 }
 
+static void
+csp_interleave_references(struct csp *csp, struct csp_process *process,
+                          struct csp_process_visitor *visitor)
+{
+    struct csp_interleave *interleave =
+            container_of(process, struct csp_interleave, process);
+    struct csp_persistent_bag_iterator iter;
+    csp_persistent_bag_foreach (&interleave->ps, &iter) {
+        struct csp_process *subprocess = csp_persistent_bag_iterator_get(&iter);
+        csp_process_visitor_call(csp, visitor, subprocess);
+    }
+}
+
 static void
 csp_interleave_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_interleave *interleave =
             container_of(process, struct csp_interleave, process);
-    csp_process_bag_done(&interleave->ps);
-    free(interleave);
+    csp_persistent_bag_done(csp, &interleave->ps);
+    csp_dealloc(csp, interleave, sizeof(struct csp_interleave));
 }
 
 static const struct csp_process_iface csp_interleave_iface = {
         9, csp_interleave_name, csp_interleave_initials, csp_interleave_afters,
-        csp_interleave_free};
+        csp_interleave_references, csp_interleave_free};
 
+/* The ID of an interleaving is derived from the multiset hash that the
+ * persistent bag caches at its root, so we never have to walk through the
+ * subprocesses to find out whether we've already created it. */
 static csp_id
-csp_interleave_get_id(const struct csp_process_bag *ps)
+csp_interleave_get_id(const struct csp_persistent_bag *ps)
 {
     static struct csp_id_scope interleave;
     csp_id id = csp_id_start(&interleave);
-    id = csp_id_add_process_bag(id, ps);
+    id = csp_id_add_id(id, csp_persistent_bag_hash(ps));
     return id;
 }
 
 static struct csp_process *
-csp_interleave_new(struct csp *csp, const struct csp_process_bag *ps)
+csp_interleave_persistent(struct csp *csp, const struct csp_persistent_bag *ps)
 {
     csp_id id = csp_interleave_get_id(ps);
     struct csp_interleave *interleave;
     return_if_nonnull(csp_get_process(csp, id));
-    interleave = malloc(sizeof(struct csp_interleave));
-    assert(interleave != NULL);
+    interleave = csp_alloc(csp, sizeof(struct csp_interleave));
     interleave->process.id = id;
     interleave->process.iface = &csp_interleave_iface;
-    csp_process_bag_init(&interleave->ps);
-    csp_process_bag_union(&interleave->ps, ps);
+    csp_persistent_bag_init_copy(&interleave->ps, ps);
     csp_register_process(csp, &interleave->process);
     return &interleave->process;
 }
@@ -296,5 +311,19 @@ csp_interleave_new(struct csp *csp, const struct csp_process_bag *ps)
 struct csp_process *
 csp_interleave(struct csp *csp, const struct csp_process_bag *ps)
 {
-    return csp_interleave_new(csp, ps);
+    struct csp_process *process;
+    struct csp_persistent_bag persistent;
+    struct csp_process_bag_iterator iter;
+    csp_persistent_bag_init(&persistent);
+    csp_process_bag_foreach (ps, &iter) {
+        struct csp_process *p = csp_process_bag_iterator_get(&iter);
+        size_t count = csp_process_bag_iterator_get_count(&iter);
+        size_t i;
+        for (i = 0; i < count; i++) {
+            csp_persistent_bag_add(csp, &persistent, p);
+        }
+    }
+    process = csp_interleave_persistent(csp, &persistent);
+    csp_persistent_bag_done(csp, &persistent);
+    return process;
 }
@@ -62,18 +62,28 @@ csp_internal_choice_afters(struct csp *csp, struct csp_process *process,
     }
 }
 
+static void
+csp_internal_choice_references(struct csp *csp, struct csp_process *process,
+                                 struct csp_process_visitor *visitor)
+{
+    struct csp_internal_choice *choice =
+            container_of(process, struct csp_internal_choice, process);
+    csp_process_set_visit(csp, &choice->ps, visitor);
+}
+
 static void
 csp_internal_choice_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_internal_choice *choice =
             container_of(process, struct csp_internal_choice, process);
     csp_process_set_done(&choice->ps);
-    free(choice);
+    csp_dealloc(csp, choice, sizeof(struct csp_internal_choice));
 }
 
 static const struct csp_process_iface csp_internal_choice_iface = {
         7, csp_internal_choice_name, csp_internal_choice_initials,
-        csp_internal_choice_afters, csp_internal_choice_free};
+        csp_internal_choice_afters, csp_internal_choice_references,
+        csp_internal_choice_free};
 
 static csp_id
 csp_internal_choice_get_id(const struct csp_process_set *ps)
@@ -90,8 +100,7 @@ csp_internal_choice_new(struct csp *csp, const struct csp_process_set *ps)
     csp_id id = csp_internal_choice_get_id(ps);
     struct csp_internal_choice *choice;
     return_if_nonnull(csp_get_process(csp, id));
-    choice = malloc(sizeof(struct csp_internal_choice));
-    assert(choice != NULL);
+    choice = csp_alloc(csp, sizeof(struct csp_internal_choice));
     choice->process.id = id;
     choice->process.iface = &csp_internal_choice_iface;
     csp_process_set_init(&choice->ps);
@@ -63,17 +63,26 @@ csp_prefix_afters(struct csp *csp, struct csp_process *process,
     }
 }
 
+static void
+csp_prefix_references(struct csp *csp, struct csp_process *process,
+                      struct csp_process_visitor *visitor)
+{
+    struct csp_prefix *prefix =
+            container_of(process, struct csp_prefix, process);
+    csp_process_visitor_call(csp, visitor, prefix->p);
+}
+
 static void
 csp_prefix_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_prefix *prefix =
             container_of(process, struct csp_prefix, process);
-    free(prefix);
+    csp_dealloc(csp, prefix, sizeof(struct csp_prefix));
 }
 
 static const struct csp_process_iface csp_prefix_iface = {
         1, csp_prefix_name, csp_prefix_initials, csp_prefix_afters,
-        csp_prefix_free};
+        csp_prefix_references, csp_prefix_free};
 
 static csp_id
 csp_prefix_get_id(const struct csp_event *a, struct csp_process *p)
@@ -92,8 +101,7 @@ csp_prefix_new(struct csp *csp, const struct csp_event *a,
     csp_id id = csp_prefix_get_id(a, p);
     struct csp_prefix *prefix;
     return_if_nonnull(csp_get_process(csp, id));
-    prefix = malloc(sizeof(struct csp_prefix));
-    assert(prefix != NULL);
+    prefix = csp_alloc(csp, sizeof(struct csp_prefix));
     prefix->process.id = id;
     prefix->process.iface = &csp_prefix_iface;
     prefix->a = a;
@@ -61,18 +61,31 @@ csp_recursive_process_afters(struct csp *csp, struct csp_process *process,
                              visitor);
 }
 
+static void
+csp_recursive_process_references(struct csp *csp, struct csp_process *process,
+                                 struct csp_process_visitor *visitor)
+{
+    struct csp_recursive_process *recursive_process =
+            container_of(process, struct csp_recursive_process, process);
+    if (recursive_process->definition != NULL) {
+        csp_process_visitor_call(csp, visitor, recursive_process->definition);
+    }
+}
+
 static void
 csp_recursive_process_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_recursive_process *recursive_process =
             container_of(process, struct csp_recursive_process, process);
-    free((char *) recursive_process->name);
-    free(recursive_process);
+    csp_dealloc(csp, recursive_process,
+                sizeof(struct csp_recursive_process) +
+                        strlen(recursive_process->name) + 1);
 }
 
 static const struct csp_process_iface csp_recursive_process_iface = {
         0, csp_recursive_process_name, csp_recursive_process_initials,
-        csp_recursive_process_afters, csp_recursive_process_free};
+        csp_recursive_process_afters, csp_recursive_process_references,
+        csp_recursive_process_free};
 
 static struct csp_process *
 csp_recursive_process_new(struct csp *csp, const char *name, size_t name_length,
@@ -81,12 +94,12 @@ csp_recursive_process_new(struct csp *csp, const char *name, size_t name_length,
     struct csp_recursive_process *recursive_process;
     char *name_copy;
     return_if_nonnull(csp_get_process(csp, id));
-    recursive_process = malloc(sizeof(struct csp_recursive_process));
-    assert(recursive_process != NULL);
+    /* Allocate the name along with the process itself. */
+    recursive_process = csp_alloc(
+            csp, sizeof(struct csp_recursive_process) + name_length + 1);
     recursive_process->process.id = id;
     recursive_process->process.iface = &csp_recursive_process_iface;
-    name_copy = malloc(name_length + 1);
-    assert(name_copy != NULL);
+    name_copy = (char *) (recursive_process + 1);
     memcpy(name_copy, name, name_length);
     name_copy[name_length] = '\0';
     recursive_process->name = name_copy;
@@ -163,17 +163,30 @@ csp_sequential_composition_afters(struct csp *csp, struct csp_process *process,
     }
 }
 
+static void
+csp_sequential_composition_references(struct csp *csp,
+                                      struct csp_process *process,
+                                      struct csp_process_visitor *visitor)
+{
+    struct csp_sequential_composition *seq =
+            container_of(process, struct csp_sequential_composition, process);
+    csp_process_visitor_call(csp, visitor, seq->p);
+    csp_process_visitor_call(csp, visitor, seq->q);
+}
+
 static void
 csp_sequential_composition_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_sequential_composition *seq =
             container_of(process, struct csp_sequential_composition, process);
-    free(seq);
+    csp_dealloc(csp, seq, sizeof(struct csp_sequential_composition));
 }
 
 static const struct csp_process_iface csp_sequential_composition_iface = {
         3, csp_sequential_composition_name, csp_sequential_composition_initials,
-        csp_sequential_composition_afters, csp_sequential_composition_free};
+        csp_sequential_composition_afters,
+        csp_sequential_composition_references,
+        csp_sequential_composition_free};
 
 static csp_id
 csp_sequential_composition_get_id(struct csp_process *p, struct csp_process *q)
@@ -192,8 +205,7 @@ csp_sequential_composition_new(struct csp *csp, struct csp_process *p,
     csp_id id = csp_sequential_composition_get_id(p, q);
     struct csp_sequential_composition *seq;
     return_if_nonnull(csp_get_process(csp, id));
-    seq = malloc(sizeof(struct csp_sequential_composition));
-    assert(seq != NULL);
+    seq = csp_alloc(csp, sizeof(struct csp_sequential_composition));
     seq->process.id = id;
     seq->process.iface = &csp_sequential_composition_iface;
     seq->p = p;
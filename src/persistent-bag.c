@@ -0,0 +1,352 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "persistent-bag.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "environment.h"
+#include "id-hash.h"
+#include "process.h"
+
+#define CSP_PERSISTENT_BAG_SEED UINT64_C(0x5fa8e4ba1c3d2b07) /* random */
+
+/* Nodes are immutable once they're shared, and reference-counted.  Every
+ * operation below that returns a node returns a new reference to it, and every
+ * node owns a reference to each of its children. */
+struct csp_persistent_bag_node {
+    size_t ref_count;
+    struct csp_process *process;
+    size_t count;
+    /* A hash of the process's ID.  This is also the node's treap priority. */
+    uint64_t element_hash;
+    struct csp_persistent_bag_node *left;
+    struct csp_persistent_bag_node *right;
+    /* The number of processes (including duplicates) in this subtree. */
+    size_t size;
+    /* The sum of count × element_hash over every node in this subtree. */
+    uint64_t hash;
+};
+
+static uint64_t
+csp_persistent_bag_element_hash(const struct csp_process *process)
+{
+    return csp_id_hash_word(process->id, CSP_PERSISTENT_BAG_SEED);
+}
+
+static struct csp_persistent_bag_node *
+csp_persistent_bag_node_retain(struct csp_persistent_bag_node *node)
+{
+    if (node != NULL) {
+        node->ref_count++;
+    }
+    return node;
+}
+
+static void
+csp_persistent_bag_node_release(struct csp *csp,
+                                struct csp_persistent_bag_node *node)
+{
+    if (node != NULL && --node->ref_count == 0) {
+        csp_persistent_bag_node_release(csp, node->left);
+        csp_persistent_bag_node_release(csp, node->right);
+        csp_dealloc(csp, node, sizeof(struct csp_persistent_bag_node));
+    }
+}
+
+static void
+csp_persistent_bag_node_update(struct csp_persistent_bag_node *node)
+{
+    node->size = node->count;
+    node->hash = node->count * node->element_hash;
+    if (node->left != NULL) {
+        node->size += node->left->size;
+        node->hash += node->left->hash;
+    }
+    if (node->right != NULL) {
+        node->size += node->right->size;
+        node->hash += node->right->hash;
+    }
+}
+
+/* Takes ownership of `left` and `right`. */
+static struct csp_persistent_bag_node *
+csp_persistent_bag_node_new(struct csp *csp, struct csp_process *process,
+                            size_t count, uint64_t element_hash,
+                            struct csp_persistent_bag_node *left,
+                            struct csp_persistent_bag_node *right)
+{
+    struct csp_persistent_bag_node *node =
+            csp_alloc(csp, sizeof(struct csp_persistent_bag_node));
+    node->ref_count = 1;
+    node->process = process;
+    node->count = count;
+    node->element_hash = element_hash;
+    node->left = left;
+    node->right = right;
+    csp_persistent_bag_node_update(node);
+    return node;
+}
+
+/* Creates a copy of `node` with different children.  Takes ownership of `left`
+ * and `right`. */
+static struct csp_persistent_bag_node *
+csp_persistent_bag_node_with_children(
+        struct csp *csp, const struct csp_persistent_bag_node *node,
+        struct csp_persistent_bag_node *left,
+        struct csp_persistent_bag_node *right)
+{
+    return csp_persistent_bag_node_new(csp, node->process, node->count,
+                                       node->element_hash, left, right);
+}
+
+/* Whether `a` belongs above `b` in the treap.  Ties are broken by index so that
+ * every bag has exactly one valid shape. */
+static bool
+csp_persistent_bag_node_above(const struct csp_persistent_bag_node *a,
+                              const struct csp_persistent_bag_node *b)
+{
+    if (a->element_hash != b->element_hash) {
+        return a->element_hash > b->element_hash;
+    }
+    return a->process->index < b->process->index;
+}
+
+/* Returns a new tree containing everything in `node` plus `process`.  The root
+ * of the result is always a freshly allocated node, which we're allowed to
+ * modify in place before anyone else sees it. */
+static struct csp_persistent_bag_node *
+csp_persistent_bag_node_add(struct csp *csp,
+                            const struct csp_persistent_bag_node *node,
+                            struct csp_process *process, uint64_t element_hash)
+{
+    struct csp_persistent_bag_node *child;
+    struct csp_persistent_bag_node *result;
+    if (node == NULL) {
+        return csp_persistent_bag_node_new(csp, process, 1, element_hash, NULL,
+                                           NULL);
+    }
+
+    if (process->index == node->process->index) {
+        return csp_persistent_bag_node_new(
+                csp, node->process, node->count + 1, node->element_hash,
+                csp_persistent_bag_node_retain(node->left),
+                csp_persistent_bag_node_retain(node->right));
+    }
+
+    if (process->index < node->process->index) {
+        child = csp_persistent_bag_node_add(csp, node->left, process,
+                                            element_hash);
+        if (csp_persistent_bag_node_above(child, node)) {
+            /* Rotate right: `child` becomes the root, and a copy of `node`
+             * becomes its right child. */
+            result = csp_persistent_bag_node_with_children(
+                    csp, node, child->right,
+                    csp_persistent_bag_node_retain(node->right));
+            child->right = result;
+            csp_persistent_bag_node_update(child);
+            return child;
+        }
+        return csp_persistent_bag_node_with_children(
+                csp, node, child, csp_persistent_bag_node_retain(node->right));
+    }
+
+    child = csp_persistent_bag_node_add(csp, node->right, process,
+                                            element_hash);
+    if (csp_persistent_bag_node_above(child, node)) {
+        /* Rotate left */
+        result = csp_persistent_bag_node_with_children(
+                csp, node, csp_persistent_bag_node_retain(node->left),
+                child->left);
+        child->left = result;
+        csp_persistent_bag_node_update(child);
+        return child;
+    }
+    return csp_persistent_bag_node_with_children(
+            csp, node, csp_persistent_bag_node_retain(node->left), child);
+}
+
+/* Joins two trees, where every process in `left` comes before every process in
+ * `right`. */
+static struct csp_persistent_bag_node *
+csp_persistent_bag_node_merge(struct csp *csp,
+                              const struct csp_persistent_bag_node *left,
+                              const struct csp_persistent_bag_node *right)
+{
+    if (left == NULL) {
+        return csp_persistent_bag_node_retain(
+                (struct csp_persistent_bag_node *) right);
+    }
+    if (right == NULL) {
+        return csp_persistent_bag_node_retain(
+                (struct csp_persistent_bag_node *) left);
+    }
+    if (csp_persistent_bag_node_above(left, right)) {
+        return csp_persistent_bag_node_with_children(
+                csp, left, csp_persistent_bag_node_retain(left->left),
+                csp_persistent_bag_node_merge(csp, left->right, right));
+    } else {
+        return csp_persistent_bag_node_with_children(
+                csp, right,
+                csp_persistent_bag_node_merge(csp, left, right->left),
+                csp_persistent_bag_node_retain(right->right));
+    }
+}
+
+static struct csp_persistent_bag_node *
+csp_persistent_bag_node_remove(struct csp *csp,
+                               const struct csp_persistent_bag_node *node,
+                               struct csp_process *process)
+{
+    assert(node != NULL);
+    if (process->index == node->process->index) {
+        if (node->count > 1) {
+            return csp_persistent_bag_node_new(
+                    csp, node->process, node->count - 1, node->element_hash,
+                    csp_persistent_bag_node_retain(node->left),
+                    csp_persistent_bag_node_retain(node->right));
+        }
+        return csp_persistent_bag_node_merge(csp, node->left, node->right);
+    }
+    if (process->index < node->process->index) {
+        return csp_persistent_bag_node_with_children(
+                csp, node,
+                csp_persistent_bag_node_remove(csp, node->left, process),
+                csp_persistent_bag_node_retain(node->right));
+    } else {
+        return csp_persistent_bag_node_with_children(
+                csp, node, csp_persistent_bag_node_retain(node->left),
+                csp_persistent_bag_node_remove(csp, node->right, process));
+    }
+}
+
+void
+csp_persistent_bag_init(struct csp_persistent_bag *bag)
+{
+    bag->root = NULL;
+}
+
+void
+csp_persistent_bag_done(struct csp *csp, struct csp_persistent_bag *bag)
+{
+    csp_persistent_bag_node_release(csp, bag->root);
+}
+
+void
+csp_persistent_bag_init_copy(struct csp_persistent_bag *bag,
+                             const struct csp_persistent_bag *other)
+{
+    bag->root = csp_persistent_bag_node_retain(other->root);
+}
+
+bool
+csp_persistent_bag_empty(const struct csp_persistent_bag *bag)
+{
+    return bag->root == NULL;
+}
+
+size_t
+csp_persistent_bag_size(const struct csp_persistent_bag *bag)
+{
+    return bag->root == NULL ? 0 : bag->root->size;
+}
+
+uint64_t
+csp_persistent_bag_hash(const struct csp_persistent_bag *bag)
+{
+    return bag->root == NULL ? 0 : bag->root->hash;
+}
+
+void
+csp_persistent_bag_add(struct csp *csp, struct csp_persistent_bag *bag,
+                       struct csp_process *process)
+{
+    struct csp_persistent_bag_node *root = csp_persistent_bag_node_add(
+            csp, bag->root, process, csp_persistent_bag_element_hash(process));
+    csp_persistent_bag_node_release(csp, bag->root);
+    bag->root = root;
+}
+
+void
+csp_persistent_bag_remove(struct csp *csp, struct csp_persistent_bag *bag,
+                          struct csp_process *process)
+{
+    struct csp_persistent_bag_node *root =
+            csp_persistent_bag_node_remove(csp, bag->root, process);
+    csp_persistent_bag_node_release(csp, bag->root);
+    bag->root = root;
+}
+
+void
+csp_persistent_bag_to_bag(const struct csp_persistent_bag *bag,
+                          struct csp_process_bag *dest)
+{
+    struct csp_persistent_bag_iterator iter;
+    csp_persistent_bag_foreach (bag, &iter) {
+        struct csp_process *process = csp_persistent_bag_iterator_get(&iter);
+        size_t count = csp_persistent_bag_iterator_get_count(&iter);
+        size_t i;
+        for (i = 0; i < count; i++) {
+            csp_process_bag_add(dest, process);
+        }
+    }
+}
+
+/* Iterators are key-based: since the tree can't change underneath us, we find
+ * each successor by walking down from the root, which takes O(log n) time
+ * without needing a stack. */
+
+void
+csp_persistent_bag_get_iterator(const struct csp_persistent_bag *bag,
+                                struct csp_persistent_bag_iterator *iter)
+{
+    const struct csp_persistent_bag_node *node = bag->root;
+    iter->root = bag->root;
+    while (node != NULL && node->left != NULL) {
+        node = node->left;
+    }
+    iter->current = node;
+}
+
+struct csp_process *
+csp_persistent_bag_iterator_get(const struct csp_persistent_bag_iterator *iter)
+{
+    return iter->current->process;
+}
+
+size_t
+csp_persistent_bag_iterator_get_count(
+        const struct csp_persistent_bag_iterator *iter)
+{
+    return iter->current->count;
+}
+
+bool
+csp_persistent_bag_iterator_done(struct csp_persistent_bag_iterator *iter)
+{
+    return iter->current == NULL;
+}
+
+void
+csp_persistent_bag_iterator_advance(struct csp_persistent_bag_iterator *iter)
+{
+    size_t index = iter->current->process->index;
+    const struct csp_persistent_bag_node *node = iter->root;
+    const struct csp_persistent_bag_node *successor = NULL;
+    while (node != NULL) {
+        if (node->process->index > index) {
+            successor = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    iter->current = successor;
+}
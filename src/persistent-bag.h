@@ -0,0 +1,108 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HST_PERSISTENT_BAG_H
+#define HST_PERSISTENT_BAG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "process.h"
+
+/* A bag of processes that can share structure with other bags.  Copying a
+ * persistent bag takes constant time, and adding or removing a process only
+ * allocates O(log n) new nodes; the rest of the bag's contents are shared with
+ * whatever bag it was copied from.  That makes them a good fit for operators
+ * like interleaving, where each transition only replaces a single subprocess.
+ *
+ * Internally, a persistent bag is a treap keyed by each process's `index`.  A
+ * node's priority is derived from its process's ID, so two bags with the same
+ * contents always have the same shape.  Each node also caches a hash of its
+ * subtree, so you can get a hash of the entire bag in constant time.
+ *
+ * Nodes are allocated with csp_alloc, so they're charged to the environment
+ * like any other part of a process.  That means that the functions that create
+ * or release nodes need the environment, and that you must free a bag before
+ * the session that was active when you created it ends.  (A process that owns
+ * a bag frees it from its `free` method, which always satisfies that.) */
+
+struct csp_persistent_bag_node;
+
+struct csp_persistent_bag {
+    struct csp_persistent_bag_node *root;
+};
+
+void
+csp_persistent_bag_init(struct csp_persistent_bag *bag);
+
+void
+csp_persistent_bag_done(struct csp *csp, struct csp_persistent_bag *bag);
+
+/* Initializes `bag` with the same contents as `other`, sharing all of its
+ * nodes. */
+void
+csp_persistent_bag_init_copy(struct csp_persistent_bag *bag,
+                             const struct csp_persistent_bag *other);
+
+bool
+csp_persistent_bag_empty(const struct csp_persistent_bag *bag);
+
+/* Returns the number of processes in the bag, counting duplicates. */
+size_t
+csp_persistent_bag_size(const struct csp_persistent_bag *bag);
+
+/* Returns a hash of the bag's contents.  The hash only depends on the IDs of
+ * the processes in the bag (and how many times each one appears). */
+uint64_t
+csp_persistent_bag_hash(const struct csp_persistent_bag *bag);
+
+/* Add a single process to a bag. */
+void
+csp_persistent_bag_add(struct csp *csp, struct csp_persistent_bag *bag,
+                       struct csp_process *process);
+
+/* Remove a single process from a bag.  `process` must be in the bag. */
+void
+csp_persistent_bag_remove(struct csp *csp, struct csp_persistent_bag *bag,
+                          struct csp_process *process);
+
+/* Add the contents of a persistent bag to an ordinary one. */
+void
+csp_persistent_bag_to_bag(const struct csp_persistent_bag *bag,
+                          struct csp_process_bag *dest);
+
+/* Iterates through the distinct processes in the bag, in order of their
+ * `index`. */
+struct csp_persistent_bag_iterator {
+    const struct csp_persistent_bag_node *root;
+    const struct csp_persistent_bag_node *current;
+};
+
+void
+csp_persistent_bag_get_iterator(const struct csp_persistent_bag *bag,
+                                struct csp_persistent_bag_iterator *iter);
+
+struct csp_process *
+csp_persistent_bag_iterator_get(const struct csp_persistent_bag_iterator *iter);
+
+size_t
+csp_persistent_bag_iterator_get_count(
+        const struct csp_persistent_bag_iterator *iter);
+
+bool
+csp_persistent_bag_iterator_done(struct csp_persistent_bag_iterator *iter);
+
+void
+csp_persistent_bag_iterator_advance(struct csp_persistent_bag_iterator *iter);
+
+#define csp_persistent_bag_foreach(bag, iter)            \
+    for (csp_persistent_bag_get_iterator((bag), (iter)); \
+         !csp_persistent_bag_iterator_done((iter));      \
+         csp_persistent_bag_iterator_advance((iter)))
+
+#endif /* HST_PERSISTENT_BAG_H */
@@ -14,6 +14,7 @@
 
 #include "ccan/container_of/container_of.h"
 #include "basics.h"
+#include "bitmap.h"
 #include "environment.h"
 #include "event.h"
 #include "macros.h"
@@ -171,6 +172,13 @@ csp_process_visit_afters(struct csp *csp, struct csp_process *process,
     process->iface->afters(csp, process, initial, visitor);
 }
 
+void
+csp_process_visit_references(struct csp *csp, struct csp_process *process,
+                             struct csp_process_visitor *visitor)
+{
+    process->iface->references(csp, process, visitor);
+}
+
 void
 csp_process_visit_transitions(struct csp *csp, struct csp_process *process,
                               struct csp_edge_visitor *visitor)
@@ -188,7 +196,9 @@ csp_process_visit_transitions(struct csp *csp, struct csp_process *process,
 }
 
 struct csp_process_bfs {
-    struct csp_process_set seen;
+    /* Indexed by each process's `index`, since we only need to check
+     * membership, and indices are small and dense. */
+    struct csp_bitmap seen;
     struct csp_process_set queue1;
     struct csp_process_set queue2;
     struct csp_process_set *current_queue;
@@ -201,7 +211,7 @@ static void
 csp_process_bfs_enqueue(struct csp *csp, struct csp_process_bfs *self,
                         struct csp_process* process)
 {
-    if (csp_process_set_add(&self->seen, process)) {
+    if (csp_bitmap_add(&self->seen, (uint32_t) process->index)) {
         csp_process_set_add(self->next_queue, process);
     }
 }
@@ -232,7 +242,7 @@ static void
 csp_process_bfs_init(struct csp_process_bfs *self,
                      struct csp_process_visitor *wrapped)
 {
-    csp_process_set_init(&self->seen);
+    csp_bitmap_init(&self->seen);
     csp_process_set_init(&self->queue1);
     csp_process_set_init(&self->queue2);
     self->current_queue = &self->queue1;
@@ -244,7 +254,7 @@ csp_process_bfs_init(struct csp_process_bfs *self,
 static void
 csp_process_bfs_done(struct csp_process_bfs *self)
 {
-    csp_process_set_done(&self->seen);
+    csp_bitmap_done(&self->seen);
     csp_process_set_done(&self->queue1);
     csp_process_set_done(&self->queue2);
 }
@@ -263,10 +273,11 @@ csp_process_bfs(struct csp *csp, struct csp_process *root,
         csp_process_set_foreach (self.current_queue, &iter) {
             struct csp_process *process = csp_process_set_iterator_get(&iter);
             if (unlikely(!csp_process_bfs_visit_process(csp, &self, process))) {
-                break;
+                goto done;
             }
         }
     }
+done:
     csp_process_bfs_done(&self);
 }
 
@@ -302,7 +313,7 @@ csp_process_set_free(struct csp_process_set *set)
     free(set);
 }
 
-static const struct csp_process_set EMPTY = {{NULL}};
+static const struct csp_process_set EMPTY = {{{NULL}}};
 
 const struct csp_process_set *
 csp_process_set_new_empty(void)
@@ -329,6 +340,13 @@ csp_process_set_eq(const struct csp_process_set *set1,
     return csp_set_eq(&set1->set, &set2->set);
 }
 
+bool
+csp_process_set_subseteq(const struct csp_process_set *set1,
+                         const struct csp_process_set *set2)
+{
+    return csp_set_subseteq(&set1->set, &set2->set);
+}
+
 void
 csp_process_set_clear(struct csp_process_set *set)
 {
@@ -367,6 +385,17 @@ csp_process_set_sort_by_index(const struct csp_process_set *set,
     *sorted_out = sorted;
 }
 
+void
+csp_process_set_visit(struct csp *csp, const struct csp_process_set *set,
+                      struct csp_process_visitor *visitor)
+{
+    struct csp_process_set_iterator iter;
+    csp_process_set_foreach (set, &iter) {
+        struct csp_process *process = csp_process_set_iterator_get(&iter);
+        csp_process_visitor_call(csp, visitor, process);
+    }
+}
+
 void
 csp_process_set_name(struct csp *csp, const struct csp_process_set *set,
                      struct csp_name_visitor *visitor)
@@ -8,6 +8,7 @@
 #ifndef HST_PROCESS_H
 #define HST_PROCESS_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -111,9 +112,22 @@ struct csp_process_iface {
                    const struct csp_event *initial,
                    struct csp_edge_visitor *visitor);
 
+    /* Call `visitor` for every other process that this process holds a
+     * pointer to (including any afters that it has memoized).  The garbage
+     * collector uses this to decide which processes are still reachable. */
+    void (*references)(struct csp *csp, struct csp_process *process,
+                       struct csp_process_visitor *visitor);
+
+    /* Release any resources that the process owns, and then give the node
+     * itself back to the environment with csp_dealloc. */
     void (*free)(struct csp *csp, struct csp_process *process);
 };
 
+/* Processes are numbered densely, in the order that they're registered with
+ * their environment.  We use those indices as keys in 32-bit csp_bitmaps, so an
+ * environment can't register more than CSP_PROCESS_INDEX_MAX + 1 processes. */
+#define CSP_PROCESS_INDEX_MAX UINT32_MAX
+
 struct csp_process {
     csp_id id;
     const struct csp_process_iface *iface;
@@ -148,6 +162,10 @@ void
 csp_process_visit_transitions(struct csp *csp, struct csp_process *process,
                               struct csp_edge_visitor *visitor);
 
+void
+csp_process_visit_references(struct csp *csp, struct csp_process *process,
+                             struct csp_process_visitor *visitor);
+
 #define CSP_PROCESS_BFS_CONTINUE 0
 #define CSP_PROCESS_BFS_ABORT 1
 #define CSP_PROCESS_BFS_PRUNE 2
@@ -193,6 +211,11 @@ bool
 csp_process_set_eq(const struct csp_process_set *set1,
                    const struct csp_process_set *set2);
 
+/* Return whether set1 ⊆ set2 */
+bool
+csp_process_set_subseteq(const struct csp_process_set *set1,
+                         const struct csp_process_set *set2);
+
 void
 csp_process_set_clear(struct csp_process_set *set);
 
@@ -203,6 +226,12 @@ void
 csp_process_set_sort_by_index(const struct csp_process_set *set, size_t *count,
                               struct csp_process ***processes);
 
+/* Calls `visitor` for each process in a set (in no particular order), ignoring
+ * its result. */
+void
+csp_process_set_visit(struct csp *csp, const struct csp_process_set *set,
+                      struct csp_process_visitor *visitor);
+
 /* Renders the name of each process in a set, in some braces to show that it's a
  * set. */
 void
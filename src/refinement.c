@@ -8,13 +8,18 @@
 #include "refinement.h"
 
 #include <assert.h>
+#include <stdlib.h>
 
 #include "ccan/compiler/compiler.h"
 #include "ccan/container_of/container_of.h"
+#include "antichain.h"
 #include "behavior.h"
+#include "bitmap.h"
 #include "event.h"
+#include "id-set.h"
 #include "macros.h"
 #include "normalization.h"
+#include "side-table.h"
 
 #if defined(REFINEMENT_DEBUG)
 #include <stdio.h>
@@ -168,17 +173,28 @@ csp_refinement_process_afters(struct csp *csp, struct csp_process *process,
     csp_process_visit_afters(csp, refinement->impl, initial, &add_spec.visitor);
 }
 
+static void
+csp_refinement_process_references(struct csp *csp, struct csp_process *process,
+                                  struct csp_process_visitor *visitor)
+{
+    struct csp_refinement_process *refinement =
+            container_of(process, struct csp_refinement_process, process);
+    csp_process_visitor_call(csp, visitor, refinement->spec);
+    csp_process_visitor_call(csp, visitor, refinement->impl);
+}
+
 static void
 csp_refinement_process_free(struct csp *csp, struct csp_process *process)
 {
     struct csp_refinement_process *refinement =
             container_of(process, struct csp_refinement_process, process);
-    free(refinement);
+    csp_dealloc(csp, refinement, sizeof(struct csp_refinement_process));
 }
 
 static const struct csp_process_iface csp_refinement_process_iface = {
         0, csp_refinement_process_name, csp_refinement_process_initials,
-        csp_refinement_process_afters, csp_refinement_process_free};
+        csp_refinement_process_afters, csp_refinement_process_references,
+        csp_refinement_process_free};
 
 static csp_id
 csp_refinement_process_get_id(struct csp_process *spec,
@@ -198,8 +214,7 @@ csp_refinement_process(struct csp *csp, struct csp_process *spec,
     csp_id id = csp_refinement_process_get_id(spec, impl);
     struct csp_refinement_process *refinement;
     return_if_nonnull(csp_get_process(csp, id));
-    refinement = malloc(sizeof(struct csp_refinement_process));
-    assert(refinement != NULL);
+    refinement = csp_alloc(csp, sizeof(struct csp_refinement_process));
     refinement->process.id = id;
     refinement->process.iface = &csp_refinement_process_iface;
     refinement->spec = spec;
@@ -219,10 +234,87 @@ csp_refinement_process_downcast(struct csp_process *process)
  * Refinement
  */
 
+/* The state of an in-progress refinement check. */
+struct csp_refinement_check {
+    struct csp_bitmap enqueued;
+    /* If we might collect garbage during the check, a pair that we've already
+     * visited might be freed and later recreated with a different index, so
+     * we have to remember which pairs we've enqueued by ID instead. */
+    bool collect_garbage;
+    struct csp_id_set enqueued_ids;
+    struct csp_process_set *pending;
+    /* If this is not NULL, we're using the antichain engine; maps the index
+     * of each Impl process to the antichain of Spec sets that we've visited it
+     * with. */
+    struct csp_side_table *antichains;
+    /* Whether to stop if we go over the environment's memory budget. */
+    bool enforce_budget;
+    struct csp_refinement_stats *stats;
+};
+
+static struct csp_antichain *
+csp_refinement_antichain_get(struct csp_side_table *antichains,
+                             struct csp_process *impl)
+{
+    struct csp_antichain **entry = csp_side_table_at(antichains, impl->index);
+    if (*entry == NULL) {
+        *entry = malloc(sizeof(struct csp_antichain));
+        assert(*entry != NULL);
+        csp_antichain_init(*entry);
+    }
+    return *entry;
+}
+
+static void
+csp_refinement_antichain_free(void *ud, void *entry)
+{
+    struct csp_antichain *antichain = *(struct csp_antichain **) entry;
+    if (antichain != NULL) {
+        csp_antichain_done(antichain);
+        free(antichain);
+    }
+}
+
+/* Returns whether we still need to visit `refinement`.  For the normalization
+ * engine, that's true as long as we haven't visited it before.  For the
+ * antichain engine, it's also false if we've visited the same Impl state with
+ * a subset of `refinement`'s Spec set. */
+static bool
+csp_refinement_check_enqueue(struct csp_refinement_check *check,
+                             struct csp_process *process)
+{
+    struct csp_refinement_process *refinement =
+            csp_refinement_process_downcast(process);
+    if (check->collect_garbage) {
+        if (!csp_id_set_add(&check->enqueued_ids, process->id)) {
+            return false;
+        }
+    } else if (!csp_bitmap_add(&check->enqueued, (uint32_t) process->index)) {
+        return false;
+    }
+    if (check->antichains != NULL) {
+        struct csp_antichain *antichain = csp_refinement_antichain_get(
+                check->antichains, refinement->impl);
+        const struct csp_process_set *spec_set =
+                csp_prenormalized_process_get_processes(refinement->spec);
+        if (!csp_antichain_add(antichain, spec_set)) {
+            DEBUG("      subsumed");
+            check->stats->subsumed_count++;
+            return false;
+        }
+    }
+    XDEBUG("      enqueue (");
+    XDEBUG_PROCESS(refinement->spec);
+    XDEBUG(",");
+    XDEBUG_PROCESS(refinement->impl);
+    DEBUG(")");
+    csp_process_set_add(check->pending, process);
+    return true;
+}
+
 struct csp_enqueue_next {
     struct csp_edge_visitor visitor;
-    struct csp_process_set *enqueued;
-    struct csp_process_set *pending;
+    struct csp_refinement_check *check;
     bool any_next;
 };
 
@@ -234,32 +326,20 @@ csp_enqueue_next_visit(struct csp *csp, struct csp_edge_visitor *visitor,
     struct csp_enqueue_next *self =
             container_of(visitor, struct csp_enqueue_next, visitor);
     self->any_next = true;
-    if (csp_process_set_add(self->enqueued, after)) {
-        UNNEEDED struct csp_refinement_process *refinement_after =
-                csp_refinement_process_downcast(after);
-        XDEBUG("      enqueue (");
-        XDEBUG_PROCESS(refinement_after->spec);
-        XDEBUG(",");
-        XDEBUG_PROCESS(refinement_after->impl);
-        DEBUG(")");
-        csp_process_set_add(self->pending, after);
-    }
+    csp_refinement_check_enqueue(self->check, after);
 }
 
 static struct csp_enqueue_next
-csp_enqueue_next(struct csp_process_set *enqueued,
-                 struct csp_process_set *pending)
+csp_enqueue_next(struct csp_refinement_check *check)
 {
-    struct csp_enqueue_next self = {
-            {csp_enqueue_next_visit}, enqueued, pending, false};
+    struct csp_enqueue_next self = {{csp_enqueue_next_visit}, check, false};
     return self;
 }
 
 struct csp_check_refinement_initials {
     struct csp_event_visitor visitor;
     struct csp_process *process;
-    struct csp_process_set *enqueued;
-    struct csp_process_set *pending;
+    struct csp_refinement_check *check;
     bool refinement_holds;
 };
 
@@ -270,8 +350,7 @@ csp_check_refinement_initials_visit(struct csp *csp,
 {
     struct csp_check_refinement_initials *self = container_of(
             visitor, struct csp_check_refinement_initials, visitor);
-    struct csp_enqueue_next enqueue =
-            csp_enqueue_next(self->enqueued, self->pending);
+    struct csp_enqueue_next enqueue = csp_enqueue_next(self->check);
     csp_process_visit_afters(csp, self->process, initial, &enqueue.visitor);
     if (!enqueue.any_next) {
         DEBUG("      NOPE");
@@ -281,23 +360,17 @@ csp_check_refinement_initials_visit(struct csp *csp,
 
 static struct csp_check_refinement_initials
 csp_check_refinement_initials(struct csp_process *process,
-                              struct csp_process_set *enqueued,
-                              struct csp_process_set *pending)
+                              struct csp_refinement_check *check)
 {
     struct csp_check_refinement_initials self = {
-            {csp_check_refinement_initials_visit},
-            process,
-            enqueued,
-            pending,
-            true};
+            {csp_check_refinement_initials_visit}, process, check, true};
     return self;
 }
 
 static bool
 csp_check_refinement_process(struct csp *csp,
                              struct csp_refinement_process *refinement,
-                             struct csp_process_set *enqueued,
-                             struct csp_process_set *pending)
+                             struct csp_refinement_check *check)
 {
     struct csp_behavior spec_behavior;
     struct csp_behavior impl_behavior;
@@ -312,9 +385,9 @@ csp_check_refinement_process(struct csp *csp,
     XDEBUG(" ⊑ ");
     DEBUG_PROCESS(refinement->impl);
     XDEBUG("    spec: ");
-    DEBUG_EVENT_SET(&spec_behavior.initials);
+    DEBUG_EVENT_SET(spec_behavior.initials);
     XDEBUG("    impl: ");
-    DEBUG_EVENT_SET(&impl_behavior.initials);
+    DEBUG_EVENT_SET(impl_behavior.initials);
     if (!csp_behavior_refines(&spec_behavior, &impl_behavior)) {
         /* TODO: Construct a counterexample */
         DEBUG("    NOPE");
@@ -325,82 +398,580 @@ csp_check_refinement_process(struct csp *csp,
     csp_behavior_done(&spec_behavior);
     csp_behavior_done(&impl_behavior);
 
-    check_initials = csp_check_refinement_initials(&refinement->process,
-                                                   enqueued, pending);
+    check_initials = csp_check_refinement_initials(&refinement->process, check);
     csp_process_visit_initials(csp, &refinement->process,
                                &check_initials.visitor);
     return check_initials.refinement_holds;
 }
 
-static bool
+static enum csp_refinement_result
 csp_check_refinement_process_set(struct csp *csp,
-                                 struct csp_process_set *enqueued,
-                                 struct csp_process_set *checking,
-                                 struct csp_process_set *pending)
+                                 struct csp_refinement_check *check,
+                                 struct csp_process_set *checking)
 {
+    size_t unchecked_count = csp_process_set_size(checking);
     struct csp_process_set_iterator iter;
     csp_process_set_foreach (checking, &iter) {
         struct csp_process *process = csp_process_set_iterator_get(&iter);
         struct csp_refinement_process *refinement =
                 csp_refinement_process_downcast(process);
-        if (!csp_check_refinement_process(csp, refinement, enqueued, pending)) {
-            return false;
+        if (check->enforce_budget && csp_memory_exhausted(csp)) {
+            DEBUG("--- out of memory");
+            check->stats->frontier_size =
+                    unchecked_count + csp_process_set_size(check->pending);
+            return CSP_REFINEMENT_EXHAUSTED;
+        }
+        check->stats->pair_count++;
+        unchecked_count--;
+        if (!csp_check_refinement_process(csp, refinement, check)) {
+            check->stats->frontier_size =
+                    unchecked_count + csp_process_set_size(check->pending);
+            return CSP_REFINEMENT_FAILS;
         }
     }
-    return true;
+    return CSP_REFINEMENT_HOLDS;
 }
 
-static bool
+static enum csp_refinement_result
 csp_perform_traces_refinement_check(struct csp *csp,
-                                    struct csp_process *refinement)
+                                    struct csp_process *refinement,
+                                    struct csp_side_table *antichains,
+                                    bool enforce_budget,
+                                    struct csp_refinement_stats *stats)
 {
-    struct csp_process_set enqueued;
+    struct csp_refinement_check check;
     struct csp_process_set set1;
     struct csp_process_set set2;
     struct csp_process_set *checking;
-    struct csp_process_set *pending;
-
-    csp_process_set_init(&enqueued);
+    enum csp_refinement_result result = CSP_REFINEMENT_HOLDS;
+
+    csp_bitmap_init(&check.enqueued);
+    /* The antichain engine remembers each Impl state (and the Spec states in
+     * each antichain) by its index, so a collection would leave it pointing at
+     * freed or reused indices.  We only collect garbage with the normalization
+     * engine; the antichain and HKC checks hold onto everything until their
+     * session ends, no matter what csp_set_gc_high_water_mark says. */
+    check.collect_garbage = antichains == NULL && csp_gc_enabled(csp);
+    csp_id_set_init(&check.enqueued_ids);
     csp_process_set_init(&set1);
     csp_process_set_init(&set2);
+    check.antichains = antichains;
+    check.enforce_budget = enforce_budget;
+    check.stats = stats;
     checking = &set1;
-    pending = &set2;
-    csp_process_set_add(pending, refinement);
+    check.pending = &set2;
+    csp_refinement_check_enqueue(&check, refinement);
     XDEBUG("=== check ");
     DEBUG_PROCESS(refinement);
 
-    while (!csp_process_set_empty(pending)) {
-        swap(checking, pending);
-        csp_process_set_clear(pending);
+    while (!csp_process_set_empty(check.pending)) {
+        swap(checking, check.pending);
+        csp_process_set_clear(check.pending);
         DEBUG("--- new round; checking %zu pairs",
               csp_process_set_size(checking));
-        if (!csp_check_refinement_process_set(csp, &enqueued, checking,
-                                              pending)) {
-            goto failure;
+        /* Once we've checked a round of pairs, we only need the ones in the
+         * next round (and anything they refer to). */
+        if (check.collect_garbage) {
+            csp_maybe_collect_garbage(csp, checking);
+        }
+        stats->depth++;
+        result = csp_check_refinement_process_set(csp, &check, checking);
+        if (result != CSP_REFINEMENT_HOLDS) {
+            break;
         }
     }
 
-    csp_process_set_done(&enqueued);
+    csp_bitmap_done(&check.enqueued);
+    csp_id_set_done(&check.enqueued_ids);
     csp_process_set_done(&set1);
     csp_process_set_done(&set2);
-    return true;
+    return result;
+}
 
-failure:
-    csp_process_set_done(&enqueued);
-    csp_process_set_done(&set1);
-    csp_process_set_done(&set2);
-    return false;
+/*------------------------------------------------------------------------------
+ * Bisimulation up to congruence
+ */
+
+/* Spec ⊑T Impl exactly when traces(Spec ∪ Impl) = traces(Spec), so we can
+ * check refinement by checking whether the prenormalized nodes for {Spec, Impl}
+ * and {Spec} are bisimilar.  Each pair is (spec ∪ impl, spec); since following
+ * an event preserves the fact that the left set contains the right, the only
+ * way for a pair to fail is for the left set to be able to perform an event
+ * that the right set can't.
+ *
+ * A pair can be skipped if it already follows from the pairs that we've
+ * visited: either because the two nodes are already known to be equivalent
+ * (tracked with a union-find structure), or because the right set can be
+ * rewritten into a superset of the left set by repeatedly replacing the right
+ * side of a visited pair with its left side (the congruence closure).
+ *
+ * Each visited pair is a rule that fires once our normal form contains its
+ * entire right set.  To find the rules that might fire without rescanning all
+ * of them, we index the visited pairs by the elements of their right sets, and
+ * count how many of each rule's elements are still missing from the normal
+ * form.  Adding a process to the normal form only touches the rules that it
+ * appears in, and each rule fires at most once per congruence check. */
+
+struct csp_hkc_pair {
+    struct csp_process *left;  /* prenormalized (Spec ∪ Impl) */
+    struct csp_process *right; /* prenormalized Spec */
+};
+
+struct csp_hkc_pairs {
+    struct csp_hkc_pair *pairs;
+    size_t count;
+    size_t allocated_count;
+};
+
+static void
+csp_hkc_pairs_init(struct csp_hkc_pairs *pairs)
+{
+    pairs->pairs = NULL;
+    pairs->count = 0;
+    pairs->allocated_count = 0;
+}
+
+static void
+csp_hkc_pairs_done(struct csp_hkc_pairs *pairs)
+{
+    free(pairs->pairs);
+}
+
+static void
+csp_hkc_pairs_add(struct csp_hkc_pairs *pairs, struct csp_process *left,
+                  struct csp_process *right)
+{
+    if (pairs->count == pairs->allocated_count) {
+        pairs->allocated_count =
+                pairs->allocated_count == 0 ? 16 : pairs->allocated_count * 2;
+        pairs->pairs = realloc(pairs->pairs, pairs->allocated_count *
+                                                     sizeof(struct csp_hkc_pair));
+        assert(pairs->pairs != NULL);
+    }
+    pairs->pairs[pairs->count].left = left;
+    pairs->pairs[pairs->count].right = right;
+    pairs->count++;
+}
+
+/* The visited pairs whose right sets contain a particular process, identified
+ * by their position in the relation. */
+struct csp_hkc_rules {
+    size_t *pairs;
+    size_t count;
+    size_t allocated_count;
+};
+
+static void
+csp_hkc_rules_free(void *ud, void *vrules)
+{
+    struct csp_hkc_rules *rules = vrules;
+    free(rules->pairs);
+}
+
+static void
+csp_hkc_rules_add(struct csp_hkc_rules *rules, size_t pair)
+{
+    if (rules->count == rules->allocated_count) {
+        rules->allocated_count =
+                rules->allocated_count == 0 ? 4 : rules->allocated_count * 2;
+        rules->pairs =
+                realloc(rules->pairs, rules->allocated_count * sizeof(size_t));
+        assert(rules->pairs != NULL);
+    }
+    rules->pairs[rules->count++] = pair;
+}
+
+struct csp_hkc {
+    /* The pairs that we've visited so far. */
+    struct csp_hkc_pairs relation;
+    /* Maps a process's index to its parent in the union-find structure.
+     * Processes without a parent are their own representative. */
+    struct csp_side_table parents;
+    /* Maps a process's index to the csp_hkc_rules for that process. */
+    struct csp_side_table rules;
+    /* Scratch space for csp_hkc_congruent: the number of elements of each
+     * visited pair's right set that aren't in the normal form yet, and the
+     * processes that we've added to the normal form but haven't followed up on
+     * yet. */
+    size_t *missing;
+    size_t missing_allocated_count;
+    struct csp_process **worklist;
+    size_t worklist_count;
+    size_t worklist_allocated_count;
+};
+
+static void
+csp_hkc_init(struct csp_hkc *hkc)
+{
+    csp_hkc_pairs_init(&hkc->relation);
+    csp_side_table_init(&hkc->parents, sizeof(struct csp_process *));
+    csp_side_table_init(&hkc->rules, sizeof(struct csp_hkc_rules));
+    hkc->missing = NULL;
+    hkc->missing_allocated_count = 0;
+    hkc->worklist = NULL;
+    hkc->worklist_count = 0;
+    hkc->worklist_allocated_count = 0;
+}
+
+static void
+csp_hkc_done(struct csp_hkc *hkc)
+{
+    csp_hkc_pairs_done(&hkc->relation);
+    csp_side_table_done(&hkc->parents, NULL, NULL);
+    csp_side_table_done(&hkc->rules, csp_hkc_rules_free, NULL);
+    free(hkc->missing);
+    free(hkc->worklist);
+}
+
+static struct csp_process *
+csp_hkc_find(struct csp_hkc *hkc, struct csp_process *process)
+{
+    struct csp_process *const *entry =
+            csp_side_table_get(&hkc->parents, process->index);
+    struct csp_process *parent = entry == NULL ? NULL : *entry;
+    struct csp_process *root;
+    if (parent == NULL) {
+        return process;
+    }
+    root = csp_hkc_find(hkc, parent);
+    if (root != parent) {
+        *(struct csp_process **) csp_side_table_at(&hkc->parents,
+                                                   process->index) = root;
+    }
+    return root;
+}
+
+static void
+csp_hkc_union(struct csp_hkc *hkc, struct csp_process *p1,
+              struct csp_process *p2)
+{
+    struct csp_process *root1 = csp_hkc_find(hkc, p1);
+    struct csp_process *root2 = csp_hkc_find(hkc, p2);
+    if (root1 != root2) {
+        *(struct csp_process **) csp_side_table_at(&hkc->parents,
+                                                   root1->index) = root2;
+    }
+}
+
+/* Records that we've visited `pair`. */
+static void
+csp_hkc_add_visited(struct csp_hkc *hkc, const struct csp_hkc_pair *pair)
+{
+    struct csp_process_set_iterator iter;
+    size_t index = hkc->relation.count;
+    csp_hkc_union(hkc, pair->left, pair->right);
+    csp_hkc_pairs_add(&hkc->relation, pair->left, pair->right);
+    csp_process_set_foreach (
+            csp_prenormalized_process_get_processes(pair->right), &iter) {
+        struct csp_process *process = csp_process_set_iterator_get(&iter);
+        csp_hkc_rules_add(csp_side_table_at(&hkc->rules, process->index),
+                          index);
+    }
+    if (hkc->missing_allocated_count < hkc->relation.count) {
+        hkc->missing_allocated_count = hkc->relation.allocated_count;
+        hkc->missing = realloc(hkc->missing,
+                               hkc->missing_allocated_count * sizeof(size_t));
+        assert(hkc->missing != NULL);
+    }
+}
+
+/* Adds each element of `set` to the normal form, queueing up the ones that are
+ * new. */
+static void
+csp_hkc_add_to_normal(struct csp_hkc *hkc, struct csp_process_set *normal,
+                      const struct csp_process_set *set)
+{
+    struct csp_process_set_iterator iter;
+    csp_process_set_foreach (set, &iter) {
+        struct csp_process *process = csp_process_set_iterator_get(&iter);
+        if (!csp_process_set_add(normal, process)) {
+            continue;
+        }
+        if (hkc->worklist_count == hkc->worklist_allocated_count) {
+            hkc->worklist_allocated_count =
+                    hkc->worklist_allocated_count == 0
+                            ? 16
+                            : hkc->worklist_allocated_count * 2;
+            hkc->worklist = realloc(hkc->worklist,
+                                    hkc->worklist_allocated_count *
+                                            sizeof(struct csp_process *));
+            assert(hkc->worklist != NULL);
+        }
+        hkc->worklist[hkc->worklist_count++] = process;
+    }
+}
+
+/* Returns whether `pair` is in the congruence closure of the visited pairs. */
+static bool
+csp_hkc_congruent(struct csp_hkc *hkc, const struct csp_hkc_pair *pair)
+{
+    struct csp_process_set normal;
+    bool result;
+    size_t i;
+    if (csp_hkc_find(hkc, pair->left) == csp_hkc_find(hkc, pair->right)) {
+        return true;
+    }
+    /* Every visited pair has a left set that contains its right set, so the
+     * only useful rewrite is to add a pair's left set to our normal form
+     * whenever it contains that pair's right set. */
+    for (i = 0; i < hkc->relation.count; i++) {
+        hkc->missing[i] = csp_process_set_size(
+                csp_prenormalized_process_get_processes(
+                        hkc->relation.pairs[i].right));
+    }
+    csp_process_set_init(&normal);
+    hkc->worklist_count = 0;
+    csp_hkc_add_to_normal(hkc, &normal,
+                          csp_prenormalized_process_get_processes(pair->right));
+    while (hkc->worklist_count > 0) {
+        struct csp_process *process = hkc->worklist[--hkc->worklist_count];
+        const struct csp_hkc_rules *rules =
+                csp_side_table_get(&hkc->rules, process->index);
+        if (rules == NULL) {
+            continue;
+        }
+        for (i = 0; i < rules->count; i++) {
+            size_t index = rules->pairs[i];
+            if (--hkc->missing[index] == 0) {
+                csp_hkc_add_to_normal(
+                        hkc, &normal,
+                        csp_prenormalized_process_get_processes(
+                                hkc->relation.pairs[index].left));
+            }
+        }
+    }
+    result = csp_process_set_subseteq(
+            csp_prenormalized_process_get_processes(pair->left), &normal);
+    csp_process_set_done(&normal);
+    return result;
+}
+
+static enum csp_refinement_result
+csp_perform_hkc_traces_refinement_check(struct csp *csp,
+                                        struct csp_process *spec,
+                                        struct csp_process *impl,
+                                        bool enforce_budget,
+                                        struct csp_refinement_stats *stats)
+{
+    struct csp_hkc hkc;
+    struct csp_hkc_pairs pending;
+    struct csp_process_set initial;
+    struct csp_process *empty;
+    struct csp_process *left;
+    struct csp_process *right;
+    size_t next = 0;
+    /* The index in `pending` where the current breadth-first level ends. */
+    size_t level_end = 0;
+    enum csp_refinement_result result = CSP_REFINEMENT_HOLDS;
+
+    csp_process_set_init(&initial);
+    empty = csp_prenormalized_process_new(csp, &initial);
+    csp_process_set_add(&initial, spec);
+    csp_process_set_add(&initial, impl);
+    csp_find_process_closure(csp, csp->tau, &initial);
+    left = csp_prenormalized_process_new(csp, &initial);
+    right = csp_prenormalize_process(csp, spec);
+    csp_process_set_done(&initial);
+
+    csp_hkc_init(&hkc);
+    csp_hkc_pairs_init(&pending);
+    csp_hkc_pairs_add(&pending, left, right);
+    while (next < pending.count) {
+        struct csp_hkc_pair pair;
+        struct csp_event_set initials;
+        struct csp_collect_events collect;
+        struct csp_event_set_iterator iter;
+        if (next == level_end) {
+            stats->depth++;
+            level_end = pending.count;
+        }
+        if (enforce_budget && csp_memory_exhausted(csp)) {
+            DEBUG("--- out of memory");
+            result = CSP_REFINEMENT_EXHAUSTED;
+            break;
+        }
+        /* Copy the pair, since adding new pending pairs might move it. */
+        pair = pending.pairs[next++];
+        if (csp_hkc_congruent(&hkc, &pair)) {
+            stats->subsumed_count++;
+            continue;
+        }
+        stats->pair_count++;
+        XDEBUG("  check ");
+        XDEBUG_PROCESS(pair.right);
+        XDEBUG(" ~ ");
+        DEBUG_PROCESS(pair.left);
+        if (csp_process_set_empty(
+                    csp_prenormalized_process_get_processes(pair.right))) {
+            /* We only follow events that the left side can perform, so the
+             * left side is never empty. */
+            DEBUG("    NOPE");
+            result = CSP_REFINEMENT_FAILS;
+            break;
+        }
+        csp_hkc_add_visited(&hkc, &pair);
+        csp_event_set_init(&initials);
+        collect = csp_collect_events(&initials);
+        csp_process_visit_initials(csp, pair.left, &collect.visitor);
+        csp_event_set_foreach (&initials, &iter) {
+            const struct csp_event *initial = csp_event_set_iterator_get(&iter);
+            struct csp_process *left_after =
+                    csp_process_get_single_after(csp, pair.left, initial);
+            struct csp_process *right_after =
+                    csp_process_get_single_after(csp, pair.right, initial);
+            if (right_after == NULL) {
+                right_after = empty;
+            }
+            csp_hkc_pairs_add(&pending, left_after, right_after);
+        }
+        csp_event_set_done(&initials);
+    }
+
+    stats->frontier_size = pending.count - next;
+    csp_hkc_pairs_done(&pending);
+    csp_hkc_done(&hkc);
+    return result;
+}
+
+/* CSP_SPEC_AUTO won't bisimulate a Spec with more prenormalized nodes than
+ * this; it will check against the prenormalized nodes lazily instead. */
+#define CSP_SPEC_AUTO_MAX_NORMALIZED_NODES 4096
+
+/* CSP_SPEC_AUTO won't bisimulate a Spec where fewer than 1 in this many
+ * prenormalized nodes is nondeterministic. */
+#define CSP_SPEC_AUTO_MIN_NONDETERMINISM_RATIO 16
+
+struct csp_refinement_options
+csp_refinement_options(void)
+{
+    struct csp_refinement_options options = {CSP_REFINEMENT_NORMALIZATION,
+                                             CSP_SPEC_AUTO};
+    return options;
+}
+
+static enum csp_spec_preparation
+csp_choose_spec_preparation(struct csp *csp, struct csp_process *prenormalized)
+{
+    struct csp_prenormalized_survey survey;
+    csp_survey_prenormalized_process(csp, prenormalized,
+                                     CSP_SPEC_AUTO_MAX_NORMALIZED_NODES,
+                                     &survey);
+    DEBUG("=== spec survey: %zu nodes, %zu nondeterministic%s",
+          survey.node_count, survey.nondeterministic_count,
+          survey.truncated ? " (truncated)" : "");
+    if (survey.truncated) {
+        return CSP_SPEC_PRENORMALIZE;
+    } else if (survey.nondeterministic_count == 0) {
+        return CSP_SPEC_DIRECT;
+    } else if (survey.nondeterministic_count *
+                       CSP_SPEC_AUTO_MIN_NONDETERMINISM_RATIO <
+               survey.node_count) {
+        return CSP_SPEC_PRENORMALIZE;
+    } else {
+        return CSP_SPEC_NORMALIZE;
+    }
+}
+
+static struct csp_process *
+csp_prepare_spec(struct csp *csp, struct csp_process *spec,
+                 enum csp_spec_preparation *spec_preparation)
+{
+    struct csp_process *prenormalized;
+    if (*spec_preparation == CSP_SPEC_DIRECT) {
+        return spec;
+    }
+    prenormalized = csp_prenormalize_process(csp, spec);
+    if (*spec_preparation == CSP_SPEC_AUTO) {
+        *spec_preparation = csp_choose_spec_preparation(csp, prenormalized);
+    }
+    switch (*spec_preparation) {
+        case CSP_SPEC_NORMALIZE:
+            return csp_normalize_process(csp, prenormalized);
+        case CSP_SPEC_PRENORMALIZE:
+            /* Prenormalized nodes are created lazily as the check asks for
+             * their afters, so there's nothing more to do up front. */
+            return prenormalized;
+        case CSP_SPEC_DIRECT:
+            return spec;
+        default:
+            abort();
+    }
 }
 
 bool
 csp_check_traces_refinement(struct csp *csp, struct csp_process *spec,
                             struct csp_process *impl)
 {
-    struct csp_process *prenormalized;
-    struct csp_process *normalized;
+    struct csp_refinement_options options = csp_refinement_options();
+    return csp_check_traces_refinement_with(csp, spec, impl, &options, NULL);
+}
+
+static enum csp_refinement_result
+csp_run_traces_refinement(struct csp *csp, struct csp_process *spec,
+                          struct csp_process *impl,
+                          const struct csp_refinement_options *options,
+                          bool enforce_budget,
+                          struct csp_refinement_stats *stats)
+{
+    struct csp_refinement_stats local_stats;
+    struct csp_process *prepared;
     struct csp_process *refinement;
-    prenormalized = csp_prenormalize_process(csp, spec);
-    normalized = csp_normalize_process(csp, prenormalized);
-    refinement = csp_refinement_process(csp, normalized, impl);
-    return csp_perform_traces_refinement_check(csp, refinement);
+    enum csp_refinement_result result;
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    stats->engine = options->engine;
+    stats->spec_preparation = options->spec_preparation;
+    stats->pair_count = 0;
+    stats->subsumed_count = 0;
+    stats->depth = 0;
+    stats->frontier_size = 0;
+    if (options->engine == CSP_REFINEMENT_ANTICHAINS) {
+        struct csp_side_table antichains;
+        /* The antichain engine needs to see the τ-closed set of Spec states
+         * that each pair represents. */
+        stats->spec_preparation = CSP_SPEC_PRENORMALIZE;
+        prepared = csp_prenormalize_process(csp, spec);
+        refinement = csp_refinement_process(csp, prepared, impl);
+        csp_side_table_init(&antichains, sizeof(struct csp_antichain *));
+        result = csp_perform_traces_refinement_check(
+                csp, refinement, &antichains, enforce_budget, stats);
+        csp_side_table_done(&antichains, csp_refinement_antichain_free, NULL);
+        return result;
+    }
+    if (options->engine == CSP_REFINEMENT_HKC) {
+        stats->spec_preparation = CSP_SPEC_PRENORMALIZE;
+        return csp_perform_hkc_traces_refinement_check(csp, spec, impl,
+                                                       enforce_budget, stats);
+    }
+    /* The caller still needs Spec and Impl after the check, even if we collect
+     * garbage while performing it. */
+    csp_pin_process(csp, spec);
+    csp_pin_process(csp, impl);
+    prepared = csp_prepare_spec(csp, spec, &stats->spec_preparation);
+    refinement = csp_refinement_process(csp, prepared, impl);
+    result = csp_perform_traces_refinement_check(csp, refinement, NULL,
+                                                 enforce_budget, stats);
+    csp_unpin_process(csp, spec);
+    csp_unpin_process(csp, impl);
+    return result;
+}
+
+bool
+csp_check_traces_refinement_with(struct csp *csp, struct csp_process *spec,
+                                 struct csp_process *impl,
+                                 const struct csp_refinement_options *options,
+                                 struct csp_refinement_stats *stats)
+{
+    return csp_run_traces_refinement(csp, spec, impl, options, false, stats) ==
+           CSP_REFINEMENT_HOLDS;
+}
+
+enum csp_refinement_result
+csp_try_traces_refinement(struct csp *csp, struct csp_process *spec,
+                          struct csp_process *impl,
+                          const struct csp_refinement_options *options,
+                          struct csp_refinement_stats *stats)
+{
+    return csp_run_traces_refinement(csp, spec, impl, options, true, stats);
 }
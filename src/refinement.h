@@ -9,6 +9,7 @@
 #define HST_REFINEMENT_H
 
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include "environment.h"
 #include "process.h"
@@ -18,7 +19,9 @@
  */
 
 /* Creates a process that contains a (Spec, Impl) pair that needs to be visited
- * during a refinement check.  `spec` should be a normalized process. */
+ * during a refinement check.  `spec` should be a normalized or prenormalized
+ * process — i.e., it must have at most one `after` for each event, and no τ
+ * transitions. */
 struct csp_process *
 csp_refinement_process(struct csp *csp, struct csp_process *spec,
                        struct csp_process *impl);
@@ -27,9 +30,124 @@ csp_refinement_process(struct csp *csp, struct csp_process *spec,
  * Refinement
  */
 
-/* Return whether Spec ⊑T Impl.  We will normalize Spec for you. */
+/* How Spec is turned into a process that can be used as the Spec side of a
+ * refinement check. */
+enum csp_spec_preparation {
+    /* Prenormalize Spec, and then bisimulate every reachable prenormalized node
+     * to produce a fully normalized process.  This gives the smallest possible
+     * Spec, but the entire prenormalized graph has to be built up front. */
+    CSP_SPEC_NORMALIZE,
+
+    /* Prenormalize Spec, and check Impl directly against the prenormalized
+     * nodes, creating each one on demand the first time that the check reaches
+     * it.  Bisimulation is skipped entirely.  The check is still correct, but
+     * it might visit more pairs, since equivalent Spec nodes aren't merged. */
+    CSP_SPEC_PRENORMALIZE,
+
+    /* Use Spec as-is.  This is only correct if Spec is already deterministic:
+     * no reachable subprocess can perform a τ, or has more than one distinct
+     * `after` for any event. */
+    CSP_SPEC_DIRECT,
+
+    /* Survey the prenormalized graph of Spec (up to a size limit), and choose
+     * one of the other preparations based on what we find: use Spec directly
+     * if it turns out to be deterministic; prenormalize only if it's large or
+     * if only a small fraction of its nodes are nondeterministic (since then
+     * bisimulation has little to merge); and fully normalize otherwise. */
+    CSP_SPEC_AUTO
+};
+
+/* How the (Spec, Impl) pairs of a refinement check are explored. */
+enum csp_refinement_engine {
+    /* Prepare Spec as described by the `spec_preparation` option, and visit
+     * every reachable (Spec, Impl) pair. */
+    CSP_REFINEMENT_NORMALIZATION,
+
+    /* Pair each Impl state with a τ-closed set of Spec states (which are
+     * prenormalized lazily, regardless of the `spec_preparation` option), and
+     * skip any pair whose Spec set is a superset of one that we've already
+     * visited for the same Impl state.  A larger Spec set allows every trace
+     * that a smaller one does, so the skipped pair can never find a violation
+     * that the visited one wouldn't.  This avoids building most of the subset
+     * construction for Specs with a lot of nondeterminism.  The antichains
+     * refer to processes by index, so this engine never collects garbage (see
+     * csp_set_gc_high_water_mark). */
+    CSP_REFINEMENT_ANTICHAINS,
+
+    /* Check that the (prenormalized) set of Spec and Impl states is traces
+     * equivalent to the set of Spec states alone, using bisimulation up to
+     * congruence.  Pairs of Spec sets are related in a union-find structure,
+     * and any pair that already follows from the pairs visited so far (by
+     * taking unions of related sets) is skipped.  This ignores the
+     * `spec_preparation` option, too, and like the antichain engine, it never
+     * collects garbage. */
+    CSP_REFINEMENT_HKC
+};
+
+struct csp_refinement_options {
+    enum csp_refinement_engine engine;
+    enum csp_spec_preparation spec_preparation;
+};
+
+/* Returns the options that csp_check_traces_refinement uses. */
+struct csp_refinement_options
+csp_refinement_options(void);
+
+struct csp_refinement_stats {
+    /* The engine that performed the check. */
+    enum csp_refinement_engine engine;
+    /* How Spec was actually prepared for the check.  This is never
+     * CSP_SPEC_AUTO; it's whichever preparation the cost model chose.  (The
+     * antichain and HKC engines always use CSP_SPEC_PRENORMALIZE.) */
+    enum csp_spec_preparation spec_preparation;
+    /* The number of (Spec, Impl) pairs that were checked. */
+    size_t pair_count;
+    /* The number of pairs that the antichain or HKC engine skipped because
+     * they were subsumed by (or followed from) pairs that it had already
+     * visited. */
+    size_t subsumed_count;
+    /* The number of breadth-first levels of pairs that the check reached. */
+    size_t depth;
+    /* The number of pairs that were waiting to be checked when the check
+     * stopped.  This is only nonzero if the check found a violation or ran out
+     * of memory before it finished. */
+    size_t frontier_size;
+};
+
+enum csp_refinement_result {
+    CSP_REFINEMENT_FAILS,
+    CSP_REFINEMENT_HOLDS,
+    /* The environment went over its memory budget before the check could
+     * finish.  The stats describe how far the check got. */
+    CSP_REFINEMENT_EXHAUSTED
+};
+
+/* Return whether Spec ⊑T Impl.  We will normalize Spec for you, if needed.
+ * This ignores the environment's memory budget; use csp_try_traces_refinement
+ * if you've set one. */
 bool
 csp_check_traces_refinement(struct csp *csp, struct csp_process *spec,
                             struct csp_process *impl);
 
+/* Return whether Spec ⊑T Impl, preparing Spec as described by `options`.  If
+ * `stats` is not NULL, we'll fill it in with some details about the check. */
+bool
+csp_check_traces_refinement_with(struct csp *csp, struct csp_process *spec,
+                                 struct csp_process *impl,
+                                 const struct csp_refinement_options *options,
+                                 struct csp_refinement_stats *stats);
+
+/* Check whether Spec ⊑T Impl, just like csp_check_traces_refinement_with, but
+ * stop early if the environment goes over its memory budget (see
+ * csp_set_memory_budget).  The budget is checked before each pair is visited;
+ * the check won't notice if Spec's preparation goes over budget until it
+ * visits the first pair.  Any processes that the check created are still
+ * registered, so you'll typically want to run this inside of a session, and
+ * end the session to get the memory back before trying again. */
+enum csp_refinement_result
+csp_try_traces_refinement(struct csp *csp, struct csp_process *spec,
+                          struct csp_process *impl,
+                          const struct csp_refinement_options *options,
+                          struct csp_refinement_stats *stats);
+
 #endif /* HST_REFINEMENT_H */
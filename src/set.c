@@ -7,28 +7,45 @@
 
 #include "set.h"
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define JUDYERROR_NOTEST 1
 #include <Judy.h>
 
 #include "ccan/compiler/compiler.h"
-#include "ccan/hash/hash.h"
+#include "id-hash.h"
 
 /* Hashing sets: We use Zobrist hashes to calculate a hash for each set.  A
  * Zobrist hash relies on each possible element having a distinct (and uniformly
  * distributed) hash value.  You then simply XOR together the hashes of each
  * element (possibly along with some initial base value) to get the hash of the
- * set. */
+ * set.  Since XOR is its own inverse, we can maintain the hash incrementally as
+ * elements are added and removed. */
 
 #define CSP_SET_INITIAL_HASH UINT64_C(0xec87ea715d6826f5) /* random */
+#define CSP_SET_ELEMENT_SEED UINT64_C(0x4b1b5c4d3e8f6a27) /* random */
+
+static uint64_t
+csp_set_element_hash(void *element)
+{
+    return csp_id_hash_word((uintptr_t) element, CSP_SET_ELEMENT_SEED);
+}
 
 void
 csp_set_init(struct csp_set *set)
 {
-    set->elements = NULL;
+    set->size = 0;
+    set->hash = 0;
+}
+
+static bool
+csp_set_is_inline(const struct csp_set *set)
+{
+    return set->size <= CSP_SET_INLINE_COUNT;
 }
 
 void
@@ -42,7 +59,11 @@ csp_set_done(struct csp_set *set, csp_set_free_entry_f *free_entry, void *ud)
             free_entry(ud, entry);
         }
     }
-    J1FA(dummy, set->elements);
+    if (!csp_set_is_inline(set)) {
+        J1FA(dummy, set->elements.judy);
+    }
+    set->size = 0;
+    set->hash = 0;
 }
 
 void
@@ -55,28 +76,20 @@ csp_set_clear(struct csp_set *set, csp_set_free_entry_f *free_entry, void *ud)
 uint64_t
 csp_set_hash(const struct csp_set *set, uint64_t base)
 {
-    struct csp_set_iterator iter;
-    uint64_t hash = CSP_SET_INITIAL_HASH;
-    csp_set_foreach (set, &iter) {
-        void *element = csp_set_iterator_get(&iter);
-        uint64_t element_hash = hash64_any(&element, sizeof(element), base);
-        hash ^= element_hash;
-    }
-    return hash;
+    uint64_t hash = set->hash ^ CSP_SET_INITIAL_HASH;
+    return csp_id_hash_word(hash, base);
 }
 
 bool
 csp_set_empty(const struct csp_set *set)
 {
-    return set->elements == NULL;
+    return set->size == 0;
 }
 
 size_t
 csp_set_size(const struct csp_set *set)
 {
-    Word_t count;
-    J1C(count, set->elements, 0, -1);
-    return count;
+    return set->size;
 }
 
 bool
@@ -84,6 +97,15 @@ csp_set_eq(const struct csp_set *set1, const struct csp_set *set2)
 {
     struct csp_set_iterator iter1;
     struct csp_set_iterator iter2;
+    if (set1->size != set2->size || set1->hash != set2->hash) {
+        return false;
+    }
+    /* Sets with the same size always use the same representation. */
+    if (csp_set_is_inline(set1)) {
+        return memcmp(set1->elements.inline_elements,
+                      set2->elements.inline_elements,
+                      set1->size * sizeof(void *)) == 0;
+    }
     /* Loop through the elements in `set1`, verifying that each one is also
      * in `set2`. */
     for (csp_set_get_iterator(set1, &iter1), csp_set_get_iterator(set2, &iter2);
@@ -96,11 +118,37 @@ csp_set_eq(const struct csp_set *set1, const struct csp_set *set2)
     return csp_set_iterator_done(&iter1) == csp_set_iterator_done(&iter2);
 }
 
+static bool
+csp_set_inline_subseteq(const struct csp_set *set1, const struct csp_set *set2)
+{
+    size_t i1;
+    size_t i2 = 0;
+    for (i1 = 0; i1 < set1->size; i1++) {
+        uintptr_t element = (uintptr_t) set1->elements.inline_elements[i1];
+        while (i2 < set2->size &&
+               element > (uintptr_t) set2->elements.inline_elements[i2]) {
+            i2++;
+        }
+        if (i2 == set2->size ||
+            element < (uintptr_t) set2->elements.inline_elements[i2]) {
+            return false;
+        }
+        i2++;
+    }
+    return true;
+}
+
 bool
 csp_set_subseteq(const struct csp_set *set1, const struct csp_set *set2)
 {
     struct csp_set_iterator iter1;
     struct csp_set_iterator iter2;
+    if (set1->size > set2->size) {
+        return false;
+    }
+    if (csp_set_is_inline(set1) && csp_set_is_inline(set2)) {
+        return csp_set_inline_subseteq(set1, set2);
+    }
     /* Loop through the elements in `set1`, verifying that each one is also in
      * `set2`. */
     for (csp_set_get_iterator(set1, &iter1), csp_set_get_iterator(set2, &iter2);
@@ -118,24 +166,231 @@ csp_set_subseteq(const struct csp_set *set1, const struct csp_set *set2)
     return true;
 }
 
+/* Returns the position of the first inline element that is >= `element`. */
+static size_t
+csp_set_inline_find(const struct csp_set *set, uintptr_t element)
+{
+    size_t i;
+    for (i = 0; i < set->size; i++) {
+        if ((uintptr_t) set->elements.inline_elements[i] >= element) {
+            break;
+        }
+    }
+    return i;
+}
+
+/* Moves the inline elements of `set` into a new Judy array.  The set must be
+ * full, and the caller must add a new element right away, since until then
+ * the set's size says that it's still inline. */
+static void
+csp_set_promote(struct csp_set *set)
+{
+    UNNEEDED int rc;
+    void *elements[CSP_SET_INLINE_COUNT];
+    size_t i;
+    memcpy(elements, set->elements.inline_elements, sizeof(elements));
+    set->elements.judy = NULL;
+    for (i = 0; i < CSP_SET_INLINE_COUNT; i++) {
+        J1S(rc, set->elements.judy, (uintptr_t) elements[i]);
+    }
+}
+
+/* Moves the elements of `set`'s Judy array back inline, once it has shrunk
+ * down to CSP_SET_INLINE_COUNT elements. */
+static void
+csp_set_demote(struct csp_set *set)
+{
+    UNNEEDED Word_t dummy;
+    void *elements[CSP_SET_INLINE_COUNT];
+    Word_t key = 0;
+    size_t count = 0;
+    int found;
+    J1F(found, set->elements.judy, key);
+    while (found) {
+        assert(count < CSP_SET_INLINE_COUNT);
+        elements[count++] = (void *) key;
+        J1N(found, set->elements.judy, key);
+    }
+    J1FA(dummy, set->elements.judy);
+    memcpy(set->elements.inline_elements, elements, count * sizeof(void *));
+}
+
+static void
+csp_set_added(struct csp_set *set, void *element)
+{
+    set->size++;
+    set->hash ^= csp_set_element_hash(element);
+}
+
+static void
+csp_set_removed(struct csp_set *set, void *element)
+{
+    set->size--;
+    set->hash ^= csp_set_element_hash(element);
+}
+
 bool
 csp_set_add(struct csp_set *set, void *element)
 {
     int rc;
-    J1S(rc, set->elements, (uintptr_t) element);
+    if (csp_set_is_inline(set)) {
+        size_t i = csp_set_inline_find(set, (uintptr_t) element);
+        void **inline_elements = set->elements.inline_elements;
+        if (i < set->size && inline_elements[i] == element) {
+            return false;
+        }
+        if (set->size < CSP_SET_INLINE_COUNT) {
+            memmove(&inline_elements[i + 1], &inline_elements[i],
+                    (set->size - i) * sizeof(void *));
+            inline_elements[i] = element;
+            csp_set_added(set, element);
+            return true;
+        }
+        csp_set_promote(set);
+    }
+    J1S(rc, set->elements.judy, (uintptr_t) element);
+    if (rc) {
+        csp_set_added(set, element);
+    }
     return rc;
 }
 
+/* Bulk insertion: Judy1SetArray can build a Judy array from a sorted list of
+ * keys much faster than inserting them one at a time, but it only works on an
+ * empty array.  So when the set is empty, or is much smaller than the batch
+ * that we're adding to it, we merge the batch with the existing contents and
+ * rebuild the array from scratch.  Otherwise, rebuilding would mean copying
+ * the whole set to add a few elements, so we insert the batch's elements
+ * individually (in sorted order, which is kinder to the cache).
+ *
+ * Judy1SetArray builds arrays with fewer than 32 elements (on 64-bit platforms)
+ * differently, and that code path reads past the end of one of Judy's size
+ * tables when there are exactly 31 keys.  Small arrays don't benefit from bulk
+ * loading anyway, so we build those one key at a time, too. */
+
+#define CSP_SET_BULK_MIN 16
+#define CSP_SET_REBUILD_RATIO 8
+#define CSP_SET_SET_ARRAY_MIN 64
+
+static int
+csp_set_compare_keys(const void *vk1, const void *vk2)
+{
+    Word_t k1 = *(const Word_t *) vk1;
+    Word_t k2 = *(const Word_t *) vk2;
+    return (k1 > k2) - (k1 < k2);
+}
+
+/* Replaces the contents of `set` with `count` sorted, distinct keys.  Doesn't
+ * touch the set's hash. */
+static void
+csp_set_rebuild(struct csp_set *set, size_t count, const Word_t *keys)
+{
+    UNNEEDED Word_t dummy;
+    UNNEEDED int rc;
+    if (!csp_set_is_inline(set)) {
+        J1FA(dummy, set->elements.judy);
+    }
+    set->size = count;
+    if (csp_set_is_inline(set)) {
+        size_t i;
+        for (i = 0; i < count; i++) {
+            set->elements.inline_elements[i] = (void *) keys[i];
+        }
+    } else if (count < CSP_SET_SET_ARRAY_MIN) {
+        size_t i;
+        set->elements.judy = NULL;
+        for (i = 0; i < count; i++) {
+            J1S(rc, set->elements.judy, keys[i]);
+        }
+    } else {
+        set->elements.judy = NULL;
+        J1SA(rc, set->elements.judy, count, keys);
+        assert(rc == 1);
+    }
+}
+
+/* Adds `count` sorted, distinct keys to `set`. */
+static bool
+csp_set_add_sorted(struct csp_set *set, size_t count, const Word_t *keys)
+{
+    struct csp_set_iterator iter;
+    Word_t *merged;
+    uint64_t new_hash = 0;
+    size_t i = 0;
+    size_t merged_count = 0;
+
+    if (count == 0) {
+        return false;
+    }
+    if (set->size > 0 && set->size * CSP_SET_REBUILD_RATIO > count) {
+        bool any_new = false;
+        for (i = 0; i < count; i++) {
+            if (csp_set_add(set, (void *) keys[i])) {
+                any_new = true;
+            }
+        }
+        return any_new;
+    }
+
+    merged = malloc((set->size + count) * sizeof(Word_t));
+    assert(merged != NULL);
+    csp_set_foreach (set, &iter) {
+        Word_t existing = (Word_t) csp_set_iterator_get(&iter);
+        for (; i < count && keys[i] < existing; i++) {
+            /* Only keys that weren't already in the set are new. */
+            merged[merged_count++] = keys[i];
+            new_hash ^= csp_set_element_hash((void *) keys[i]);
+        }
+        if (i < count && keys[i] == existing) {
+            i++;
+        }
+        merged[merged_count++] = existing;
+    }
+    for (; i < count; i++) {
+        merged[merged_count++] = keys[i];
+        new_hash ^= csp_set_element_hash((void *) keys[i]);
+    }
+
+    if (merged_count == set->size) {
+        free(merged);
+        return false;
+    }
+    csp_set_rebuild(set, merged_count, merged);
+    set->hash ^= new_hash;
+    free(merged);
+    return true;
+}
+
 bool
 csp_set_add_many(struct csp_set *set, size_t count, void **elements)
 {
     bool any_new = false;
+    Word_t *keys;
+    size_t unique_count;
     size_t i;
+    if (count < CSP_SET_BULK_MIN) {
+        for (i = 0; i < count; i++) {
+            if (csp_set_add(set, elements[i])) {
+                any_new = true;
+            }
+        }
+        return any_new;
+    }
+
+    keys = malloc(count * sizeof(Word_t));
+    assert(keys != NULL);
     for (i = 0; i < count; i++) {
-        if (csp_set_add(set, elements[i])) {
-            any_new = true;
+        keys[i] = (Word_t) elements[i];
+    }
+    qsort(keys, count, sizeof(Word_t), csp_set_compare_keys);
+    unique_count = 1;
+    for (i = 1; i < count; i++) {
+        if (keys[i] != keys[unique_count - 1]) {
+            keys[unique_count++] = keys[i];
         }
     }
+    any_new = csp_set_add_sorted(set, unique_count, keys);
+    free(keys);
     return any_new;
 }
 
@@ -143,7 +398,24 @@ bool
 csp_set_remove(struct csp_set *set, void *element)
 {
     int rc;
-    J1U(rc, set->elements, (uintptr_t) element);
+    if (csp_set_is_inline(set)) {
+        size_t i = csp_set_inline_find(set, (uintptr_t) element);
+        void **inline_elements = set->elements.inline_elements;
+        if (i == set->size || inline_elements[i] != element) {
+            return false;
+        }
+        memmove(&inline_elements[i], &inline_elements[i + 1],
+                (set->size - i - 1) * sizeof(void *));
+        csp_set_removed(set, element);
+        return true;
+    }
+    J1U(rc, set->elements.judy, (uintptr_t) element);
+    if (rc) {
+        csp_set_removed(set, element);
+        if (csp_set_is_inline(set)) {
+            csp_set_demote(set);
+        }
+    }
     return rc;
 }
 
@@ -160,25 +432,115 @@ csp_set_remove_many(struct csp_set *set, size_t count, void **elements)
     return any_removed;
 }
 
+/* Merges two inline sets, if the result fits inline.  Returns whether it did. */
+static bool
+csp_set_inline_union(struct csp_set *set, const struct csp_set *other,
+                     bool *any_new)
+{
+    void *merged[2 * CSP_SET_INLINE_COUNT];
+    void *const *elements1 = set->elements.inline_elements;
+    void *const *elements2 = other->elements.inline_elements;
+    uint64_t new_hash = 0;
+    size_t i1 = 0;
+    size_t i2 = 0;
+    size_t count = 0;
+    while (i1 < set->size || i2 < other->size) {
+        if (i2 == other->size ||
+            (i1 < set->size &&
+             (uintptr_t) elements1[i1] < (uintptr_t) elements2[i2])) {
+            merged[count++] = elements1[i1++];
+        } else if (i1 == set->size ||
+                   (uintptr_t) elements2[i2] < (uintptr_t) elements1[i1]) {
+            /* Only elements that come from `other` alone are new. */
+            merged[count] = elements2[i2++];
+            new_hash ^= csp_set_element_hash(merged[count++]);
+        } else {
+            merged[count++] = elements1[i1++];
+            i2++;
+        }
+    }
+    if (count > CSP_SET_INLINE_COUNT) {
+        return false;
+    }
+    *any_new = count > set->size;
+    memcpy(set->elements.inline_elements, merged, count * sizeof(void *));
+    set->size = count;
+    set->hash ^= new_hash;
+    return true;
+}
+
 bool
 csp_set_union(struct csp_set *set, const struct csp_set *other)
 {
     bool any_new = false;
     struct csp_set_iterator iter;
-    csp_set_foreach (other, &iter) {
-        if (csp_set_add(set, csp_set_iterator_get(&iter))) {
-            any_new = true;
+    Word_t *keys;
+    size_t count = 0;
+    if (csp_set_is_inline(set) && csp_set_is_inline(other) &&
+        csp_set_inline_union(set, other, &any_new)) {
+        return any_new;
+    }
+    if (other->size < CSP_SET_BULK_MIN) {
+        csp_set_foreach (other, &iter) {
+            if (csp_set_add(set, csp_set_iterator_get(&iter))) {
+                any_new = true;
+            }
         }
+        return any_new;
     }
+    /* `other`'s elements come out of its iterator already sorted. */
+    keys = malloc(other->size * sizeof(Word_t));
+    assert(keys != NULL);
+    csp_set_foreach (other, &iter) {
+        keys[count++] = (Word_t) csp_set_iterator_get(&iter);
+    }
+    any_new = csp_set_add_sorted(set, count, keys);
+    free(keys);
     return any_new;
 }
 
+/* Judy1 stores an array with at most 31 elements in a single root-level leaf:
+ * a word containing the number of elements minus one, followed by the elements
+ * themselves, in order.  (The 31 is cJ1_LEAFW_MAXPOP1 in Judy1.h.)  Larger
+ * arrays point at a structure whose first word is also the number of elements
+ * minus one, which is how Judy itself tells the two apart.  For sets whose
+ * array is a root leaf, iterators can step through the leaf directly instead of
+ * calling Judy1Next, which has to decode the root and search the leaf again for
+ * every element. */
+#define CSP_SET_JUDY_ROOT_LEAF_MAX 31
+
+/* Returns the elements of `set`'s root leaf, and fills in `count`, or returns
+ * NULL if `set` isn't stored in a root leaf. */
+static const Word_t *
+csp_set_root_leaf(const struct csp_set *set, size_t *count)
+{
+    const Word_t *leaf = set->elements.judy;
+    if (csp_set_is_inline(set) || leaf[0] >= CSP_SET_JUDY_ROOT_LEAF_MAX) {
+        return NULL;
+    }
+    *count = leaf[0] + 1;
+    return leaf + 1;
+}
+
 void
 csp_set_get_iterator(const struct csp_set *set, struct csp_set_iterator *iter)
 {
-    iter->elements = &set->elements;
+    const Word_t *leaf;
+    size_t count;
+    iter->set = set;
     iter->current = 0;
-    J1F(iter->found, *iter->elements, iter->current);
+    iter->index = 0;
+    if (csp_set_is_inline(set)) {
+        iter->found = set->size > 0;
+        if (iter->found) {
+            iter->current = (uintptr_t) set->elements.inline_elements[0];
+        }
+    } else if ((leaf = csp_set_root_leaf(set, &count)) != NULL) {
+        iter->found = true;
+        iter->current = leaf[0];
+    } else {
+        J1F(iter->found, set->elements.judy, iter->current);
+    }
 }
 
 void *
@@ -196,5 +558,39 @@ csp_set_iterator_done(struct csp_set_iterator *iter)
 void
 csp_set_iterator_advance(struct csp_set_iterator *iter)
 {
-    J1N(iter->found, *iter->elements, iter->current);
+    const struct csp_set *set = iter->set;
+    const Word_t *leaf;
+    size_t count;
+    if (csp_set_is_inline(set)) {
+        size_t i = iter->index;
+        /* If the set hasn't changed since the last step, the current element
+         * is still where we left it; otherwise search for its successor. */
+        if (i < set->size &&
+            (uintptr_t) set->elements.inline_elements[i] == iter->current) {
+            i++;
+        } else {
+            i = csp_set_inline_find(set, iter->current + 1);
+            if (iter->current == UINTPTR_MAX) {
+                i = set->size;
+            }
+        }
+        iter->index = i;
+        iter->found = i < set->size;
+        if (iter->found) {
+            iter->current = (uintptr_t) set->elements.inline_elements[i];
+        }
+    } else if ((leaf = csp_set_root_leaf(set, &count)) != NULL &&
+               iter->index < count && leaf[iter->index] == iter->current) {
+        /* Same as above: the set hasn't changed in a way that moves the current
+         * element, so its successor is the next element in the leaf. */
+        iter->index++;
+        iter->found = iter->index < count;
+        if (iter->found) {
+            iter->current = leaf[iter->index];
+        }
+    } else {
+        /* Forget the hint, since we don't know where the successor is. */
+        iter->index = SIZE_MAX;
+        J1N(iter->found, set->elements.judy, iter->current);
+    }
 }
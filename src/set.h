@@ -12,14 +12,33 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#define CSP_SET_INLINE_COUNT 6
+
 /* A set of any pointer that you want.  The pointers must be directly comparable
  * — i.e., a pointer is only equal to itself; there isn't any way to define a
  * deeper comparison operation for your elements.  (If you want to do that, use
  * map.h to define a hash set.)  You'll typically never use this type directly;
  * instead, there are several helper types that store particular kinds of
- * elements, and you'll use one of those directly. */
+ * elements, and you'll use one of those directly.
+ *
+ * Most sets are small, so a set with at most CSP_SET_INLINE_COUNT elements
+ * stores them inline, in a sorted array, in the same space that would
+ * otherwise hold the pointer to its Judy array.  The representation only
+ * depends on the size of the set: we promote a set to a Judy array as soon as
+ * it grows past CSP_SET_INLINE_COUNT elements, and demote it as soon as it
+ * shrinks back down to that many.  That keeps the whole struct in a single
+ * 64-byte cache line.
+ *
+ * We also keep track of the number of elements in the set, and the XOR of the
+ * hashes of each element, updating them as elements are added and removed, so
+ * that csp_set_size and csp_set_hash don't have to look at the elements. */
 struct csp_set {
-    void *elements;
+    union {
+        void *judy;
+        void *inline_elements[CSP_SET_INLINE_COUNT];
+    } elements;
+    size_t size;
+    uint64_t hash;
 };
 
 void
@@ -75,9 +94,16 @@ csp_set_remove_many(struct csp_set *set, size_t count, void **elements);
 bool
 csp_set_union(struct csp_set *set, const struct csp_set *other);
 
+/* Iterators are "key-based": they only remember the current element, and find
+ * the next element by looking for the smallest one that's larger than it.
+ * That means that they remain valid even if the set switches representations
+ * while you're iterating through it. */
 struct csp_set_iterator {
-    void *const *elements;
+    const struct csp_set *set;
     uintptr_t current;
+    /* A hint: where `current` appears in `inline_elements`, or in the Judy
+     * array's root leaf (see set.c). */
+    size_t index;
     int found;
 };
 
@@ -0,0 +1,90 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "side-table.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccan/likely/likely.h"
+
+void
+csp_side_table_init(struct csp_side_table *table, size_t element_size)
+{
+    table->element_size = element_size;
+    table->chunk_count = 0;
+    table->chunks = NULL;
+    table->allocated_chunk_count = 0;
+}
+
+void
+csp_side_table_done(struct csp_side_table *table,
+                    csp_side_table_free_entry_f *free_entry, void *ud)
+{
+    size_t i;
+    for (i = 0; i < table->chunk_count; i++) {
+        char *chunk = table->chunks[i];
+        if (chunk != NULL && free_entry != NULL) {
+            size_t j;
+            for (j = 0; j < CSP_SIDE_TABLE_CHUNK_SIZE; j++) {
+                free_entry(ud, chunk + j * table->element_size);
+            }
+        }
+        free(chunk);
+    }
+    free(table->chunks);
+}
+
+size_t
+csp_side_table_memory_usage(const struct csp_side_table *table)
+{
+    return table->chunk_count * sizeof(void *) +
+           table->allocated_chunk_count * CSP_SIDE_TABLE_CHUNK_SIZE *
+                   table->element_size;
+}
+
+void *
+csp_side_table_at(struct csp_side_table *table, size_t index)
+{
+    size_t chunk_index = index / CSP_SIDE_TABLE_CHUNK_SIZE;
+    char *chunk;
+    if (unlikely(chunk_index >= table->chunk_count)) {
+        size_t new_count = table->chunk_count == 0 ? 4 : table->chunk_count;
+        while (new_count <= chunk_index) {
+            new_count *= 2;
+        }
+        table->chunks = realloc(table->chunks, new_count * sizeof(void *));
+        assert(table->chunks != NULL);
+        memset(&table->chunks[table->chunk_count], 0,
+               (new_count - table->chunk_count) * sizeof(void *));
+        table->chunk_count = new_count;
+    }
+    chunk = table->chunks[chunk_index];
+    if (unlikely(chunk == NULL)) {
+        chunk = calloc(CSP_SIDE_TABLE_CHUNK_SIZE, table->element_size);
+        assert(chunk != NULL);
+        table->chunks[chunk_index] = chunk;
+        table->allocated_chunk_count++;
+    }
+    return chunk + (index % CSP_SIDE_TABLE_CHUNK_SIZE) * table->element_size;
+}
+
+const void *
+csp_side_table_get(const struct csp_side_table *table, size_t index)
+{
+    size_t chunk_index = index / CSP_SIDE_TABLE_CHUNK_SIZE;
+    const char *chunk;
+    if (chunk_index >= table->chunk_count) {
+        return NULL;
+    }
+    chunk = table->chunks[chunk_index];
+    if (chunk == NULL) {
+        return NULL;
+    }
+    return chunk + (index % CSP_SIDE_TABLE_CHUNK_SIZE) * table->element_size;
+}
@@ -0,0 +1,58 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HST_SIDE_TABLE_H
+#define HST_SIDE_TABLE_H
+
+#include <stdlib.h>
+
+/* A side table stores a fixed-size piece of data for each process in an
+ * environment, indexed by the process's `index`.  Since indices are assigned
+ * sequentially as processes are registered, this is just a flat array, which
+ * makes it a much cheaper place to keep per-process analysis state (visited
+ * flags, class IDs, parent pointers) than a map keyed by ID or pointer.
+ *
+ * The array is split into fixed-size chunks, which we allocate on demand, so
+ * that growing the table never moves existing elements.  New elements are
+ * always filled with zeroes. */
+
+#define CSP_SIDE_TABLE_CHUNK_SIZE 1024
+
+struct csp_side_table {
+    size_t element_size;
+    size_t chunk_count;
+    void **chunks;
+    /* The number of entries in `chunks` that are non-NULL */
+    size_t allocated_chunk_count;
+};
+
+void
+csp_side_table_init(struct csp_side_table *table, size_t element_size);
+
+/* Called for every element in every chunk that has been allocated, including
+ * elements that you never touched (which will still be all zeroes). */
+typedef void
+csp_side_table_free_entry_f(void *ud, void *element);
+
+void
+csp_side_table_done(struct csp_side_table *table,
+                    csp_side_table_free_entry_f *free_entry, void *ud);
+
+/* Returns the number of bytes that the table's chunks take up. */
+size_t
+csp_side_table_memory_usage(const struct csp_side_table *table);
+
+/* Returns the element for `index`, allocating its chunk if needed. */
+void *
+csp_side_table_at(struct csp_side_table *table, size_t index);
+
+/* Returns the element for `index`, or NULL if its chunk hasn't been allocated
+ * yet (in which case the element would be all zeroes). */
+const void *
+csp_side_table_get(const struct csp_side_table *table, size_t index);
+
+#endif /* HST_SIDE_TABLE_H */
@@ -0,0 +1,112 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "antichain.h"
+
+#include "process.h"
+#include "test-case-harness.h"
+
+/* Antichains only look at the index of each process. */
+static struct csp_process p0 = {0, NULL, 0};
+static struct csp_process p1 = {0, NULL, 1};
+static struct csp_process p2 = {0, NULL, 2};
+static struct csp_process p3 = {0, NULL, 3};
+static struct csp_process p4 = {0, NULL, 4};
+
+TEST_CASE_GROUP("antichains");
+
+TEST_CASE("empty antichain has no subsets")
+{
+    struct csp_antichain antichain;
+    csp_antichain_init(&antichain);
+    check(csp_antichain_size(&antichain) == 0);
+    check(!csp_antichain_has_subset(&antichain, process_set()));
+    check(!csp_antichain_has_subset(&antichain, process_set(&p0, &p1)));
+    csp_antichain_done(&antichain);
+}
+
+TEST_CASE("can add sets")
+{
+    struct csp_antichain antichain;
+    csp_antichain_init(&antichain);
+    check(csp_antichain_add(&antichain, process_set(&p1, &p3)));
+    check(csp_antichain_add(&antichain, process_set(&p2)));
+    check(csp_antichain_size(&antichain) == 2);
+    csp_antichain_done(&antichain);
+}
+
+TEST_CASE("can find subsets")
+{
+    struct csp_antichain antichain;
+    csp_antichain_init(&antichain);
+    check(csp_antichain_add(&antichain, process_set(&p1, &p3)));
+    check(csp_antichain_add(&antichain, process_set(&p2, &p4)));
+    check(csp_antichain_has_subset(&antichain, process_set(&p1, &p3)));
+    check(csp_antichain_has_subset(&antichain, process_set(&p0, &p1, &p3)));
+    check(csp_antichain_has_subset(&antichain,
+                                   process_set(&p0, &p1, &p2, &p3, &p4)));
+    check(csp_antichain_has_subset(&antichain, process_set(&p2, &p3, &p4)));
+    check(!csp_antichain_has_subset(&antichain, process_set(&p1)));
+    check(!csp_antichain_has_subset(&antichain, process_set(&p1, &p2)));
+    check(!csp_antichain_has_subset(&antichain, process_set(&p0, &p3, &p4)));
+    check(!csp_antichain_has_subset(&antichain, process_set()));
+    csp_antichain_done(&antichain);
+}
+
+TEST_CASE("won't add supersets of existing sets")
+{
+    struct csp_antichain antichain;
+    csp_antichain_init(&antichain);
+    check(csp_antichain_add(&antichain, process_set(&p1, &p3)));
+    check(!csp_antichain_add(&antichain, process_set(&p1, &p3)));
+    check(!csp_antichain_add(&antichain, process_set(&p1, &p2, &p3)));
+    check(csp_antichain_size(&antichain) == 1);
+    csp_antichain_done(&antichain);
+}
+
+TEST_CASE("can add subsets of existing sets")
+{
+    struct csp_antichain antichain;
+    csp_antichain_init(&antichain);
+    check(csp_antichain_add(&antichain, process_set(&p1, &p2, &p3)));
+    check(!csp_antichain_has_subset(&antichain, process_set(&p1, &p3)));
+    check(csp_antichain_add(&antichain, process_set(&p1, &p3)));
+    check(csp_antichain_has_subset(&antichain, process_set(&p1, &p3)));
+    check(csp_antichain_has_subset(&antichain, process_set(&p1, &p3, &p4)));
+    csp_antichain_done(&antichain);
+}
+
+TEST_CASE("empty set is a subset of everything")
+{
+    struct csp_antichain antichain;
+    csp_antichain_init(&antichain);
+    check(csp_antichain_add(&antichain, process_set()));
+    check(csp_antichain_has_subset(&antichain, process_set()));
+    check(csp_antichain_has_subset(&antichain, process_set(&p0, &p2)));
+    check(!csp_antichain_add(&antichain, process_set(&p4)));
+    csp_antichain_done(&antichain);
+}
+
+TEST_CASE("adding a set removes its supersets")
+{
+    struct csp_antichain antichain;
+    csp_antichain_init(&antichain);
+    check(csp_antichain_add(&antichain, process_set(&p1, &p2, &p3)));
+    check(csp_antichain_add(&antichain, process_set(&p0, &p1, &p3)));
+    check(csp_antichain_add(&antichain, process_set(&p1, &p3, &p4)));
+    check(csp_antichain_add(&antichain, process_set(&p2, &p4)));
+    check(csp_antichain_size(&antichain) == 4);
+    check(csp_antichain_add(&antichain, process_set(&p1, &p3)));
+    check(csp_antichain_size(&antichain) == 2);
+    check(csp_antichain_has_subset(&antichain, process_set(&p1, &p3)));
+    check(csp_antichain_has_subset(&antichain, process_set(&p2, &p4)));
+    check(!csp_antichain_has_subset(&antichain, process_set(&p1, &p2)));
+    check(csp_antichain_add(&antichain, process_set()));
+    check(csp_antichain_size(&antichain) == 1);
+    check(csp_antichain_has_subset(&antichain, process_set(&p4)));
+    csp_antichain_done(&antichain);
+}
@@ -0,0 +1,72 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test-case-harness.h"
+
+#define ALLOCATION_COUNT 10000
+
+static bool
+is_aligned(const void *ptr)
+{
+    return ((uintptr_t) ptr % CSP_ARENA_ALIGNMENT) == 0;
+}
+
+TEST_CASE_GROUP("arenas");
+
+TEST_CASE("can create empty arena")
+{
+    struct csp_arena arena;
+    csp_arena_init(&arena);
+    csp_arena_done(&arena);
+}
+
+TEST_CASE("allocations are aligned and don't overlap")
+{
+    static unsigned char *allocations[ALLOCATION_COUNT];
+    struct csp_arena arena;
+    size_t i;
+    csp_arena_init(&arena);
+    /* Use a mix of sizes, including some odd ones. */
+    for (i = 0; i < ALLOCATION_COUNT; i++) {
+        size_t size = 1 + (i % 37);
+        allocations[i] = csp_arena_alloc(&arena, size);
+        check(is_aligned(allocations[i]));
+        memset(allocations[i], (unsigned char) i, size);
+    }
+    for (i = 0; i < ALLOCATION_COUNT; i++) {
+        size_t size = 1 + (i % 37);
+        size_t j;
+        for (j = 0; j < size; j++) {
+            check(allocations[i][j] == (unsigned char) i);
+        }
+    }
+    csp_arena_done(&arena);
+}
+
+TEST_CASE("can allocate large objects")
+{
+    struct csp_arena arena;
+    unsigned char *small1;
+    unsigned char *large;
+    unsigned char *small2;
+    csp_arena_init(&arena);
+    small1 = csp_arena_alloc(&arena, 8);
+    large = csp_arena_alloc(&arena, 3 * 1024 * 1024);
+    small2 = csp_arena_alloc(&arena, 8);
+    check(is_aligned(large));
+    memset(large, 0xaa, 3 * 1024 * 1024);
+    /* Large allocations get their own chunk, so the small ones around them can
+     * still share the current chunk. */
+    check(small2 == small1 + CSP_ARENA_ALIGNMENT);
+    check(large[3 * 1024 * 1024 - 1] == 0xaa);
+    csp_arena_done(&arena);
+}
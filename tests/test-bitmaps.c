@@ -0,0 +1,99 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "bitmap.h"
+
+#include "test-case-harness.h"
+
+/* Adds every `step`th value in [start, end) to `bitmap`. */
+static void
+add_range(struct csp_bitmap *bitmap, uint32_t start, uint32_t end,
+          uint32_t step)
+{
+    uint32_t value;
+    for (value = start; value < end; value += step) {
+        csp_bitmap_add(bitmap, value);
+    }
+}
+
+/* Checks that `bitmap` contains exactly every `step`th value in [start, end).
+ * (Only looks at the values in that range, plus the bitmap's size.) */
+static bool
+bitmap_has_range(const struct csp_bitmap *bitmap, uint32_t start,
+                 uint32_t end, uint32_t step)
+{
+    uint32_t value;
+    for (value = start; value < end; value++) {
+        bool expected = (value - start) % step == 0;
+        if (csp_bitmap_contains(bitmap, value) != expected) {
+            return false;
+        }
+    }
+    return csp_bitmap_size(bitmap) == (end - start + step - 1) / step;
+}
+
+TEST_CASE_GROUP("bitmaps");
+
+TEST_CASE("can create empty bitmap")
+{
+    struct csp_bitmap bitmap;
+    csp_bitmap_init(&bitmap);
+    check(csp_bitmap_empty(&bitmap));
+    check(csp_bitmap_size(&bitmap) == 0);
+    check(!csp_bitmap_contains(&bitmap, 0));
+    csp_bitmap_done(&bitmap);
+}
+
+TEST_CASE("can add individual values")
+{
+    struct csp_bitmap bitmap;
+    csp_bitmap_init(&bitmap);
+    check(csp_bitmap_add(&bitmap, 5));
+    check(csp_bitmap_add(&bitmap, 0));
+    check(csp_bitmap_add(&bitmap, 70000));
+    check(csp_bitmap_add(&bitmap, UINT32_MAX));
+    check(!csp_bitmap_add(&bitmap, 5));
+    check(!csp_bitmap_add(&bitmap, 70000));
+    check(!csp_bitmap_empty(&bitmap));
+    check(csp_bitmap_size(&bitmap) == 4);
+    check(csp_bitmap_contains(&bitmap, 0));
+    check(csp_bitmap_contains(&bitmap, 5));
+    check(csp_bitmap_contains(&bitmap, 70000));
+    check(csp_bitmap_contains(&bitmap, UINT32_MAX));
+    check(!csp_bitmap_contains(&bitmap, 1));
+    check(!csp_bitmap_contains(&bitmap, 65536 + 5));
+    csp_bitmap_done(&bitmap);
+}
+
+TEST_CASE("dense chunks switch from arrays to bitmaps")
+{
+    struct csp_bitmap bitmap;
+    csp_bitmap_init(&bitmap);
+    /* Enough values to overflow an array container. */
+    add_range(&bitmap, 0, 2 * CSP_BITMAP_ARRAY_MAX, 2);
+    check(bitmap_has_range(&bitmap, 0, 2 * CSP_BITMAP_ARRAY_MAX, 2));
+    check(csp_bitmap_add(&bitmap, 1));
+    check(!csp_bitmap_add(&bitmap, 1));
+    check(!csp_bitmap_add(&bitmap, 100));
+    check(csp_bitmap_size(&bitmap) == CSP_BITMAP_ARRAY_MAX + 1);
+    csp_bitmap_done(&bitmap);
+}
+
+TEST_CASE("can add values across many chunks")
+{
+    struct csp_bitmap bitmap;
+    csp_bitmap_init(&bitmap);
+    /* Mix sparse and dense chunks, and add them out of order. */
+    add_range(&bitmap, 2 * 65536, 3 * 65536, 1);
+    add_range(&bitmap, 0, 65536, 7);
+    check(csp_bitmap_size(&bitmap) == 65536 + (65536 + 6) / 7);
+    check(csp_bitmap_contains(&bitmap, 7));
+    check(!csp_bitmap_contains(&bitmap, 8));
+    check(!csp_bitmap_contains(&bitmap, 65536 + 7));
+    check(csp_bitmap_contains(&bitmap, 2 * 65536 + 8));
+    csp_bitmap_done(&bitmap);
+}
@@ -0,0 +1,146 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "csp0.h"
+#include "environment.h"
+#include "refinement.h"
+#include "test-case-harness.h"
+#include "test-cases.h"
+
+/* The test cases in this file run many independent environments at the same
+ * time, on separate threads.  They're most useful when run under ThreadSanitizer
+ * (configure with --enable-tsan) or helgrind (make check-valgrind-helgrind). */
+
+#define THREAD_COUNT 8
+#define ROUND_COUNT 10
+
+struct refinement_case {
+    const char *spec;
+    const char *impl;
+    bool expected;
+};
+
+static const struct refinement_case cases[] = {
+        {"a → STOP □ b → STOP", "a → STOP ⊓ b → STOP", true},
+        {"a → STOP ⊓ b → STOP", "a → STOP □ b → STOP", true},
+        {"a → b → STOP ⊓ a → c → STOP", "a → d → STOP", false},
+        {"let X=a → X within X", "let Y=a → Y within Y", true},
+        {"let X=a → X within X", "let Y=a → (Y □ b → STOP) within Y", false},
+        {"let X=a → (X ⊓ c → STOP) within X", "let Y=a → Y within Y", true},
+        {"a → SKIP ⫴ b → SKIP ⫴ c → SKIP",
+         "a → b → c → SKIP □ c → b → a → SKIP", true},
+        {"a → SKIP ⫴ b → SKIP", "a → a → SKIP", false},
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static const enum csp_refinement_engine engines[] = {
+        CSP_REFINEMENT_NORMALIZATION, CSP_REFINEMENT_ANTICHAINS,
+        CSP_REFINEMENT_HKC};
+
+#define ENGINE_COUNT (sizeof(engines) / sizeof(engines[0]))
+
+struct checker {
+    pthread_t thread;
+    size_t id;
+    /* The number of checks that gave the wrong answer. */
+    size_t failures;
+};
+
+/* Runs every refinement case with every engine in a fresh environment. */
+static void
+run_round(struct checker *self, size_t round)
+{
+    struct csp *csp = csp_new();
+    size_t i;
+    size_t e;
+    char name[64];
+    if (csp == NULL) {
+        self->failures++;
+        return;
+    }
+    for (i = 0; i < CASE_COUNT; i++) {
+        /* Stagger the order that each thread runs the cases in, so that the
+         * threads create shared events in different orders. */
+        const struct refinement_case *c =
+                &cases[(i + self->id + round) % CASE_COUNT];
+        struct csp_process *spec = csp_load_csp0_string(csp, c->spec);
+        struct csp_process *impl = csp_load_csp0_string(csp, c->impl);
+        if (spec == NULL || impl == NULL) {
+            self->failures++;
+            continue;
+        }
+        for (e = 0; e < ENGINE_COUNT; e++) {
+            struct csp_refinement_options options = csp_refinement_options();
+            options.engine = engines[e];
+            if (csp_check_traces_refinement_with(csp, spec, impl, &options,
+                                                 NULL) != c->expected) {
+                self->failures++;
+            }
+        }
+    }
+    /* Also create some events that only this thread uses. */
+    snprintf(name, sizeof(name), "thread%zu_round%zu → STOP", self->id, round);
+    if (csp_load_csp0_string(csp, name) == NULL) {
+        self->failures++;
+    }
+    csp_free(csp);
+}
+
+static void *
+run_checker(void *vself)
+{
+    struct checker *self = vself;
+    size_t round;
+    for (round = 0; round < ROUND_COUNT; round++) {
+        run_round(self, round);
+    }
+    return NULL;
+}
+
+TEST_CASE_GROUP("concurrency");
+
+TEST_CASE("can check refinement in a single thread")
+{
+    struct checker checker = {0};
+    run_checker(&checker);
+    check(checker.failures == 0);
+}
+
+TEST_CASE("can check refinement in parallel environments")
+{
+    static struct checker checkers[THREAD_COUNT];
+    size_t t;
+    for (t = 0; t < THREAD_COUNT; t++) {
+        checkers[t].id = t;
+        checkers[t].failures = 0;
+        check0(pthread_create(&checkers[t].thread, NULL, run_checker,
+                              &checkers[t]));
+    }
+    for (t = 0; t < THREAD_COUNT; t++) {
+        check0(pthread_join(checkers[t].thread, NULL));
+        check(checkers[t].failures == 0);
+    }
+}
+
+TEST_CASE("environments have their own predefined processes")
+{
+    struct csp *csp1;
+    struct csp *csp2;
+    check_alloc(csp1, csp_new());
+    check_alloc(csp2, csp_new());
+    check(csp1->stop != csp2->stop);
+    check(csp1->skip != csp2->skip);
+    check(csp1->stop->id == csp2->stop->id);
+    check(csp_get_process_by_index(csp1, csp1->stop->index) == csp1->stop);
+    check(csp_get_process_by_index(csp2, csp2->stop->index) == csp2->stop);
+    csp_free(csp1);
+    csp_free(csp2);
+}
@@ -7,8 +7,12 @@
 
 #include "environment.h"
 
+#include "csp0.h"
 #include "event.h"
+#include "normalization.h"
+#include "operators.h"
 #include "process.h"
+#include "refinement.h"
 #include "test-case-harness.h"
 #include "test-cases.h"
 
@@ -74,6 +78,232 @@ TEST_CASE("predefined SKIP process exists")
     csp_free(csp);
 }
 
+TEST_CASE("can look up processes by index")
+{
+    struct csp *csp;
+    struct csp_process *p;
+    size_t count;
+    check_alloc(csp, csp_new());
+    count = csp_process_count(csp);
+    check(csp_get_process_by_index(csp, csp->stop->index) == csp->stop);
+    check(csp_get_process_by_index(csp, csp->skip->index) == csp->skip);
+    p = csp_prefix(csp, csp_event_get("a"), csp->stop);
+    check(p->index == count);
+    check(csp_process_count(csp) == count + 1);
+    check(csp_get_process_by_index(csp, p->index) == p);
+    check(csp_get_process_by_index(csp, count + 1) == NULL);
+    check(csp_get_process_by_index(csp, 1000000) == NULL);
+    csp_free(csp);
+}
+
+TEST_CASE("sessions free the processes created inside them")
+{
+    struct csp *csp;
+    struct csp_process *outer;
+    struct csp_process *inner;
+    csp_id inner_id;
+    size_t count;
+    check_alloc(csp, csp_new());
+    outer = csp_prefix(csp, csp_event_get("a"), csp->stop);
+    count = csp_process_count(csp);
+    csp_session_begin(csp);
+    check(csp_session_owns_process(csp, outer) == false);
+    /* Processes from outside the session are still visible. */
+    check(csp_prefix(csp, csp_event_get("a"), csp->stop) == outer);
+    check(csp_process_count(csp) == count);
+    inner = csp_prefix(csp, csp_event_get("b"), outer);
+    inner_id = inner->id;
+    check(csp_session_owns_process(csp, inner));
+    check(inner->index == count);
+    check(csp_get_process(csp, inner_id) == inner);
+    csp_session_end(csp);
+    /* The session's processes are gone, and their indices are reused. */
+    check(csp_process_count(csp) == count);
+    check(csp_get_process(csp, inner_id) == NULL);
+    check(csp_get_process_by_index(csp, count) == NULL);
+    check(csp_get_process(csp, outer->id) == outer);
+    check(csp_get_process_by_index(csp, outer->index) == outer);
+    inner = csp_prefix(csp, csp_event_get("b"), outer);
+    check(inner->index == count);
+    csp_free(csp);
+}
+
+TEST_CASE("sessions can be nested")
+{
+    struct csp *csp;
+    struct csp_process *p1;
+    struct csp_process *p2;
+    size_t count;
+    check_alloc(csp, csp_new());
+    count = csp_process_count(csp);
+    csp_session_begin(csp);
+    p1 = csp_prefix(csp, csp_event_get("a"), csp->stop);
+    csp_session_begin(csp);
+    p2 = csp_prefix(csp, csp_event_get("b"), p1);
+    check(csp_session_owns_process(csp, p1) == false);
+    check(csp_session_owns_process(csp, p2));
+    csp_session_end(csp);
+    check(csp_process_count(csp) == count + 1);
+    check(csp_get_process(csp, p1->id) == p1);
+    csp_session_end(csp);
+    check(csp_process_count(csp) == count);
+    /* csp_free should clean up any sessions that are still active. */
+    csp_session_begin(csp);
+    csp_prefix(csp, csp_event_get("a"), csp->stop);
+    csp_free(csp);
+}
+
+TEST_CASE("repeated checks in sessions don't accumulate processes")
+{
+    struct csp *csp;
+    struct csp_process *spec;
+    struct csp_process *impl;
+    struct csp_process *prenormalized;
+    size_t count;
+    size_t i;
+    check_alloc(csp, csp_new());
+    spec = csp_load_csp0_string(csp, "a → b → STOP ⊓ a → c → STOP");
+    impl = csp_load_csp0_string(csp, "a → b → STOP");
+    /* The afters of a prenormalized node from outside the session are created
+     * inside of it, and have to go away when the session ends. */
+    prenormalized = csp_prenormalize_process(csp, spec);
+    count = csp_process_count(csp);
+    for (i = 0; i < 9; i++) {
+        static const enum csp_refinement_engine engines[] = {
+                CSP_REFINEMENT_NORMALIZATION, CSP_REFINEMENT_ANTICHAINS,
+                CSP_REFINEMENT_HKC};
+        struct csp_refinement_options options = csp_refinement_options();
+        options.engine = engines[i % 3];
+        options.spec_preparation = CSP_SPEC_DIRECT;
+        csp_session_begin(csp);
+        check(csp_check_traces_refinement_with(csp, prenormalized, impl,
+                                               &options, NULL));
+        options.spec_preparation = CSP_SPEC_AUTO;
+        check(csp_check_traces_refinement_with(csp, spec, impl, &options,
+                                               NULL));
+        check(!csp_check_traces_refinement_with(csp, impl, spec, &options,
+                                                NULL));
+        csp_session_end(csp);
+        check(csp_process_count(csp) == count);
+    }
+    csp_free(csp);
+}
+
+TEST_CASE("garbage collector frees unreachable processes")
+{
+    struct csp *csp;
+    struct csp_process *outer;
+    struct csp_process *a;
+    struct csp_process *b;
+    struct csp_process *c;
+    csp_id b_id;
+    csp_id c_id;
+    size_t count;
+    check_alloc(csp, csp_new());
+    outer = csp_prefix(csp, csp_event_get("x"), csp->stop);
+    csp_session_begin(csp);
+    a = csp_prefix(csp, csp_event_get("a"), csp->stop);
+    b = csp_prefix(csp, csp_event_get("b"), a);
+    c = csp_prefix(csp, csp_event_get("c"), outer);
+    b_id = b->id;
+    c_id = c->id;
+    /* `b` is pinned, and `a` is reachable from it. */
+    csp_pin_process(csp, b);
+    check(csp_collect_garbage(csp, NULL) == 1);
+    check(csp_get_process(csp, a->id) == a);
+    check(csp_get_process(csp, b_id) == b);
+    check(csp_get_process(csp, c_id) == NULL);
+    /* Processes from enclosing sessions are never collected. */
+    check(csp_get_process(csp, outer->id) == outer);
+    check(csp_get_process(csp, csp->stop->id) == csp->stop);
+    /* Explicit roots are reachable, too. */
+    csp_unpin_process(csp, b);
+    check(csp_collect_garbage(csp, process_set(a)) == 1);
+    check(csp_get_process(csp, a->id) == a);
+    check(csp_get_process(csp, b_id) == NULL);
+    /* A collected process can be recreated with the same ID, and reuses one of
+     * the freed indices. */
+    count = csp_process_count(csp);
+    c = csp_prefix(csp, csp_event_get("c"), outer);
+    check_id_eq(c->id, c_id);
+    check(csp_get_process_by_index(csp, c->index) == c);
+    check(csp_process_count(csp) == count);
+    csp_session_end(csp);
+    csp_free(csp);
+}
+
+TEST_CASE("collected choices can be recreated with the same ID")
+{
+    struct csp *csp;
+    struct csp_process *a;
+    struct csp_process *b;
+    struct csp_process *c;
+    struct csp_process *choice;
+    csp_id choice_id;
+    size_t i;
+    check_alloc(csp, csp_new());
+    csp_session_begin(csp);
+    a = csp_prefix(csp, csp_event_get("a"), csp->stop);
+    b = csp_prefix(csp, csp_event_get("b"), csp->stop);
+    c = csp_prefix(csp, csp_event_get("c"), csp->stop);
+    choice = csp_replicated_internal_choice(csp, process_set(a, b, c));
+    choice_id = choice->id;
+    check(csp_collect_garbage(csp, NULL) == 4);
+    check(csp_get_process(csp, choice_id) == NULL);
+    /* Create some other processes first, and then recreate the subprocesses in
+     * the opposite order, so that they end up at different addresses. */
+    for (i = 0; i < 10; i++) {
+        csp_prefix(csp, csp_event_get("x"), csp->skip);
+    }
+    c = csp_prefix(csp, csp_event_get("c"), csp->stop);
+    b = csp_prefix(csp, csp_event_get("b"), csp->stop);
+    a = csp_prefix(csp, csp_event_get("a"), csp->stop);
+    choice = csp_replicated_internal_choice(csp, process_set(a, b, c));
+    check_id_eq(choice->id, choice_id);
+    csp_session_end(csp);
+    csp_free(csp);
+}
+
+TEST_CASE("garbage collector keeps the predefined processes")
+{
+    struct csp *csp;
+    check_alloc(csp, csp_new());
+    csp_collect_garbage(csp, NULL);
+    check(csp_get_process(csp, csp->stop->id) == csp->stop);
+    check(csp_get_process(csp, csp->skip->id) == csp->skip);
+    csp_free(csp);
+}
+
+TEST_CASE("refinement checks can collect garbage")
+{
+    struct csp *csp;
+    struct csp_process *spec;
+    struct csp_process *impl;
+    size_t uncollected_count;
+    check_alloc(csp, csp_new());
+    /* The cycles need to be long enough that the checks keep going for a few
+     * rounds after the first collection. */
+    spec = csp_load_csp0_string(
+            csp,
+            "let P = a → b → c → d → e → P ⊓ a → c → P within P ⫴ d → SKIP");
+    impl = csp_load_csp0_string(
+            csp, "let Q = a → b → c → d → e → Q within Q ⫴ d → SKIP");
+    csp_session_begin(csp);
+    check(csp_check_traces_refinement(csp, spec, impl));
+    check(!csp_check_traces_refinement(csp, impl, spec));
+    uncollected_count = csp_process_count(csp);
+    csp_session_end(csp);
+    /* The checks should free the pairs from earlier rounds as they go, and
+     * reuse their indices for the later ones. */
+    csp_session_begin(csp);
+    csp_set_gc_high_water_mark(csp, 1);
+    check(csp_check_traces_refinement(csp, spec, impl));
+    check(!csp_check_traces_refinement(csp, impl, spec));
+    check(csp_process_count(csp) < uncollected_count);
+    csp_session_end(csp);
+    csp_free(csp);
+}
+
 TEST_CASE("base process IDs should be reproducible")
 {
     static struct csp_id_scope scope;
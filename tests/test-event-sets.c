@@ -7,6 +7,8 @@
 
 #include "event.h"
 
+#include <stdio.h>
+
 #include "ccan/cppmagic/cppmagic.h"
 #include "test-case-harness.h"
 
@@ -118,3 +120,105 @@ TEST_CASE("can check subsets")
     check(!csp_event_set_subseteq(event_set("b", "c"), event_set("c", "d")));
     check(!csp_event_set_subseteq(event_set("b", "c"), event_set("d")));
 }
+
+TEST_CASE("can store events past the inline limit")
+{
+    struct csp_event_set small;
+    struct csp_event_set large;
+    struct csp_event_set_iterator iter;
+    const struct csp_event *events[600];
+    char name[16];
+    size_t i;
+    size_t count;
+    for (i = 0; i < 600; i++) {
+        snprintf(name, sizeof(name), "large%zu", i);
+        events[i] = e(name);
+    }
+    csp_event_set_init(&small);
+    csp_event_set_init(&large);
+    for (i = 0; i < 600; i++) {
+        check(csp_event_set_add(&large, events[i]));
+        check(!csp_event_set_add(&large, events[i]));
+    }
+    check(csp_event_set_size(&large) == 600);
+    /* Every event should appear exactly once when iterating. */
+    count = 0;
+    csp_event_set_foreach (&large, &iter) {
+        check(csp_event_set_iterator_get(&iter) ==
+              events[csp_event_index(csp_event_set_iterator_get(&iter)) -
+                     csp_event_index(events[0])]);
+        count++;
+    }
+    check(count == 600);
+    /* Remove everything from the large set except for one event that fits in
+     * the inline words of the small set, too. */
+    for (i = 0; i < 600; i++) {
+        csp_event_set_remove(&large, events[i]);
+    }
+    check(csp_event_set_empty(&large));
+    csp_event_set_add(&large, e("a"));
+    csp_event_set_add(&small, e("a"));
+    check(csp_event_set_eq(&large, &small));
+    check(csp_event_set_eq(&small, &large));
+    check(csp_event_set_hash(&large) == csp_event_set_hash(&small));
+    check(csp_event_set_subseteq(&large, &small));
+    check(csp_event_set_subseteq(&small, &large));
+    csp_event_set_add(&large, events[599]);
+    check(!csp_event_set_eq(&large, &small));
+    check(csp_event_set_hash(&large) != csp_event_set_hash(&small));
+    check(csp_event_set_subseteq(&small, &large));
+    check(!csp_event_set_subseteq(&large, &small));
+    check(csp_event_set_union(&small, &large));
+    check(!csp_event_set_union(&small, &large));
+    check(csp_event_set_eq(&large, &small));
+    csp_event_set_done(&small);
+    csp_event_set_done(&large);
+}
+
+TEST_CASE("can intern sets")
+{
+    struct csp_event_set_table table;
+    struct csp_event_set set;
+    const struct csp_event_set *empty;
+    const struct csp_event_set *ab;
+    csp_event_set_table_init(&table);
+    csp_event_set_init(&set);
+    empty = csp_event_set_table_intern(&table, &set);
+    check(csp_event_set_eq(empty, event_set()));
+    csp_event_set_add(&set, e("b"));
+    csp_event_set_add(&set, e("a"));
+    ab = csp_event_set_table_intern(&table, &set);
+    check(ab != empty);
+    check(csp_event_set_eq(ab, event_set("a", "b")));
+    check(csp_interned_event_set_id(ab) != csp_interned_event_set_id(empty));
+    /* Modifying the original set doesn't affect the interned copy. */
+    csp_event_set_remove(&set, e("b"));
+    check(csp_event_set_eq(ab, event_set("a", "b")));
+    /* Interning an equal set gives back the same pointer. */
+    check(csp_event_set_table_intern(&table, event_set("a", "b")) == ab);
+    check(csp_event_set_table_intern(&table, event_set()) == empty);
+    check(csp_event_set_table_intern(&table, &set) != ab);
+    csp_event_set_done(&set);
+    csp_event_set_table_done(&table);
+}
+
+TEST_CASE("child tables share their parent's sets")
+{
+    struct csp_event_set_table parent;
+    struct csp_event_set_table child;
+    const struct csp_event_set *ab;
+    const struct csp_event_set *bc;
+    csp_event_set_table_init(&parent);
+    ab = csp_event_set_table_intern(&parent, event_set("a", "b"));
+    csp_event_set_table_init_child(&child, &parent);
+    check(csp_event_set_table_intern(&child, event_set("a", "b")) == ab);
+    bc = csp_event_set_table_intern(&child, event_set("b", "c"));
+    check(csp_event_set_eq(bc, event_set("b", "c")));
+    check(csp_interned_event_set_id(bc) != csp_interned_event_set_id(ab));
+    check(csp_event_set_table_intern(&child, event_set("b", "c")) == bc);
+    /* Freeing the child doesn't affect the parent's sets. */
+    csp_event_set_table_done(&child);
+    check(csp_event_set_eq(ab, event_set("a", "b")));
+    check(csp_event_set_table_intern(&parent, event_set("a", "b")) == ab);
+    csp_event_set_table_done(&parent);
+}
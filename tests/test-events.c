@@ -7,6 +7,9 @@
 
 #include "event.h"
 
+#include <pthread.h>
+#include <stdio.h>
+
 #include "test-case-harness.h"
 #include "test-cases.h"
 
@@ -25,3 +28,78 @@ TEST_CASE("can create events")
     check_streq(csp_event_name(csp_event_get("b")), "b");
     check_streq(csp_event_name(csp_event_get_sized("b", 1)), "b");
 }
+
+TEST_CASE("events have dense indices")
+{
+    const struct csp_event *first = csp_event_get("dense-first");
+    const struct csp_event *second = csp_event_get("dense-second");
+    check(csp_event_index(second) == csp_event_index(first) + 1);
+    check(csp_event_index(csp_event_get("dense-first")) ==
+          csp_event_index(first));
+    check(csp_event_index(csp_tau()) != csp_event_index(csp_tick()));
+}
+
+TEST_CASE("can create events in bulk")
+{
+    static const char *const names[] = {"bulk-a", "bulk-b", "a", "bulk-a",
+                                        "bulk-c"};
+    static const size_t lengths[] = {6, 6, 1, 6, 6};
+    const struct csp_event *events[5];
+    csp_event_get_many(5, names, lengths, events);
+    check(events[0] == csp_event_get("bulk-a"));
+    check(events[1] == csp_event_get("bulk-b"));
+    check(events[2] == csp_event_get("a"));
+    check(events[3] == events[0]);
+    check(events[4] == csp_event_get("bulk-c"));
+    check_streq(csp_event_name(events[4]), "bulk-c");
+}
+
+#define THREAD_COUNT 8
+#define THREAD_EVENT_COUNT 2000
+
+struct create_events {
+    pthread_t thread;
+    size_t start;
+    const struct csp_event *events[THREAD_EVENT_COUNT];
+};
+
+static void *
+create_events(void *vself)
+{
+    struct create_events *self = vself;
+    size_t i;
+    /* Each thread creates the same events, but in a different order. */
+    for (i = 0; i < THREAD_EVENT_COUNT; i++) {
+        size_t index = (self->start + i) % THREAD_EVENT_COUNT;
+        char name[32];
+        snprintf(name, sizeof(name), "concurrent-%zu", index);
+        self->events[index] = csp_event_get(name);
+    }
+    return NULL;
+}
+
+TEST_CASE("can create events from multiple threads")
+{
+    static struct create_events threads[THREAD_COUNT];
+    struct csp_event_set indices;
+    size_t i;
+    size_t t;
+    for (t = 0; t < THREAD_COUNT; t++) {
+        threads[t].start = t * (THREAD_EVENT_COUNT / THREAD_COUNT);
+        check0(pthread_create(&threads[t].thread, NULL, create_events,
+                              &threads[t]));
+    }
+    for (t = 0; t < THREAD_COUNT; t++) {
+        check0(pthread_join(threads[t].thread, NULL));
+    }
+    /* Every thread should have seen the same event for each name, and each
+     * event should have its own index. */
+    csp_event_set_init(&indices);
+    for (i = 0; i < THREAD_EVENT_COUNT; i++) {
+        for (t = 1; t < THREAD_COUNT; t++) {
+            check(threads[t].events[i] == threads[0].events[i]);
+        }
+        check(csp_event_set_add(&indices, threads[0].events[i]));
+    }
+    csp_event_set_done(&indices);
+}
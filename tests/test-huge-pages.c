@@ -0,0 +1,88 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "huge-pages.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "environment.h"
+#include "id-set.h"
+#include "operators.h"
+#include "test-case-harness.h"
+#include "test-cases.h"
+
+TEST_CASE_GROUP("huge pages");
+
+TEST_CASE("regions are rounded up and aligned")
+{
+    size_t size = 1;
+    unsigned char *region = csp_huge_pages_map(&size);
+    check(size == CSP_HUGE_PAGE_SIZE);
+    check((uintptr_t) region % CSP_HUGE_PAGE_SIZE == 0);
+    /* New regions are zeroed. */
+    check(region[0] == 0 && region[size - 1] == 0);
+    memset(region, 0xaa, size);
+    check(region[size - 1] == 0xaa);
+    csp_huge_pages_unmap(region, size);
+}
+
+TEST_CASE("arenas can use huge pages")
+{
+    struct csp_arena arena;
+    unsigned char *small;
+    unsigned char *large;
+    size_t i;
+    csp_set_huge_pages(true);
+    csp_arena_init(&arena);
+    /* Enough small allocations that the chunks grow past the point where we
+     * start backing them with huge pages. */
+    for (i = 0; i < 40000; i++) {
+        small = csp_arena_alloc(&arena, 64);
+        memset(small, 0x55, 64);
+    }
+    large = csp_arena_alloc(&arena, 3 * 1024 * 1024);
+    memset(large, 0xaa, 3 * 1024 * 1024);
+    check(small[63] == 0x55);
+    check(large[3 * 1024 * 1024 - 1] == 0xaa);
+    csp_arena_done(&arena);
+    csp_set_huge_pages(false);
+}
+
+TEST_CASE("Judy arrays can use huge pages")
+{
+    struct csp_id_set set;
+    csp_id i;
+    csp_set_huge_pages(true);
+    csp_id_set_init(&set);
+    for (i = 0; i < 100000; i++) {
+        csp_id_set_add(&set, i * 0x10001);
+    }
+    check(csp_id_set_size(&set) == 100000);
+    check(csp_id_set_remove(&set, (csp_id) 99999 * 0x10001));
+    check(csp_id_set_size(&set) == 99999);
+    csp_id_set_done(&set);
+    csp_set_huge_pages(false);
+}
+
+TEST_CASE("environments can switch huge pages on and off")
+{
+    struct csp *csp;
+    struct csp_process *process;
+    size_t i;
+    check_alloc(csp, csp_new());
+    process = csp->stop;
+    for (i = 0; i < 1000; i++) {
+        /* Alternate between the two kinds of chunk. */
+        csp_set_huge_pages(i % 100 < 50);
+        process = csp_prefix(csp, csp_event_get("a"), process);
+    }
+    csp_set_huge_pages(false);
+    check(csp_process_count(csp) > 1000);
+    csp_free(csp);
+}
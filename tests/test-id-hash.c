@@ -0,0 +1,194 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "id-hash.h"
+
+#include <stdio.h>
+
+#include "id-set.h"
+#include "test-case-harness.h"
+
+#define COLLISION_COUNT 65536
+#define AVALANCHE_COUNT 1000
+
+/* A deterministic source of well-distributed test inputs (splitmix64). */
+static uint64_t
+next_random(uint64_t *state)
+{
+    uint64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/* Returns whether every hash that `hash` produces for 0 ≤ i < COLLISION_COUNT
+ * is distinct. */
+static bool
+no_collisions(uint64_t (*hash)(size_t i))
+{
+    struct csp_id_set seen;
+    size_t i;
+    bool result = true;
+    csp_id_set_init(&seen);
+    for (i = 0; i < COLLISION_COUNT; i++) {
+        if (!csp_id_set_add(&seen, hash(i))) {
+            result = false;
+        }
+    }
+    csp_id_set_done(&seen);
+    return result;
+}
+
+static uint64_t
+hash_sequential_values(size_t i)
+{
+    return csp_id_hash_word(i, 0);
+}
+
+static uint64_t
+hash_sequential_seeds(size_t i)
+{
+    return csp_id_hash_word(0, i);
+}
+
+static uint64_t
+hash_small_names(size_t i)
+{
+    char name[32];
+    int length = snprintf(name, sizeof(name), "e%zu", i);
+    return csp_id_hash_bytes(name, length, 0);
+}
+
+static uint64_t
+hash_long_names(size_t i)
+{
+    char name[64];
+    int length = snprintf(name, sizeof(name),
+                          "a_fairly_long_process_name_%zu", i);
+    return csp_id_hash_bytes(name, length, 0);
+}
+
+static unsigned int
+count_bits(uint64_t value)
+{
+    return __builtin_popcountll(value);
+}
+
+/* Flips each bit of the input in turn, and returns the average number of output
+ * bits that change.  A good mixer should flip about half of them. */
+static double
+word_value_avalanche(void)
+{
+    uint64_t state = 1;
+    size_t i;
+    unsigned int bit;
+    unsigned long total = 0;
+    for (i = 0; i < AVALANCHE_COUNT; i++) {
+        uint64_t value = next_random(&state);
+        uint64_t seed = next_random(&state);
+        uint64_t hash = csp_id_hash_word(value, seed);
+        for (bit = 0; bit < 64; bit++) {
+            uint64_t flipped = value ^ (UINT64_C(1) << bit);
+            total += count_bits(hash ^ csp_id_hash_word(flipped, seed));
+        }
+    }
+    return (double) total / (AVALANCHE_COUNT * 64);
+}
+
+static double
+word_seed_avalanche(void)
+{
+    uint64_t state = 2;
+    size_t i;
+    unsigned int bit;
+    unsigned long total = 0;
+    for (i = 0; i < AVALANCHE_COUNT; i++) {
+        uint64_t value = next_random(&state);
+        uint64_t seed = next_random(&state);
+        uint64_t hash = csp_id_hash_word(value, seed);
+        for (bit = 0; bit < 64; bit++) {
+            uint64_t flipped = seed ^ (UINT64_C(1) << bit);
+            total += count_bits(hash ^ csp_id_hash_word(value, flipped));
+        }
+    }
+    return (double) total / (AVALANCHE_COUNT * 64);
+}
+
+static double
+bytes_avalanche(size_t length)
+{
+    uint64_t state = 3;
+    uint8_t data[40];
+    size_t i;
+    size_t bit;
+    unsigned long total = 0;
+    for (i = 0; i < AVALANCHE_COUNT; i++) {
+        uint64_t hash;
+        size_t j;
+        for (j = 0; j < length; j++) {
+            data[j] = next_random(&state);
+        }
+        hash = csp_id_hash_bytes(data, length, 0);
+        for (bit = 0; bit < length * 8; bit++) {
+            data[bit / 8] ^= 1 << (bit % 8);
+            total += count_bits(hash ^ csp_id_hash_bytes(data, length, 0));
+            data[bit / 8] ^= 1 << (bit % 8);
+        }
+    }
+    return (double) total / (AVALANCHE_COUNT * length * 8);
+}
+
+static bool
+acceptable_avalanche(double average)
+{
+    return average > 30.0 && average < 34.0;
+}
+
+TEST_CASE_GROUP("ID hashing");
+
+TEST_CASE("word hashes don't collide")
+{
+    check(no_collisions(hash_sequential_values));
+    check(no_collisions(hash_sequential_seeds));
+}
+
+TEST_CASE("name hashes don't collide")
+{
+    check(no_collisions(hash_small_names));
+    check(no_collisions(hash_long_names));
+}
+
+TEST_CASE("word hashes depend on argument order")
+{
+    check(csp_id_hash_word(1, 2) != csp_id_hash_word(2, 1));
+    check(csp_id_hash_word(csp_id_hash_word(1, 0), 2) !=
+          csp_id_hash_word(csp_id_hash_word(2, 0), 1));
+}
+
+TEST_CASE("name hashes depend on length")
+{
+    static const char zeroes[16] = {0};
+    size_t i;
+    for (i = 1; i < sizeof(zeroes); i++) {
+        check(csp_id_hash_bytes(zeroes, i - 1, 0) !=
+              csp_id_hash_bytes(zeroes, i, 0));
+    }
+}
+
+TEST_CASE("word hashes avalanche")
+{
+    check(acceptable_avalanche(word_value_avalanche()));
+    check(acceptable_avalanche(word_seed_avalanche()));
+}
+
+TEST_CASE("name hashes avalanche")
+{
+    check(acceptable_avalanche(bytes_avalanche(3)));
+    check(acceptable_avalanche(bytes_avalanche(8)));
+    check(acceptable_avalanche(bytes_avalanche(13)));
+    check(acceptable_avalanche(bytes_avalanche(40)));
+}
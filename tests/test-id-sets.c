@@ -199,3 +199,329 @@ TEST_CASE("can check subsets")
     check(!csp_id_set_subseteq(id_set(4, 5), id_set(5, 6)));
     check(!csp_id_set_subseteq(id_set(4, 5), id_set(6)));
 }
+
+TEST_CASE("can grow sets past the inline limit")
+{
+    struct csp_id_set set;
+    csp_id i;
+    csp_id_set_init(&set);
+    /* Add elements in descending order so that the inline array has to shift
+     * everything over each time. */
+    for (i = 20; i > 0; i--) {
+        check(csp_id_set_add(&set, i));
+        check(!csp_id_set_add(&set, i));
+        check(csp_id_set_size(&set) == 21 - i);
+    }
+    check_set_eq(&set, id_set(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+                              15, 16, 17, 18, 19, 20));
+    for (i = 1; i <= 20; i++) {
+        check(csp_id_set_remove(&set, i));
+        check(csp_id_set_size(&set) == 20 - i);
+    }
+    check(csp_id_set_empty(&set));
+    /* An emptied set can be refilled. */
+    check(csp_id_set_add(&set, 7));
+    check_set_eq(&set, id_set(7));
+    csp_id_set_done(&set);
+}
+
+TEST_CASE("can compare small and large sets")
+{
+    struct csp_id_set set1;
+    struct csp_id_set set2;
+    csp_id i;
+    csp_id_set_init(&set1);
+    csp_id_set_init(&set2);
+    /* set1 gets promoted and then shrinks back down to 3 elements; set2 stays
+     * inline the whole time. */
+    for (i = 0; i < 12; i++) {
+        csp_id_set_add(&set1, i);
+    }
+    for (i = 3; i < 12; i++) {
+        csp_id_set_remove(&set1, i);
+    }
+    csp_id_set_add(&set2, 2);
+    csp_id_set_add(&set2, 1);
+    csp_id_set_add(&set2, 0);
+    check(csp_id_set_eq(&set1, &set2));
+    check(csp_id_set_eq(&set2, &set1));
+    check(csp_id_set_subseteq(&set1, &set2));
+    check(csp_id_set_subseteq(&set2, &set1));
+    csp_id_set_add(&set2, 100);
+    check(!csp_id_set_eq(&set1, &set2));
+    check(csp_id_set_subseteq(&set1, &set2));
+    check(!csp_id_set_subseteq(&set2, &set1));
+    csp_id_set_done(&set1);
+    csp_id_set_done(&set2);
+}
+
+TEST_CASE("can union sets past the inline limit")
+{
+    struct csp_id_set set1;
+    struct csp_id_set set2;
+    csp_id i;
+    csp_id_set_init(&set1);
+    csp_id_set_init(&set2);
+    for (i = 0; i < 6; i++) {
+        csp_id_set_add(&set1, 2 * i);
+        csp_id_set_add(&set2, 2 * i + 1);
+    }
+    check(csp_id_set_union(&set1, &set2));
+    check(!csp_id_set_union(&set1, &set2));
+    check_set_eq(&set1, id_set(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11));
+    csp_id_set_done(&set1);
+    csp_id_set_done(&set2);
+}
+
+TEST_CASE("can modify a set while iterating through it")
+{
+    struct csp_id_set set;
+    struct csp_id_set_iterator iter;
+    size_t count = 0;
+    csp_id i;
+    csp_id_set_init(&set);
+    for (i = 0; i < 6; i++) {
+        csp_id_set_add(&set, 10 * i);
+    }
+    /* Adding larger elements while iterating will promote the set partway
+     * through; we should still see every element exactly once. */
+    csp_id_set_foreach (&set, &iter) {
+        csp_id id = csp_id_set_iterator_get(&iter);
+        if (id < 1000) {
+            csp_id_set_add(&set, id + 1000);
+        }
+        count++;
+    }
+    check(csp_id_set_size(&set) == 12);
+    check(count == 12);
+    csp_id_set_done(&set);
+}
+
+TEST_CASE("can iterate through large sets")
+{
+    struct csp_id_set set;
+    struct csp_id_set_iterator iter;
+    csp_id expected = 0;
+    csp_id i;
+    csp_id_set_init(&set);
+    /* Large enough to be stored in a Judy array. */
+    for (i = 0; i < 1000; i++) {
+        csp_id_set_add(&set, i);
+    }
+    csp_id_set_foreach (&set, &iter) {
+        check(csp_id_set_iterator_get(&iter) == expected);
+        expected++;
+    }
+    check(expected == 1000);
+    csp_id_set_done(&set);
+}
+
+TEST_CASE("can modify a large set while iterating through it")
+{
+    struct csp_id_set set;
+    struct csp_id_set_iterator iter;
+    size_t count = 0;
+    csp_id i;
+    csp_id_set_init(&set);
+    for (i = 0; i < 200; i++) {
+        csp_id_set_add(&set, 2 * i);
+    }
+    /* Each new element lands just after the current one, so the iterator has
+     * to find it when it looks up the current element's successor. */
+    csp_id_set_foreach (&set, &iter) {
+        csp_id id = csp_id_set_iterator_get(&iter);
+        if (id % 2 == 0) {
+            csp_id_set_add(&set, id + 1);
+        }
+        count++;
+    }
+    check(csp_id_set_size(&set) == 400);
+    check(count == 400);
+    csp_id_set_done(&set);
+}
+
+TEST_CASE("can modify a medium-sized set while iterating through it")
+{
+    struct csp_id_set set;
+    struct csp_id_set_iterator iter;
+    size_t count = 0;
+    csp_id i;
+    /* These sets fit into Judy's root-level leaf, which iterators step through
+     * directly. */
+    csp_id_set_init(&set);
+    for (i = 0; i < 16; i++) {
+        csp_id_set_add(&set, 4 * i);
+    }
+    /* Removing an earlier element shifts the current one down in the leaf. */
+    csp_id_set_foreach (&set, &iter) {
+        csp_id id = csp_id_set_iterator_get(&iter);
+        if (id % 4 == 0) {
+            csp_id_set_add(&set, id + 1);
+            if (id > 0) {
+                csp_id_set_remove(&set, id - 4);
+            }
+        }
+        count++;
+    }
+    check(count == 32);
+    check(csp_id_set_size(&set) == 17);
+    csp_id_set_done(&set);
+    /* And this one outgrows the root leaf partway through. */
+    count = 0;
+    csp_id_set_init(&set);
+    for (i = 0; i < 20; i++) {
+        csp_id_set_add(&set, 2 * i);
+    }
+    csp_id_set_foreach (&set, &iter) {
+        csp_id id = csp_id_set_iterator_get(&iter);
+        if (id % 2 == 0) {
+            csp_id_set_add(&set, id + 1);
+        }
+        count++;
+    }
+    check(count == 40);
+    check(csp_id_set_size(&set) == 40);
+    csp_id_set_done(&set);
+}
+
+TEST_CASE("can add large unsorted batches of ids")
+{
+    struct csp_id_set set1;
+    struct csp_id_set set2;
+    csp_id to_add[300];
+    csp_id i;
+    csp_id_set_init(&set1);
+    csp_id_set_init(&set2);
+    /* Multiples of 3, in descending order, with each one repeated. */
+    for (i = 0; i < 150; i++) {
+        to_add[2 * i] = to_add[2 * i + 1] = 3 * (149 - i);
+    }
+    check(csp_id_set_add_many(&set1, 300, to_add));
+    check(!csp_id_set_add_many(&set1, 300, to_add));
+    check(csp_id_set_size(&set1) == 150);
+    /* Then a batch that overlaps the existing contents. */
+    for (i = 0; i < 300; i++) {
+        to_add[i] = 2 * i;
+    }
+    check(csp_id_set_add_many(&set1, 300, to_add));
+    for (i = 0; i < 600; i++) {
+        if (i % 2 == 0 || (i % 3 == 0 && i < 450)) {
+            csp_id_set_add(&set2, i);
+        }
+    }
+    check(csp_id_set_eq(&set1, &set2));
+    check(csp_id_set_hash(&set1) == csp_id_set_hash(&set2));
+    csp_id_set_done(&set1);
+    csp_id_set_done(&set2);
+}
+
+TEST_CASE("can add batches of every size to an empty set")
+{
+    struct csp_id_set set1;
+    struct csp_id_set set2;
+    csp_id to_add[100];
+    size_t count;
+    csp_id i;
+    for (i = 0; i < 100; i++) {
+        to_add[i] = 7 * i;
+    }
+    /* Building the set from scratch takes different paths for different batch
+     * sizes. */
+    for (count = 1; count <= 100; count++) {
+        csp_id_set_init(&set1);
+        csp_id_set_init(&set2);
+        check(csp_id_set_add_many(&set1, count, to_add));
+        check(csp_id_set_size(&set1) == count);
+        for (i = 0; i < count; i++) {
+            csp_id_set_add(&set2, to_add[i]);
+        }
+        check(csp_id_set_eq(&set1, &set2));
+        check(csp_id_set_hash(&set1) == csp_id_set_hash(&set2));
+        csp_id_set_done(&set1);
+        csp_id_set_done(&set2);
+    }
+}
+
+TEST_CASE("can add small batches to large sets")
+{
+    struct csp_id_set set1;
+    struct csp_id_set set2;
+    csp_id to_add[20];
+    csp_id i;
+    csp_id_set_init(&set1);
+    csp_id_set_init(&set2);
+    for (i = 0; i < 1000; i++) {
+        csp_id_set_add(&set1, 2 * i);
+        csp_id_set_add(&set2, 2 * i);
+    }
+    /* Half of these are already in the set. */
+    for (i = 0; i < 20; i++) {
+        to_add[i] = 1000 + i;
+        csp_id_set_add(&set2, 1000 + i);
+    }
+    check(csp_id_set_add_many(&set1, 20, to_add));
+    check(!csp_id_set_add_many(&set1, 20, to_add));
+    check(csp_id_set_size(&set1) == 1010);
+    check(csp_id_set_eq(&set1, &set2));
+    check(csp_id_set_hash(&set1) == csp_id_set_hash(&set2));
+    csp_id_set_done(&set1);
+    csp_id_set_done(&set2);
+}
+
+TEST_CASE("can union large sets")
+{
+    struct csp_id_set set1;
+    struct csp_id_set set2;
+    struct csp_id_set set3;
+    csp_id i;
+    csp_id_set_init(&set1);
+    csp_id_set_init(&set2);
+    csp_id_set_init(&set3);
+    for (i = 0; i < 500; i++) {
+        csp_id_set_add(&set1, 2 * i);
+        csp_id_set_add(&set2, 3 * i);
+        csp_id_set_add(&set3, 2 * i);
+    }
+    for (i = 0; i < 500; i++) {
+        csp_id_set_add(&set3, 3 * i);
+    }
+    check(csp_id_set_union(&set1, &set2));
+    check(!csp_id_set_union(&set1, &set2));
+    check(csp_id_set_eq(&set1, &set3));
+    check(csp_id_set_hash(&set1) == csp_id_set_hash(&set3));
+    csp_id_set_done(&set1);
+    csp_id_set_done(&set2);
+    csp_id_set_done(&set3);
+}
+
+TEST_CASE("hashes only depend on contents")
+{
+    struct csp_id_set set1;
+    struct csp_id_set set2;
+    csp_id i;
+    csp_id_set_init(&set1);
+    csp_id_set_init(&set2);
+    check(csp_id_set_hash(&set1) == csp_id_set_hash(&set2));
+    /* set1 grows past the inline limit and then shrinks; set2 is built up
+     * directly, in a different order. */
+    for (i = 0; i < 20; i++) {
+        csp_id_set_add(&set1, i);
+    }
+    for (i = 5; i < 20; i++) {
+        csp_id_set_remove(&set1, i);
+    }
+    for (i = 5; i > 0; i--) {
+        csp_id_set_add(&set2, i - 1);
+    }
+    check(csp_id_set_size(&set1) == 5);
+    check(csp_id_set_hash(&set1) == csp_id_set_hash(&set2));
+    csp_id_set_remove(&set2, 3);
+    check(csp_id_set_size(&set2) == 4);
+    check(csp_id_set_hash(&set1) != csp_id_set_hash(&set2));
+    csp_id_set_clear(&set1);
+    csp_id_set_clear(&set2);
+    check(csp_id_set_empty(&set1));
+    check(csp_id_set_hash(&set1) == csp_id_set_hash(&set2));
+    csp_id_set_done(&set1);
+    csp_id_set_done(&set2);
+}
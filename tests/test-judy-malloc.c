@@ -0,0 +1,120 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "Judy.h"
+#include "id-set.h"
+#include "test-case-harness.h"
+#include "test-cases.h"
+
+#define OBJECT_COUNT 1000
+#define MAX_SEARCH 100000
+
+static void *
+allocate(Word_t words)
+{
+    return (void *) JudyMalloc(words);
+}
+
+struct free_objects {
+    void **objects;
+    size_t count;
+    Word_t words;
+};
+
+static void *
+free_objects(void *vself)
+{
+    struct free_objects *self = vself;
+    size_t i;
+    for (i = 0; i < self->count; i++) {
+        JudyFree(self->objects[i], self->words);
+    }
+    return NULL;
+}
+
+TEST_CASE_GROUP("Judy allocator");
+
+TEST_CASE("allocates distinct, aligned objects of every size")
+{
+    static void *objects[70][8];
+    struct csp_id_set seen;
+    Word_t words;
+    size_t i;
+    csp_id_set_init(&seen);
+    for (words = 1; words < 70; words++) {
+        for (i = 0; i < 8; i++) {
+            Word_t *object = allocate(words);
+            check_nonnull(object);
+            check(((uintptr_t) object % sizeof(Word_t)) == 0);
+            check(csp_id_set_add(&seen, (uintptr_t) object));
+            /* Every word of the object must be usable. */
+            object[0] = words;
+            object[words - 1] = words;
+            objects[words][i] = object;
+        }
+    }
+    for (words = 1; words < 70; words++) {
+        for (i = 0; i < 8; i++) {
+            Word_t *object = objects[words][i];
+            check(object[0] == words && object[words - 1] == words);
+            JudyFree(object, words);
+        }
+    }
+    csp_id_set_done(&seen);
+}
+
+TEST_CASE("reuses freed objects")
+{
+    void *object = allocate(3);
+    JudyFree(object, 3);
+    check(allocate(3) == object);
+    JudyFree(object, 3);
+}
+
+TEST_CASE("objects freed on another thread are returned to their owner")
+{
+    static void *objects[OBJECT_COUNT];
+    struct free_objects freer = {objects, OBJECT_COUNT, 5};
+    struct csp_id_set remaining;
+    pthread_t thread;
+    size_t i;
+    void **reused;
+    size_t reused_count = 0;
+    csp_id_set_init(&remaining);
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        objects[i] = allocate(5);
+        csp_id_set_add(&remaining, (uintptr_t) objects[i]);
+    }
+    /* Free all of the objects from some other thread. */
+    check0(pthread_create(&thread, NULL, free_objects, &freer));
+    check0(pthread_join(thread, NULL));
+    /* Now keep allocating until we've gotten all of them back.  (This thread
+     * might have had some other free objects lying around first.) */
+    check_alloc(reused, malloc(MAX_SEARCH * sizeof(void *)));
+    while (!csp_id_set_empty(&remaining) && reused_count < MAX_SEARCH) {
+        void *object = allocate(5);
+        csp_id_set_remove(&remaining, (uintptr_t) object);
+        reused[reused_count++] = object;
+    }
+    check(csp_id_set_empty(&remaining));
+    for (i = 0; i < reused_count; i++) {
+        JudyFree(reused[i], 5);
+    }
+    free(reused);
+    csp_id_set_done(&remaining);
+}
+
+TEST_CASE("can allocate large objects")
+{
+    Word_t *object = allocate(1000);
+    check_nonnull(object);
+    object[999] = 1;
+    JudyFree(object, 1000);
+}
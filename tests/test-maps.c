@@ -0,0 +1,167 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "map.h"
+
+#include "id-set.h"
+#include "test-case-harness.h"
+
+/* Every test runs against both map backends. */
+static void
+init_map(struct csp_map *map, enum csp_map_backend backend)
+{
+    if (backend == CSP_MAP_HASHED) {
+        csp_map_init_hashed(map);
+    } else {
+        csp_map_init(map);
+    }
+}
+
+static const enum csp_map_backend backends[] = {CSP_MAP_ORDERED,
+                                                CSP_MAP_HASHED};
+#define BACKEND_COUNT (sizeof(backends) / sizeof(backends[0]))
+
+/* Spread the test keys out a bit, so that they don't all land in the same
+ * corner of the key space. */
+static csp_id
+key(size_t i)
+{
+    return (csp_id) i * UINT64_C(0x9e3779b97f4a7c15);
+}
+
+static void *
+value(size_t i)
+{
+    return (void *) (uintptr_t) (i + 1);
+}
+
+static void
+count_entry(void *ud, void *entry)
+{
+    size_t *count = ud;
+    (*count)++;
+}
+
+TEST_CASE_GROUP("maps");
+
+TEST_CASE("can create empty map")
+{
+    size_t b;
+    for (b = 0; b < BACKEND_COUNT; b++) {
+        struct csp_map map;
+        struct csp_map_iterator iter;
+        init_map(&map, backends[b]);
+        check(csp_map_empty(&map));
+        check(csp_map_size(&map) == 0);
+        check(csp_map_get(&map, key(0)) == NULL);
+        csp_map_remove(&map, key(0), NULL, NULL);
+        csp_map_get_iterator(&map, &iter);
+        check(csp_map_iterator_done(&iter));
+        csp_map_done(&map, NULL, NULL);
+    }
+}
+
+TEST_CASE("can add and look up entries")
+{
+    size_t b;
+    for (b = 0; b < BACKEND_COUNT; b++) {
+        struct csp_map map;
+        size_t i;
+        init_map(&map, backends[b]);
+        for (i = 0; i < 1000; i++) {
+            void **entry = csp_map_at(&map, key(i));
+            check(*entry == NULL);
+            *entry = value(i);
+        }
+        check(!csp_map_empty(&map));
+        check(csp_map_size(&map) == 1000);
+        for (i = 0; i < 1000; i++) {
+            check(csp_map_get(&map, key(i)) == value(i));
+            check(*csp_map_at(&map, key(i)) == value(i));
+        }
+        check(csp_map_get(&map, key(1000)) == NULL);
+        check(csp_map_size(&map) == 1000);
+        csp_map_done(&map, NULL, NULL);
+    }
+}
+
+TEST_CASE("can remove entries")
+{
+    size_t b;
+    for (b = 0; b < BACKEND_COUNT; b++) {
+        struct csp_map map;
+        size_t i;
+        size_t round;
+        init_map(&map, backends[b]);
+        /* Repeatedly removing and re-adding entries exercises tombstones in
+         * the hash table backend. */
+        for (round = 0; round < 5; round++) {
+            for (i = 0; i < 500; i++) {
+                *csp_map_at(&map, key(i)) = value(i);
+            }
+            for (i = 0; i < 500; i += 2) {
+                csp_map_remove(&map, key(i), NULL, NULL);
+            }
+            check(csp_map_size(&map) == 250);
+        }
+        for (i = 0; i < 500; i++) {
+            if (i % 2 == 0) {
+                check(csp_map_get(&map, key(i)) == NULL);
+            } else {
+                check(csp_map_get(&map, key(i)) == value(i));
+            }
+        }
+        for (i = 1; i < 500; i += 2) {
+            csp_map_remove(&map, key(i), NULL, NULL);
+        }
+        check(csp_map_empty(&map));
+        csp_map_done(&map, NULL, NULL);
+    }
+}
+
+TEST_CASE("can iterate through entries")
+{
+    size_t b;
+    for (b = 0; b < BACKEND_COUNT; b++) {
+        struct csp_map map;
+        struct csp_map_iterator iter;
+        struct csp_id_set seen;
+        size_t i;
+        init_map(&map, backends[b]);
+        csp_id_set_init(&seen);
+        for (i = 0; i < 300; i++) {
+            *csp_map_at(&map, key(i)) = value(i);
+        }
+        csp_map_foreach (&map, &iter) {
+            check(csp_id_set_add(&seen, iter.key));
+        }
+        check(csp_id_set_size(&seen) == 300);
+        for (i = 0; i < 300; i++) {
+            check(!csp_id_set_add(&seen, key(i)));
+        }
+        csp_id_set_done(&seen);
+        csp_map_done(&map, NULL, NULL);
+    }
+}
+
+TEST_CASE("frees every entry")
+{
+    size_t b;
+    for (b = 0; b < BACKEND_COUNT; b++) {
+        struct csp_map map;
+        size_t i;
+        size_t count = 0;
+        init_map(&map, backends[b]);
+        for (i = 0; i < 100; i++) {
+            *csp_map_at(&map, key(i)) = value(i);
+        }
+        csp_map_remove(&map, key(0), count_entry, &count);
+        check(count == 1);
+        csp_map_done(&map, count_entry, &count);
+        check(count == 100);
+    }
+}
@@ -0,0 +1,138 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "memory.h"
+
+#include <string.h>
+
+#include "environment.h"
+#include "event.h"
+#include "id-set.h"
+#include "operators.h"
+#include "test-case-harness.h"
+#include "test-cases.h"
+
+/* The counters are shared by the whole process, so these tests only look at
+ * how they change, not at their absolute values. */
+
+static bool
+streq(const char *str1, const char *str2)
+{
+    return strcmp(str1, str2) == 0;
+}
+
+static size_t
+current_bytes(enum csp_memory_category category)
+{
+    struct csp_memory_stats stats;
+    csp_memory_stats(&stats);
+    return stats.categories[category].current_bytes;
+}
+
+static void
+create_processes(struct csp *csp, size_t count)
+{
+    struct csp_process *process = csp->stop;
+    size_t i;
+    for (i = 0; i < count; i++) {
+        process = csp_prefix(csp, csp_event_get("a"), process);
+    }
+}
+
+TEST_CASE_GROUP("memory accounting");
+
+TEST_CASE("categories have names")
+{
+    check(streq(csp_memory_category_name(CSP_MEMORY_JUDY), "judy"));
+    check(streq(csp_memory_category_name(CSP_MEMORY_PROCESSES), "processes"));
+    check(streq(csp_memory_category_name(CSP_MEMORY_REGISTRY), "registry"));
+    check(streq(csp_memory_category_name(CSP_MEMORY_EQUIVALENCES),
+                "equivalences"));
+    check(streq(csp_memory_category_name(CSP_MEMORY_EVENTS), "events"));
+}
+
+TEST_CASE("peaks are never less than current usage")
+{
+    struct csp_memory_stats stats;
+    enum csp_memory_category category;
+    csp_memory_stats(&stats);
+    for (category = 0; category < CSP_MEMORY_CATEGORY_COUNT; category++) {
+        check(stats.categories[category].peak_bytes >=
+              stats.categories[category].current_bytes);
+    }
+    check(stats.judy_slab_bytes >= stats.judy_free_list_bytes);
+}
+
+TEST_CASE("environments give back their process and registry memory")
+{
+    size_t processes_before = current_bytes(CSP_MEMORY_PROCESSES);
+    size_t registry_before = current_bytes(CSP_MEMORY_REGISTRY);
+    struct csp *csp;
+    check_alloc(csp, csp_new());
+    create_processes(csp, 1000);
+    check(current_bytes(CSP_MEMORY_PROCESSES) > processes_before);
+    check(current_bytes(CSP_MEMORY_REGISTRY) > registry_before);
+    csp_free(csp);
+    check(current_bytes(CSP_MEMORY_PROCESSES) == processes_before);
+    check(current_bytes(CSP_MEMORY_REGISTRY) == registry_before);
+}
+
+TEST_CASE("sessions give back their process memory")
+{
+    struct csp *csp;
+    size_t processes_before;
+    check_alloc(csp, csp_new());
+    processes_before = current_bytes(CSP_MEMORY_PROCESSES);
+    csp_session_begin(csp);
+    create_processes(csp, 1000);
+    check(current_bytes(CSP_MEMORY_PROCESSES) > processes_before);
+    csp_session_end(csp);
+    check(current_bytes(CSP_MEMORY_PROCESSES) == processes_before);
+    csp_free(csp);
+}
+
+TEST_CASE("sessions give back their interned event sets")
+{
+    struct csp *csp;
+    const struct csp_event_set *set;
+    size_t events_before;
+    check_alloc(csp, csp_new());
+    /* Create the events up front, since those are never freed. */
+    set = event_set("session event 1", "session event 2");
+    events_before = current_bytes(CSP_MEMORY_EVENTS);
+    csp_session_begin(csp);
+    csp_intern_event_set(csp, set);
+    check(current_bytes(CSP_MEMORY_EVENTS) > events_before);
+    csp_session_end(csp);
+    check(current_bytes(CSP_MEMORY_EVENTS) == events_before);
+    csp_free(csp);
+}
+
+TEST_CASE("new events are counted")
+{
+    size_t events_before = current_bytes(CSP_MEMORY_EVENTS);
+    csp_event_get("an event that only the memory accounting tests use");
+    check(current_bytes(CSP_MEMORY_EVENTS) > events_before);
+}
+
+TEST_CASE("Judy allocations are counted")
+{
+    struct csp_memory_stats stats;
+    size_t judy_before = current_bytes(CSP_MEMORY_JUDY);
+    struct csp_id_set set;
+    csp_id i;
+    csp_id_set_init(&set);
+    /* Spread the IDs out so that Judy can't compress them, and add enough of
+     * them to get past the per-thread batching. */
+    for (i = 0; i < 100000; i++) {
+        csp_id_set_add(&set, i * 0x10001);
+    }
+    csp_memory_stats(&stats);
+    check(stats.categories[CSP_MEMORY_JUDY].current_bytes > judy_before);
+    check(stats.judy_slab_bytes > 0);
+    csp_id_set_done(&set);
+}
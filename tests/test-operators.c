@@ -160,7 +160,7 @@ check_process_traces_behavior_(const char *filename, unsigned int line,
     process = csp_process_factory_create(csp, process_);
     expected_initials = csp_event_set_factory_create(csp, expected_initials_);
     csp_process_get_behavior(csp, process, CSP_TRACES, &behavior);
-    check_event_set_eq_(filename, line, &behavior.initials, expected_initials);
+    check_event_set_eq_(filename, line, behavior.initials, expected_initials);
     csp_behavior_done(&behavior);
     csp_free(csp);
 }
@@ -168,13 +168,11 @@ check_process_traces_behavior_(const char *filename, unsigned int line,
     ADD_FILE_AND_LINE(check_process_traces_behavior_)
 
 /* Verify that the given CSP₀ process has a particular trace, and every prefix
- * of that trace. */
+ * of that trace.  `process` must belong to `csp`. */
 static void
-check_process_trace(const char *filename, unsigned int line,
+check_process_trace(const char *filename, unsigned int line, struct csp *csp,
                     struct csp_process *process, const struct csp_trace *trace)
 {
-    struct csp *csp;
-    check_alloc(csp, csp_new());
     while (true) {
         check_with_msg_(filename, line,
                         csp_process_has_trace(csp, process, trace),
@@ -184,7 +182,6 @@ check_process_trace(const char *filename, unsigned int line,
         }
         trace = trace->prev;
     }
-    csp_free(csp);
 }
 
 struct csp_check_trace {
@@ -261,7 +258,7 @@ check_process_maximal_traces_(const char *filename, unsigned int line,
     /* First verify that each of the traces passed in is a trace of the process,
      * and that each prefix of that trace is, too. */
     for (i = 0; i < traces_->count; i++) {
-        check_process_trace(filename, line, process, traces[i]);
+        check_process_trace(filename, line, csp, process, traces[i]);
     }
     /* Then verify that it's also the list of maximal traces for the process. */
     check_trace = csp_check_trace(filename, line, traces_->count, traces);
@@ -347,7 +344,7 @@ check_process_sub_traces_behavior_(
     subprocess = csp_process_factory_create(csp, subprocess_);
     expected_initials = csp_event_set_factory_create(csp, expected_initials_);
     csp_process_get_behavior(csp, subprocess, CSP_TRACES, &behavior);
-    check_event_set_eq_(filename, line, &behavior.initials, expected_initials);
+    check_event_set_eq_(filename, line, behavior.initials, expected_initials);
     csp_behavior_done(&behavior);
     csp_free(csp);
 }
@@ -0,0 +1,192 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "persistent-bag.h"
+
+#include "environment.h"
+#include "process.h"
+#include "test-case-harness.h"
+
+#define PROCESS_COUNT 100
+
+/* Persistent bags only look at a process's ID and index, so we don't need real
+ * processes to test them.  (We still need an environment, since that's where
+ * the bags allocate their nodes.) */
+static struct csp_process processes[PROCESS_COUNT];
+
+static struct csp_process *
+process(size_t i)
+{
+    processes[i].id = (csp_id) i * UINT64_C(0x9e3779b97f4a7c15) + 1;
+    processes[i].iface = NULL;
+    processes[i].index = i;
+    return &processes[i];
+}
+
+/* Checks that iterating through `bag` yields `expected` (which must be sorted
+ * by index), with the right multiplicities. */
+static bool
+bag_has(const struct csp_persistent_bag *bag, size_t count,
+        const size_t *expected)
+{
+    struct csp_persistent_bag_iterator iter;
+    size_t i = 0;
+    csp_persistent_bag_foreach (bag, &iter) {
+        struct csp_process *p = csp_persistent_bag_iterator_get(&iter);
+        size_t j;
+        for (j = 0; j < csp_persistent_bag_iterator_get_count(&iter); j++) {
+            if (i >= count || p != process(expected[i++])) {
+                return false;
+            }
+        }
+    }
+    return i == count && csp_persistent_bag_size(bag) == count;
+}
+
+#define check_bag(bag, ...)                                           \
+    do {                                                              \
+        size_t __expected[] = {__VA_ARGS__};                          \
+        check(bag_has((bag), sizeof(__expected) / sizeof(size_t),     \
+                      __expected));                                   \
+    } while (0)
+
+TEST_CASE_GROUP("persistent bags");
+
+TEST_CASE("can create empty bag")
+{
+    struct csp *csp;
+    struct csp_persistent_bag bag;
+    struct csp_persistent_bag_iterator iter;
+    check_alloc(csp, csp_new());
+    csp_persistent_bag_init(&bag);
+    check(csp_persistent_bag_empty(&bag));
+    check(csp_persistent_bag_size(&bag) == 0);
+    check(csp_persistent_bag_hash(&bag) == 0);
+    csp_persistent_bag_get_iterator(&bag, &iter);
+    check(csp_persistent_bag_iterator_done(&iter));
+    csp_persistent_bag_done(csp, &bag);
+    csp_free(csp);
+}
+
+TEST_CASE("can add and remove duplicates")
+{
+    struct csp *csp;
+    struct csp_persistent_bag bag;
+    check_alloc(csp, csp_new());
+    csp_persistent_bag_init(&bag);
+    csp_persistent_bag_add(csp, &bag, process(3));
+    csp_persistent_bag_add(csp, &bag, process(1));
+    csp_persistent_bag_add(csp, &bag, process(3));
+    check(!csp_persistent_bag_empty(&bag));
+    check_bag(&bag, 1, 3, 3);
+    csp_persistent_bag_remove(csp, &bag, process(3));
+    check_bag(&bag, 1, 3);
+    csp_persistent_bag_remove(csp, &bag, process(1));
+    check_bag(&bag, 3);
+    csp_persistent_bag_remove(csp, &bag, process(3));
+    check(csp_persistent_bag_empty(&bag));
+    csp_persistent_bag_done(csp, &bag);
+    csp_free(csp);
+}
+
+TEST_CASE("iterates in index order")
+{
+    struct csp *csp;
+    struct csp_persistent_bag bag;
+    struct csp_persistent_bag_iterator iter;
+    size_t i;
+    size_t expected = 0;
+    check_alloc(csp, csp_new());
+    csp_persistent_bag_init(&bag);
+    /* 37 is coprime to PROCESS_COUNT, so this visits every process once. */
+    for (i = 0; i < PROCESS_COUNT; i++) {
+        csp_persistent_bag_add(csp, &bag, process((i * 37) % PROCESS_COUNT));
+    }
+    check(csp_persistent_bag_size(&bag) == PROCESS_COUNT);
+    csp_persistent_bag_foreach (&bag, &iter) {
+        check(csp_persistent_bag_iterator_get(&iter) == process(expected++));
+        check(csp_persistent_bag_iterator_get_count(&iter) == 1);
+    }
+    check(expected == PROCESS_COUNT);
+    csp_persistent_bag_done(csp, &bag);
+    csp_free(csp);
+}
+
+TEST_CASE("copies are independent")
+{
+    struct csp *csp;
+    struct csp_persistent_bag bag1;
+    struct csp_persistent_bag bag2;
+    struct csp_persistent_bag bag3;
+    check_alloc(csp, csp_new());
+    csp_persistent_bag_init(&bag1);
+    csp_persistent_bag_add(csp, &bag1, process(1));
+    csp_persistent_bag_add(csp, &bag1, process(2));
+    csp_persistent_bag_add(csp, &bag1, process(5));
+    csp_persistent_bag_init_copy(&bag2, &bag1);
+    csp_persistent_bag_init_copy(&bag3, &bag1);
+    check(csp_persistent_bag_hash(&bag1) == csp_persistent_bag_hash(&bag2));
+    csp_persistent_bag_remove(csp, &bag2, process(2));
+    csp_persistent_bag_add(csp, &bag2, process(4));
+    csp_persistent_bag_add(csp, &bag3, process(1));
+    check_bag(&bag1, 1, 2, 5);
+    check_bag(&bag2, 1, 4, 5);
+    check_bag(&bag3, 1, 1, 2, 5);
+    check(csp_persistent_bag_hash(&bag1) != csp_persistent_bag_hash(&bag2));
+    check(csp_persistent_bag_hash(&bag1) != csp_persistent_bag_hash(&bag3));
+    /* Releasing the original must not affect the copies. */
+    csp_persistent_bag_done(csp, &bag1);
+    check_bag(&bag2, 1, 4, 5);
+    check_bag(&bag3, 1, 1, 2, 5);
+    csp_persistent_bag_done(csp, &bag2);
+    csp_persistent_bag_done(csp, &bag3);
+    csp_free(csp);
+}
+
+TEST_CASE("hash doesn't depend on construction order")
+{
+    struct csp *csp;
+    struct csp_persistent_bag bag1;
+    struct csp_persistent_bag bag2;
+    size_t i;
+    check_alloc(csp, csp_new());
+    csp_persistent_bag_init(&bag1);
+    csp_persistent_bag_init(&bag2);
+    for (i = 0; i < PROCESS_COUNT; i++) {
+        csp_persistent_bag_add(csp, &bag1, process(i));
+        csp_persistent_bag_add(csp, &bag2, process(PROCESS_COUNT - 1 - i));
+    }
+    /* Take a detour through some extra processes in one of the bags. */
+    csp_persistent_bag_add(csp, &bag2, process(7));
+    csp_persistent_bag_add(csp, &bag2, process(50));
+    check(csp_persistent_bag_hash(&bag1) != csp_persistent_bag_hash(&bag2));
+    csp_persistent_bag_remove(csp, &bag2, process(50));
+    csp_persistent_bag_remove(csp, &bag2, process(7));
+    check(csp_persistent_bag_size(&bag1) == csp_persistent_bag_size(&bag2));
+    check(csp_persistent_bag_hash(&bag1) == csp_persistent_bag_hash(&bag2));
+    csp_persistent_bag_done(csp, &bag1);
+    csp_persistent_bag_done(csp, &bag2);
+    csp_free(csp);
+}
+
+TEST_CASE("nodes are charged to the environment")
+{
+    struct csp *csp;
+    struct csp_persistent_bag bag;
+    size_t before;
+    size_t i;
+    check_alloc(csp, csp_new());
+    before = csp_memory_usage(csp);
+    csp_persistent_bag_init(&bag);
+    for (i = 0; i < PROCESS_COUNT; i++) {
+        csp_persistent_bag_add(csp, &bag, process(i));
+    }
+    check(csp_memory_usage(csp) >= before + PROCESS_COUNT * sizeof(void *));
+    csp_persistent_bag_done(csp, &bag);
+    check(csp_memory_usage(csp) == before);
+    csp_free(csp);
+}
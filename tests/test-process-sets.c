@@ -109,3 +109,17 @@ TEST_CASE("can compare sets")
     csp_process_set_done(&set1);
     csp_process_set_done(&set2);
 }
+
+TEST_CASE("can check subsets")
+{
+    check(csp_process_set_subseteq(process_set(), process_set()));
+    check(csp_process_set_subseteq(process_set(), process_set(&p0)));
+    check(!csp_process_set_subseteq(process_set(&p2), process_set()));
+    check(!csp_process_set_subseteq(process_set(&p2), process_set(&p1)));
+    check(csp_process_set_subseteq(process_set(&p2), process_set(&p1, &p2)));
+    check(csp_process_set_subseteq(process_set(&p1, &p2),
+                                   process_set(&p0, &p1, &p2)));
+    check(!csp_process_set_subseteq(process_set(&p1, &p2),
+                                    process_set(&p0, &p2)));
+    check(!csp_process_set_subseteq(process_set(&p1, &p2), process_set(&p1)));
+}
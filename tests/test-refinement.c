@@ -14,7 +14,9 @@
 #include "environment.h"
 #include "event.h"
 #include "id-set.h"
+#include "memory.h"
 #include "normalization.h"
+#include "operators.h"
 #include "test-case-harness.h"
 #include "test-cases.h"
 
@@ -293,35 +295,183 @@ TEST_CASE("a→a→STOP ~ a→a→STOP (single head)") {
 }
 
 /*------------------------------------------------------------------------------
- * Traces refinement
+ * Spec preparation
  */
 
 static void
-check_traces_refinement(struct csp_process_factory spec_,
-                        struct csp_process_factory impl_)
+check_survey_(const char *filename, unsigned int line,
+              struct csp_process_factory process_, size_t max_nodes,
+              size_t expected_node_count,
+              size_t expected_nondeterministic_count, bool expected_truncated)
+{
+    struct csp *csp;
+    struct csp_process *process;
+    struct csp_process *prenormalized;
+    struct csp_prenormalized_survey survey;
+    check_alloc(csp, csp_new());
+    process = csp_process_factory_create(csp, process_);
+    prenormalized = csp_prenormalize_process(csp, process);
+    csp_survey_prenormalized_process(csp, prenormalized, max_nodes, &survey);
+    check_with_msg_(filename, line,
+                    survey.node_count == expected_node_count,
+                    "Unexpected node count: got %zu, expected %zu",
+                    survey.node_count, expected_node_count);
+    check_with_msg_(filename, line,
+                    survey.nondeterministic_count ==
+                            expected_nondeterministic_count,
+                    "Unexpected nondeterministic count: got %zu, expected %zu",
+                    survey.nondeterministic_count,
+                    expected_nondeterministic_count);
+    check_(filename, line, survey.truncated == expected_truncated);
+    csp_free(csp);
+}
+#define check_survey ADD_FILE_AND_LINE(check_survey_)
+
+static void
+check_chosen_spec_preparation_(const char *filename, unsigned int line,
+                               struct csp_process_factory spec_,
+                               struct csp_process_factory impl_,
+                               enum csp_spec_preparation expected)
 {
     struct csp *csp;
     struct csp_process *spec;
     struct csp_process *impl;
+    struct csp_refinement_options options = csp_refinement_options();
+    struct csp_refinement_stats stats;
     check_alloc(csp, csp_new());
     spec = csp_process_factory_create(csp, spec_);
     impl = csp_process_factory_create(csp, impl_);
-    check(csp_check_traces_refinement(csp, spec, impl));
+    check_(filename, line, options.spec_preparation == CSP_SPEC_AUTO);
+    csp_check_traces_refinement_with(csp, spec, impl, &options, &stats);
+    check_with_msg_(filename, line, stats.spec_preparation == expected,
+                    "Unexpected spec preparation: got %d, expected %d",
+                    (int) stats.spec_preparation, (int) expected);
     csp_free(csp);
 }
+#define check_chosen_spec_preparation \
+    ADD_FILE_AND_LINE(check_chosen_spec_preparation_)
 
-static void
-xcheck_traces_refinement(struct csp_process_factory spec_,
-                         struct csp_process_factory impl_)
+TEST_CASE_GROUP("spec preparation");
+
+TEST_CASE("survey prenormalized processes")
+{
+    check_survey(csp0("STOP"), 100, 1, 0, false);
+    check_survey(csp0("a → STOP □ b → STOP"), 100, 2, 0, false);
+    check_survey(csp0("a → b → STOP"), 100, 3, 0, false);
+    check_survey(csp0("a → b → STOP"), 2, 2, 0, true);
+    check_survey(csp0("a → STOP ⊓ b → STOP"), 100, 2, 1, false);
+    check_survey(csp0("a → b → STOP □ a → c → STOP"), 100, 3, 1, false);
+}
+
+TEST_CASE("deterministic specs are used directly")
+{
+    check_chosen_spec_preparation(csp0("STOP"), csp0("STOP"),
+                                  CSP_SPEC_DIRECT);
+    check_chosen_spec_preparation(csp0("a → STOP □ b → STOP"),
+                                  csp0("a → STOP"), CSP_SPEC_DIRECT);
+    check_chosen_spec_preparation(csp0("a → STOP □ a → STOP"),
+                                  csp0("a → STOP"), CSP_SPEC_DIRECT);
+}
+
+TEST_CASE("small nondeterministic specs are normalized")
+{
+    check_chosen_spec_preparation(csp0("a → STOP ⊓ b → STOP"),
+                                  csp0("a → STOP"), CSP_SPEC_NORMALIZE);
+    check_chosen_spec_preparation(csp0("a → b → STOP □ a → c → STOP"),
+                                  csp0("a → b → STOP"), CSP_SPEC_NORMALIZE);
+}
+
+/*------------------------------------------------------------------------------
+ * Traces refinement
+ */
+
+/* Every traces refinement test is run once for each of these engine and Spec
+ * preparation combinations; they must all agree. */
+static const struct csp_refinement_options refinement_configurations[] = {
+        {CSP_REFINEMENT_NORMALIZATION, CSP_SPEC_NORMALIZE},
+        {CSP_REFINEMENT_NORMALIZATION, CSP_SPEC_PRENORMALIZE},
+        {CSP_REFINEMENT_NORMALIZATION, CSP_SPEC_AUTO},
+        {CSP_REFINEMENT_ANTICHAINS, CSP_SPEC_AUTO},
+        {CSP_REFINEMENT_HKC, CSP_SPEC_AUTO}};
+#define REFINEMENT_CONFIGURATION_COUNT         \
+    (sizeof(refinement_configurations) /       \
+     sizeof(refinement_configurations[0]))
+
+/* If `collect_garbage` is true, we set the lowest possible high-water mark, so
+ * that the check collects garbage after every round of pairs. */
+static bool
+traces_refinement_holds(struct csp_process_factory spec_,
+                        struct csp_process_factory impl_,
+                        const struct csp_refinement_options *options,
+                        bool collect_garbage)
 {
     struct csp *csp;
     struct csp_process *spec;
     struct csp_process *impl;
+    struct csp_refinement_stats stats;
+    bool result;
     check_alloc(csp, csp_new());
+    if (collect_garbage) {
+        csp_set_gc_high_water_mark(csp, 1);
+    }
     spec = csp_process_factory_create(csp, spec_);
     impl = csp_process_factory_create(csp, impl_);
-    check(!csp_check_traces_refinement(csp, spec, impl));
+    result = csp_check_traces_refinement_with(csp, spec, impl, options,
+                                              &stats);
+    check(stats.engine == options->engine);
+    check(stats.spec_preparation != CSP_SPEC_AUTO);
+    if (options->engine != CSP_REFINEMENT_NORMALIZATION) {
+        check(stats.spec_preparation == CSP_SPEC_PRENORMALIZE);
+    } else {
+        check(options->spec_preparation == CSP_SPEC_AUTO ||
+              stats.spec_preparation == options->spec_preparation);
+        check(stats.subsumed_count == 0);
+    }
+    if (options->engine == CSP_REFINEMENT_HKC) {
+        /* HKC can skip even the initial pair, if Spec ∪ Impl and Spec have the
+         * same prenormalized node. */
+        check(stats.pair_count + stats.subsumed_count > 0);
+    } else {
+        check(stats.pair_count > 0);
+    }
     csp_free(csp);
+    return result;
+}
+
+static void
+check_traces_refinement(struct csp_process_factory spec_,
+                        struct csp_process_factory impl_)
+{
+    size_t i;
+    for (i = 0; i < REFINEMENT_CONFIGURATION_COUNT; i++) {
+        check_with_msg(traces_refinement_holds(spec_, impl_,
+                                               &refinement_configurations[i],
+                                               false),
+                       "Refinement should hold (configuration %zu)", i);
+        check_with_msg(traces_refinement_holds(spec_, impl_,
+                                               &refinement_configurations[i],
+                                               true),
+                       "Refinement should hold (configuration %zu with GC)",
+                       i);
+    }
+}
+
+static void
+xcheck_traces_refinement(struct csp_process_factory spec_,
+                         struct csp_process_factory impl_)
+{
+    size_t i;
+    for (i = 0; i < REFINEMENT_CONFIGURATION_COUNT; i++) {
+        check_with_msg(!traces_refinement_holds(spec_, impl_,
+                                                &refinement_configurations[i],
+                                                false),
+                       "Refinement should not hold (configuration %zu)", i);
+        check_with_msg(!traces_refinement_holds(spec_, impl_,
+                                                &refinement_configurations[i],
+                                                true),
+                       "Refinement should not hold (configuration %zu with GC)",
+                       i);
+    }
 }
 
 TEST_CASE_GROUP("traces refinement");
@@ -409,3 +559,212 @@ TEST_CASE("a → STOP ⊓ b → STOP ⊑T a → STOP ⊓ b → STOP")
     check_traces_refinement(csp0("a → STOP ⊓ b → STOP"),
                             csp0("a → STOP ⊓ b → STOP"));
 }
+
+TEST_CASE("a → b → STOP ⊓ a → c → STOP ⊑T a → b → STOP")
+{
+    check_traces_refinement(csp0("a → b → STOP ⊓ a → c → STOP"),
+                            csp0("a → b → STOP"));
+}
+
+TEST_CASE("a → b → STOP ⊓ a → c → STOP ⋤T a → d → STOP")
+{
+    xcheck_traces_refinement(csp0("a → b → STOP ⊓ a → c → STOP"),
+                             csp0("a → d → STOP"));
+}
+
+TEST_CASE("let X=a → X within X ⊑T let Y=a → Y within Y")
+{
+    check_traces_refinement(csp0("let X=a → X within X"),
+                            csp0("let Y=a → Y within Y"));
+}
+
+TEST_CASE("let X=a → X within X ⋤T let Y=a → (Y □ b → STOP) within Y")
+{
+    xcheck_traces_refinement(csp0("let X=a → X within X"),
+                             csp0("let Y=a → (Y □ b → STOP) within Y"));
+}
+
+/*------------------------------------------------------------------------------
+ * Antichains
+ */
+
+TEST_CASE_GROUP("antichains");
+
+TEST_CASE("antichains skip pairs with larger Spec sets")
+{
+    struct csp *csp;
+    struct csp_process *spec;
+    struct csp_process *impl;
+    struct csp_refinement_options options = csp_refinement_options();
+    struct csp_refinement_stats stats;
+    check_alloc(csp, csp_new());
+    /* After the first `a`, Impl is back in its initial state, but Spec's set of
+     * possible states has grown; that pair is subsumed by the initial one. */
+    spec = csp_process_factory_create(
+            csp, csp0("let X=a → (X ⊓ c → STOP) within X"));
+    impl = csp_process_factory_create(csp, csp0("let Y=a → Y within Y"));
+    options.engine = CSP_REFINEMENT_ANTICHAINS;
+    check(csp_check_traces_refinement_with(csp, spec, impl, &options,
+                                           &stats));
+    check(stats.subsumed_count > 0);
+    csp_free(csp);
+}
+
+/*------------------------------------------------------------------------------
+ * Bisimulation up to congruence
+ */
+
+TEST_CASE_GROUP("bisimulation up to congruence");
+
+TEST_CASE("HKC skips pairs that follow from earlier pairs")
+{
+    struct csp *csp;
+    struct csp_process *spec;
+    struct csp_process *impl;
+    struct csp_refinement_options options = csp_refinement_options();
+    struct csp_refinement_stats stats;
+    check_alloc(csp, csp_new());
+    /* Impl and Spec both loop back to their initial states, so the pair that
+     * we reach after each `a` is the same as the initial pair. */
+    spec = csp_process_factory_create(
+            csp, csp0("let X=a → (X ⊓ c → STOP) within X"));
+    impl = csp_process_factory_create(csp, csp0("let Y=a → Y within Y"));
+    options.engine = CSP_REFINEMENT_HKC;
+    check(csp_check_traces_refinement_with(csp, spec, impl, &options,
+                                           &stats));
+    check(stats.subsumed_count > 0);
+    csp_free(csp);
+}
+
+TEST_CASE("HKC chains rewrites together")
+{
+    struct csp *csp;
+    struct csp_process *spec;
+    struct csp_process *impl;
+    struct csp_refinement_options options = csp_refinement_options();
+    struct csp_refinement_stats stats;
+    check_alloc(csp, csp_new());
+    /* Let S1 = e → STOP □ f → STOP, S2 = g → STOP □ h → STOP, and P = e → STOP.
+     * After `a` we visit ({S1, P}, {S1}), and after `b` we visit
+     * ({S2, P, h → STOP}, {S2, P}).  The pair after `d,c` is
+     * ({S1, S2, P, h → STOP}, {S1, S2}), which we can only skip by using the
+     * first rewrite to add P, and then the second one (which needs P) to add
+     * h → STOP. */
+    spec = csp_process_factory_create(
+            csp, csp0("a → (e → STOP □ f → STOP) □ "
+                      "b → (g → STOP □ h → STOP) □ b → e → STOP □ "
+                      "d → (c → (e → STOP □ f → STOP) □ "
+                      "     c → (g → STOP □ h → STOP))"));
+    impl = csp_process_factory_create(
+            csp, csp0("a → e → STOP □ b → h → STOP □ "
+                      "d → (c → e → STOP □ c → h → STOP)"));
+    options.engine = CSP_REFINEMENT_HKC;
+    check(csp_check_traces_refinement_with(csp, spec, impl, &options,
+                                           &stats));
+    check(stats.pair_count == 4);
+    csp_free(csp);
+}
+
+/*------------------------------------------------------------------------------
+ * Memory budget
+ */
+
+TEST_CASE_GROUP("memory budget");
+
+/* Impl has 3⁵ states, which is plenty to blow through a small budget.  (Impl
+ * can terminate once every component has stopped, so Spec has to allow ✔.) */
+#define BUDGET_SPEC                                                   \
+    "let X=□ {a1 → X, b1 → X, a2 → X, b2 → X, a3 → X, b3 → X, a4 → X, " \
+    "b4 → X, a5 → X, b5 → X, SKIP} within X"
+#define BUDGET_IMPL                                                       \
+    "⫴ {a1 → b1 → STOP, a2 → b2 → STOP, a3 → b3 → STOP, a4 → b4 → STOP, " \
+    "a5 → b5 → STOP}"
+
+static void
+check_memory_budget(enum csp_refinement_engine engine)
+{
+    struct csp *csp;
+    struct csp_process *spec;
+    struct csp_process *impl;
+    struct csp_refinement_options options = csp_refinement_options();
+    struct csp_refinement_stats stats;
+    check_alloc(csp, csp_new());
+    spec = csp_process_factory_create(csp, csp0(BUDGET_SPEC));
+    impl = csp_process_factory_create(csp, csp0(BUDGET_IMPL));
+    options.engine = engine;
+    /* Run out of memory partway through the check. */
+    csp_set_memory_budget(csp, csp_memory_usage(csp) + 4 * 1024);
+    csp_session_begin(csp);
+    check(csp_try_traces_refinement(csp, spec, impl, &options, &stats) ==
+          CSP_REFINEMENT_EXHAUSTED);
+    check(stats.pair_count > 0);
+    check(stats.depth > 0);
+    check(stats.frontier_size > 0);
+    csp_session_end(csp);
+    /* And then try again without a budget. */
+    csp_set_memory_budget(csp, 0);
+    csp_session_begin(csp);
+    check(csp_try_traces_refinement(csp, spec, impl, &options, &stats) ==
+          CSP_REFINEMENT_HOLDS);
+    check(stats.depth > 0);
+    check(stats.frontier_size == 0);
+    csp_session_end(csp);
+    csp_free(csp);
+}
+
+TEST_CASE("normalization stops when it runs out of memory")
+{
+    check_memory_budget(CSP_REFINEMENT_NORMALIZATION);
+}
+
+TEST_CASE("antichains stop when they run out of memory")
+{
+    check_memory_budget(CSP_REFINEMENT_ANTICHAINS);
+}
+
+TEST_CASE("HKC stops when it runs out of memory")
+{
+    check_memory_budget(CSP_REFINEMENT_HKC);
+}
+
+TEST_CASE("checks ignore the budget unless you ask")
+{
+    struct csp *csp;
+    struct csp_process *spec;
+    struct csp_process *impl;
+    check_alloc(csp, csp_new());
+    spec = csp_process_factory_create(csp, csp0(BUDGET_SPEC));
+    impl = csp_process_factory_create(csp, csp0(BUDGET_IMPL));
+    csp_set_memory_budget(csp, 1);
+    check(csp_memory_exhausted(csp));
+    check(csp_check_traces_refinement(csp, spec, impl));
+    csp_free(csp);
+}
+
+TEST_CASE("budgets only count the environment's own memory")
+{
+    struct csp *csp1;
+    struct csp *csp2;
+    struct csp_process *process;
+    size_t total_before;
+    size_t i;
+    check_alloc(csp1, csp_new());
+    check_alloc(csp2, csp_new());
+    csp_set_memory_budget(csp1, csp_memory_usage(csp1) + 64 * 1024);
+    total_before = csp_memory_total_bytes();
+    /* Fill up the other environment well past csp1's budget. */
+    process = csp2->stop;
+    for (i = 0; i < 10000; i++) {
+        process = csp_prefix(csp2, csp_event_get("a"), process);
+    }
+    check(csp_memory_total_bytes() > total_before + 64 * 1024);
+    check(!csp_memory_exhausted(csp1));
+    /* But creating processes in csp1 itself does count. */
+    process = csp1->stop;
+    for (i = 0; i < 10000; i++) {
+        process = csp_prefix(csp1, csp_event_get("a"), process);
+    }
+    check(csp_memory_exhausted(csp1));
+    csp_free(csp1);
+    csp_free(csp2);
+}
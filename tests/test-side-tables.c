@@ -0,0 +1,88 @@
+/* -*- coding: utf-8 -*-
+ * -----------------------------------------------------------------------------
+ * Copyright © 2016-2017, HST Project.
+ * Please see the COPYING file in this distribution for license details.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "side-table.h"
+
+#include <stdint.h>
+
+#include "test-case-harness.h"
+
+struct depth {
+    uint32_t depth;
+    uint32_t parent;
+};
+
+static void
+count_nonzero(void *ud, void *element)
+{
+    size_t *count = ud;
+    struct depth *entry = element;
+    if (entry->depth != 0) {
+        (*count)++;
+    }
+}
+
+TEST_CASE_GROUP("side tables");
+
+TEST_CASE("can create empty side table")
+{
+    struct csp_side_table table;
+    csp_side_table_init(&table, sizeof(struct depth));
+    check(csp_side_table_get(&table, 0) == NULL);
+    check(csp_side_table_get(&table, 5000) == NULL);
+    csp_side_table_done(&table, NULL, NULL);
+}
+
+TEST_CASE("new elements are zeroed")
+{
+    struct csp_side_table table;
+    const struct depth *entry;
+    csp_side_table_init(&table, sizeof(struct depth));
+    ((struct depth *) csp_side_table_at(&table, 10))->depth = 3;
+    /* Other elements in the same chunk exist, and are zero. */
+    entry = csp_side_table_get(&table, 11);
+    check(entry != NULL);
+    check(entry->depth == 0 && entry->parent == 0);
+    entry = csp_side_table_get(&table, 10);
+    check(entry->depth == 3);
+    /* But other chunks haven't been allocated yet. */
+    check(csp_side_table_get(&table, 10 + CSP_SIDE_TABLE_CHUNK_SIZE) == NULL);
+    csp_side_table_done(&table, NULL, NULL);
+}
+
+TEST_CASE("elements don't move when the table grows")
+{
+    struct csp_side_table table;
+    struct depth *first;
+    size_t i;
+    csp_side_table_init(&table, sizeof(struct depth));
+    first = csp_side_table_at(&table, 0);
+    first->depth = 1;
+    for (i = 1; i < 100 * CSP_SIDE_TABLE_CHUNK_SIZE; i += 7) {
+        struct depth *entry = csp_side_table_at(&table, i);
+        entry->depth = i;
+        entry->parent = i - 1;
+    }
+    check(csp_side_table_at(&table, 0) == first);
+    for (i = 1; i < 100 * CSP_SIDE_TABLE_CHUNK_SIZE; i += 7) {
+        const struct depth *entry = csp_side_table_get(&table, i);
+        check(entry->depth == i && entry->parent == i - 1);
+    }
+    csp_side_table_done(&table, NULL, NULL);
+}
+
+TEST_CASE("can free side table entries")
+{
+    struct csp_side_table table;
+    size_t count = 0;
+    csp_side_table_init(&table, sizeof(struct depth));
+    ((struct depth *) csp_side_table_at(&table, 1))->depth = 1;
+    ((struct depth *) csp_side_table_at(&table, 2))->depth = 1;
+    ((struct depth *) csp_side_table_at(&table, 50000))->depth = 1;
+    csp_side_table_done(&table, count_nonzero, &count);
+    check(count == 3);
+}